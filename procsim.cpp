@@ -1,6 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
 #include "procsim.hpp"
+#include "procsim_branch.hpp"
+#include "procsim_dcache.hpp"
+#include "procsim_perf.hpp"
 
 //Boolean
 #define FALSE 	-1
@@ -11,10 +16,26 @@
 #define EMPTY  		3
 #define HAS_ROOM  	4
 
+//Retire records handed to the callback at once
+#define RETIRE_BATCH 1024
+//Minimum instructions buffered by push_proc
+#define PUSH_BUFFER  4096
+
+//Checkpoint file identification
+#define CHECKPOINT_MAGIC   0x4B435350		//"PSCK"
+#define CHECKPOINT_VERSION 9
+
+//Back-to-back reads timing the host counters before a stage breakdown
+#define PERF_CALIBRATION 256
+
+//Priority levels of the bucketed issue policies, larger priorities share the top one
+#define PRIORITY_LEVELS 16
+
 //Field Status
 #define UNINITIALIZED -2
 #define READY         -3
 #define DONE          -4
+#define MEMORY        -5		//left its unit, the data cache access is still running
 
 //Register structure
 typedef struct _reg{
@@ -23,11 +44,12 @@ typedef struct _reg{
 
 //CDB node
 typedef struct _CDBbus{
-	int line_number;
+	int64_t line_number;
 	int ind;
 	int tag; 
 	int reg;
 	int FU; 
+	int thread;
 } CDBbus;
 
 //Linked list node
@@ -35,18 +57,25 @@ typedef struct _node{
 	_node *next;
 	_node *prev;
 	proc_inst_t p_inst;
-	int line_number;
+	int64_t line_number;
 	int ind;
 	int destTag;
 	int src1Tag;
 	int src2Tag;
 	int age;
-	int fetch;
-	int disp;
-	int sched;
-	int exec;
-	int state;
-	int retire;
+	int fu;				//FU class
+	int consumers;		//later instructions that read its result, counted at their dispatch
+	int thread;			//hardware thread
+	int64_t threadLine;	//line number within the thread's trace
+	int mispredicted;	//branch the predictor got wrong, fetch waits for it
+	int memLevel;		//DCACHE_* level that served its data access
+	int memLeft;		//cycles of the access still to run once its unit is done
+	int64_t fetch;
+	int64_t disp;
+	int64_t sched;
+	int64_t exec;
+	int64_t state;
+	int64_t retire;
 } node;
 //Pointers for Linked List 
 typedef struct _llPointers{
@@ -60,15 +89,19 @@ typedef struct _llPointers{
 //Structure for ROB
 typedef struct _ROB{
 	proc_inst_t p_inst;
-	int line_number;
+	int64_t line_number;
 	int destTag;
 	int done;
-	int fetch;
-	int disp;
-	int sched;
-	int exec;
-	int state;
-	int retire;
+	int thread;
+	int64_t threadLine;
+	int mispredicted;
+	int memLevel;
+	int64_t fetch;
+	int64_t disp;
+	int64_t sched;
+	int64_t exec;
+	int64_t state;
+	int64_t retire;
 } ROB;
 //Pointers for circular FIFO array
 typedef struct _FIFOPointers{
@@ -77,72 +110,202 @@ typedef struct _FIFOPointers{
 	int size;
 } FIFOPointers; 
 
-
-//Initialization Parameters
-uint64_t r = 0; 
-uint64_t k0 = 0;
-uint64_t k1 = 0;
-uint64_t k2 = 0;
-uint64_t f = 0;
-uint64_t m = 0;
-
-//Register file
-reg regFile[32];		
-
-//Dispatcher
-llPointers dispatchPointers; 
-
-//Scheudler
-llPointers k0QueuePointers; 
-llPointers k1QueuePointers; 
-llPointers k2QueuePointers; 
-
-//Execute
-node** inK0;
-node** inK1;
-node** inK2;
-
-//ROB Table for execution
-ROB *ROBTable;
-FIFOPointers ROBPointers; 
-
-//array to represent CDB
-CDBbus* CDB;
-CDBbus* tempCDB;
-int CDBsize = 0;
-int tempCDBsize = 0;
-
-//Holds line number
-int instruction;
-//File done flag
-int readDoneFlag  = 1;
-int flag = 1; 
-//Clock
-int cycle = 1;
-
-//remove
-int add0, add1, add2;
+//Architectural state and instruction source of one hardware thread
+typedef struct _hwThread{
+	reg regFile[32];
+	FIFOPointers ROBPointers;	//the thread's part of the shared ROB
+	proc_source_fn source;
+	void* sourceContext;
+	int64_t instruction;		//instructions fetched, numbers the thread's lines
+	int drained;				//source has returned false
+	int inFlight;				//fetched and not yet issued, for ICOUNT
+	int64_t fetchResume;		//cycle fetch restarts after a mispredict, INT64_MAX until it resolves
+	int64_t retired;			//instructions retired after the warmup
+} hwThread;
+
+//Processor instance: all state for one simulated core
+typedef struct _proc_t{
+	//Initialization Parameters
+	uint64_t r;
+	uint64_t k0;
+	uint64_t k1;
+	uint64_t k2;
+	uint64_t f;
+	uint64_t m;
+	uint64_t dispatchWidth;		//0 for no limit
+	uint64_t cdbWidth;			//0 for no limit
+	uint64_t retireWidth;
+
+	//Hardware threads, each with its own register file and ROB FIFO
+	hwThread thread[PROC_MAX_THREADS];
+	int threads;
+	int fetchPolicy;
+	int fetchNext;				//round-robin fetch starts from this thread
+	int retireNext;				//retirement starts from this thread
+
+	//Dispatcher
+	llPointers dispatchPointers;
+
+	//FU classes, the reference k0/k1/k2 ones unless the configuration has a table
+	proc_fu_t fu[PROC_MAX_CLASSES];
+	int classes;
+	int slots[PROC_MAX_CLASSES];		//instructions a class holds in flight
+	int opClass[PROC_MAX_OPCODE+2];		//class of opcode-1, -1 if no class executes it
+	int legacyIssue;					//reference k0/k1/k2 issue rules, see checkAge
+
+	//Scheudler, one queue per class. Each class's availExec counts its free FU
+	//slots; with a unified scheduler the instructions wait in unifiedQueue instead.
+	llPointers queue[PROC_MAX_CLASSES];
+	llPointers unifiedQueue;
+	int unified;
+
+	//Issue selection
+	int policy;
+	uint64_t issueWidth;		//0 for no limit
+	int rrNext;					//class round-robin starts from this cycle
+	int entries;				//scheduler entries over all classes
+	node** ready[PROC_MAX_CLASSES];	//ready instructions of each class, oldest first
+	int readyCount[PROC_MAX_CLASSES];
+	node** order;				//all ready instructions in policy order
+	node** sorted;				//scratch for the bucket sort
+
+	//Execute
+	node** inFU[PROC_MAX_CLASSES];
+	int64_t* unitFree[PROC_MAX_CLASSES];	//cycle each unit accepts its next instruction
+
+	//ROB Table for execution, R entries per thread of which R in use at once
+	ROB *ROBTable;
+	int ROBUsed;
+
+	//array to represent CDB
+	CDBbus* CDB;
+	CDBbus* tempCDB;
+	int CDBsize;
+	int tempCDBsize;
+	int CDBcapacity;			//entries allocated in each CDB buffer
+
+	//Nodes for every instruction between fetch and retire, indexed by tag
+	node* nodePool;
+	int tags;					//2*R tags per thread recycled in its fetch order
+
+	//Holds line number
+	int64_t instruction;
+	//File done flag
+	int readDoneFlag;
+	int flag;
+	//Clock
+	int64_t cycle;
+
+	//Branch prediction, shared by the threads
+	predictor_t predictor;
+	uint64_t mispredictPenalty;
+	int64_t branches;			//retired after the warmup
+	int64_t mispredictions;
+
+	//Data cache, and the memory instructions that left their unit for it
+	proc_config_t memoryConfig;	//configuration the cache was built from
+	dcache_t dcache;
+	node** memWait;
+	int memWaitCount;
+	int64_t accesses;			//retired after the warmup
+	int64_t l1Misses;
+	int64_t l2Misses;
+
+	//Dispatched this cycle per class, and in total
+	int added[PROC_MAX_CLASSES];
+	int addedAll;
+
+	//Retire sink
+	proc_retire_fn retireSink;
+	void* retireContext;
+	proc_retire_t* retireBatch;	//records not yet handed to retireSink
+	int retireCount;
+
+	//Instructions handed over by push_proc, a ring buffer
+	proc_inst_t* pushBuffer;
+	uint64_t pushHead;
+	uint64_t pushCount;
+	uint64_t pushCapacity;
+
+	//Warmup control
+	uint64_t warmup;			//instructions retired before stats are counted
+	int64_t warmupCycle;		//cycle the last warmup instruction retired
+	int64_t retired;			//instructions retired so far
+
+	//Periodic checkpointing
+	const char* checkpointPath;
+	uint64_t checkpointInterval;	//cycles between checkpoints, 0 for none
+
+	//Run control
+	proc_stop_t stop;
+	int stopReason;				//PROC_STOP_*, set once a criterion fires
+	int64_t windowRetired;		//retired count at the start of the IPC sample
+	int64_t windowEnd;			//measured cycle that closes the IPC sample
+	double* windowIPC;			//last stop.windows samples, a ring
+	uint64_t samples;			//samples taken so far
+
+	//Host counters read between stages, NULL unless set_stage_perf_proc enabled them
+	const perf_t* perf;
+	perf_counts_t perfLast;		//counts at the last stage boundary
+	perf_counts_t perfOverhead;	//counts of one read of the counters, taken off every stage
+	perf_counts_t stageCounts[PROC_STAGES];
+} proc_t;
+
+//Instance owned by each host thread, and the one currently being simulated
+static thread_local proc_t threadProc;
+static thread_local proc_t* P = NULL;
 
 /////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////ROB MANIPULATION//////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////
 /*
-* printROB
-* Prints information in node
+* flushRetired
+* Hands the batched retire records to the callback
+*
+* parameters: 
+* none
+*
+* returns:
+* none
+*/
+void flushRetired(){
+	if (P->retireCount > 0 && P->retireSink != NULL){
+		P->retireSink(P->retireBatch, P->retireCount, P->retireContext);
+	}
+	P->retireCount = 0;
+}
+
+/*
+* recordROB
+* Adds the timing of a retiring entry to the retire batch
 *
 * parameters: 
-* int index - index to print
+* int index - index to record
 *
 * returns:
 * none
 */
-void printROB(int index){
-	printf("%d\t%d\t%d\t%d\t%d\t%d\t%d\n", ROBTable[index].line_number, ROBTable[index].fetch, ROBTable[index].disp, ROBTable[index].sched, ROBTable[index].exec, ROBTable[index].state, ROBTable[index].retire);
+void recordROB(int index){
+	proc_retire_t* record = &P->retireBatch[P->retireCount++];
+
+	record->p_inst = P->ROBTable[index].p_inst;
+	record->line_number = P->ROBTable[index].threadLine;
+	record->thread = P->ROBTable[index].thread;
+	record->fetch = P->ROBTable[index].fetch;
+	record->disp = P->ROBTable[index].disp;
+	record->sched = P->ROBTable[index].sched;
+	record->exec = P->ROBTable[index].exec;
+	record->state = P->ROBTable[index].state;
+	record->retire = P->ROBTable[index].retire;
+
+	if (P->retireCount == RETIRE_BATCH){
+		flushRetired();
+	}
 }
 
 /*
 * statusROB
-* Returns status of the ROB
+* Returns status of the ROB, shared by all threads
 *
 * parameters: 
 * none
@@ -152,9 +315,9 @@ void printROB(int index){
 */
 int statusROB(){
 
-	if(ROBPointers.tail==ROBPointers.head && ROBPointers.size == 0){
+	if(P->ROBUsed == 0){
 		return EMPTY;
-	}else if(ROBPointers.head == ROBPointers.tail){
+	}else if(P->ROBUsed == (int)P->r){
 		return FULL;
 	}else{
 		return HAS_ROOM;
@@ -163,7 +326,7 @@ int statusROB(){
 
 /*
 * addROB
-* Adds element to ROB
+* Adds element to the ROB FIFO of its thread
 *
 * parameters: 
 * node* dispatchNode - the node being added
@@ -172,16 +335,21 @@ int statusROB(){
 * int - ind into ROB, -1 if no room
 */
 int addROB(node* dispatchNode){
-	int ind = ROBPointers.tail;		//tag added to 
+	FIFOPointers* rob = &P->thread[dispatchNode->thread].ROBPointers;
+	int ind = dispatchNode->thread*P->r + rob->tail;		//tag added to 
 
 	if (statusROB()!=FULL){			//if there is room in the ROB
 		//Put item into ROB table
-		ROBTable[ROBPointers.tail].line_number = dispatchNode->line_number;
-		ROBTable[ROBPointers.tail].destTag = dispatchNode->destTag;
-		ROBTable[ROBPointers.tail].p_inst = dispatchNode->p_inst;
-		ROBTable[ROBPointers.tail].done = 0;
-		ROBPointers.tail = (ROBPointers.tail+1)%r;
-		ROBPointers.size++;
+		P->ROBTable[ind].line_number = dispatchNode->line_number;
+		P->ROBTable[ind].destTag = dispatchNode->destTag;
+		P->ROBTable[ind].p_inst = dispatchNode->p_inst;
+		P->ROBTable[ind].done = 0;
+		P->ROBTable[ind].thread = dispatchNode->thread;
+		P->ROBTable[ind].threadLine = dispatchNode->threadLine;
+		P->ROBTable[ind].mispredicted = dispatchNode->mispredicted;
+		rob->tail = (rob->tail+1)%P->r;
+		rob->size++;
+		P->ROBUsed++;
 	}else{
 		return FALSE;
 	}
@@ -201,30 +369,53 @@ int addROB(node* dispatchNode){
 */
 void updateROB(int index){
 	//Mark as complete
-	ROBTable[index].done = 1; 
+	P->ROBTable[index].done = 1; 
 }
 
 /*
 * removeROB
-* Removes head element from ROB
+* Removes head element from the ROB FIFO of a thread
 *
 * parameters: 
-* none
+* int t - thread
 *
 * returns:
 * none
 */
-void removeROB(){
+void removeROB(int t){
+	FIFOPointers* rob = &P->thread[t].ROBPointers;
+	int head = t*P->r + rob->head;
+
 	//Update stats
-	ROBTable[ROBPointers.head].retire = cycle;
-	//Print stats
-	printROB(ROBPointers.head);
+	P->ROBTable[head].retire = P->cycle;
+	//Report stats
+	if (P->retireSink != NULL){
+		recordROB(head);
+	}
+
+	//Remember where the warmup prefix ended
+	P->retired++;
+	if (P->retired == (int64_t)P->warmup){
+		P->warmupCycle = P->cycle;
+	}else if (P->retired > (int64_t)P->warmup){
+		P->thread[t].retired++;
+		if (P->ROBTable[head].p_inst.branch != PROC_BRANCH_NONE){
+			P->branches++;
+			P->mispredictions += P->ROBTable[head].mispredicted;
+		}
+		if (P->ROBTable[head].memLevel != DCACHE_NONE){
+			P->accesses++;
+			P->l1Misses += (P->ROBTable[head].memLevel >= DCACHE_L2);
+			P->l2Misses += (P->ROBTable[head].memLevel == DCACHE_MEMORY);
+		}
+	}
 
-	ROBTable[ROBPointers.head].done = 0; 
+	P->ROBTable[head].done = 0; 
 
 	//Fix ROB queue
-	ROBPointers.head = (ROBPointers.head+1)%r;
-	ROBPointers.size--;
+	rob->head = (rob->head+1)%P->r;
+	rob->size--;
+	P->ROBUsed--;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -241,13 +432,14 @@ void removeROB(){
 * none
 */
 void updateROBfromNode(node* update){
-	ROBTable[update->ind].line_number = update->line_number;
-	ROBTable[update->ind].fetch = update->fetch;
-	ROBTable[update->ind].disp = update->disp;
-	ROBTable[update->ind].sched = update->sched;
-	ROBTable[update->ind].exec = update->exec;
-	ROBTable[update->ind].state = update->state;
-	ROBTable[update->ind].retire = update->retire;
+	P->ROBTable[update->ind].line_number = update->line_number;
+	P->ROBTable[update->ind].fetch = update->fetch;
+	P->ROBTable[update->ind].disp = update->disp;
+	P->ROBTable[update->ind].sched = update->sched;
+	P->ROBTable[update->ind].exec = update->exec;
+	P->ROBTable[update->ind].state = update->state;
+	P->ROBTable[update->ind].retire = update->retire;
+	P->ROBTable[update->ind].memLevel = update->memLevel;
 }
 
 /*
@@ -311,12 +503,11 @@ int addLL(llPointers* pointersIn, node* nextNode){
 * parameters: 
 * llPointers* pointersIn - pointers to linked list
 * node* deleteNode       - node to delete
-* int freeMem			 - free memory
 *
 * returns:
 * none
 */
-void removeLL(llPointers* pointersIn, node* deleteNode, int freeMem){
+void removeLL(llPointers* pointersIn, node* deleteNode){
 	if (deleteNode->prev==NULL){			//Head element
 		if (deleteNode->next==NULL){		//Special case where there is only 1 element
 			pointersIn->head = NULL;
@@ -334,36 +525,45 @@ void removeLL(llPointers* pointersIn, node* deleteNode, int freeMem){
 	}
 	//Add room to linked list
 	pointersIn->size++;
-
-	//Free the node if desired
-	if (freeMem==TRUE){
-		free(deleteNode);		//Free allocated memory
-	}
 }
 
 /*
 * createNode
-* Creates node for dispatcher
+* Creates node for dispatcher. Each thread owns a range of 2*R tags. At most
+* 2*R of a thread's instructions are between fetch and retire (R in its ROB,
+* at most R more in the shared dispatch queue) and they are consecutive in
+* the thread's own order, so thread_line mod 2*R is unique within the range
+* and names the node's pool slot. Threads retire independently, so the line
+* number counting fetches over all threads cannot name tags.
 *
 * parameters: 
-* int line_number    - line number of instruction
-* proc_inst_t p_inst - instruction of the node
+* proc_inst_t p_inst   - instruction of the node
+* int64_t line_number  - fetches over all threads
+* int thread           - hardware thread fetching it
+* int64_t thread_line  - fetches of that thread
 *
 * returns:
 * node* - node that has been created
 */
-node* createNode(proc_inst_t p_inst, int line_number){
-	node* newNode = (node*) malloc(sizeof(node));	//Create a new node
+node* createNode(proc_inst_t p_inst, int64_t line_number, int thread, int64_t thread_line){
+	int tag = thread*2*P->r + thread_line % (2*P->r);
+	node* newNode = &P->nodePool[tag];		//Reuse the slot of the tag
 
 	//Copy over data
 	newNode->p_inst = p_inst;
 	newNode->line_number = line_number;
-	newNode->destTag = line_number;
+	newNode->destTag = tag;
 
 	//Add valididty data
 	newNode->src1Tag = UNINITIALIZED;
 	newNode->src2Tag = UNINITIALIZED;
 	newNode->age = UNINITIALIZED;
+	newNode->consumers = 0;
+	newNode->thread = thread;
+	newNode->threadLine = thread_line;
+	newNode->mispredicted = 0;
+	newNode->memLevel = DCACHE_NONE;
+	newNode->memLeft = 0;
 
 	//Return Data
 	return newNode; 
@@ -380,6 +580,7 @@ node* createNode(proc_inst_t p_inst, int line_number){
 * none
 */
 void createNodeforSched(node* dispatchNode){
+	reg* regFile = P->thread[dispatchNode->thread].regFile;
 
 	//Add valididty data
 	if (dispatchNode->p_inst.src_reg[0]!=-1){
@@ -393,6 +594,14 @@ void createNodeforSched(node* dispatchNode){
 		dispatchNode->src2Tag = READY;
 	}
 
+	//Count a consumer for each producer still in flight
+	if (dispatchNode->src1Tag >= 0){
+		P->nodePool[dispatchNode->src1Tag].consumers++;
+	}
+	if (dispatchNode->src2Tag >= 0){
+		P->nodePool[dispatchNode->src2Tag].consumers++;
+	}
+
 	//Fix register file
 	if (dispatchNode->p_inst.dest_reg!=-1){
 		regFile[dispatchNode->p_inst.dest_reg].tag = dispatchNode->destTag;
@@ -406,9 +615,45 @@ void createNodeforSched(node* dispatchNode){
 
 ///////////////////////////INSTUCTION FETCH/DECODE///////////////////////////////////
 
+/*
+* fetchThread
+* Picks the thread that fetches this cycle: the next in turn, or with ICOUNT
+* the one with the fewest instructions waiting to issue, ties going to the
+* next in turn. Threads whose source has run dry or that wait for a
+* mispredicted branch are passed over.
+*
+* parameters: 
+* none 
+*
+* returns:
+* int - thread, FALSE once every source has run dry
+*/
+int fetchThread(){
+	int pick = FALSE;
+
+	for (int i = 0; i < P->threads; i++){
+		int t = (P->fetchNext + i)%P->threads;
+		if (P->thread[t].drained || P->cycle < P->thread[t].fetchResume){
+			continue;
+		}
+		if (pick == FALSE || P->thread[t].inFlight < P->thread[pick].inFlight){
+			pick = t;
+		}
+		if (P->fetchPolicy != PROC_FETCH_ICOUNT){
+			break;
+		}
+	}
+	if (pick != FALSE){
+		P->fetchNext = (pick+1)%P->threads;
+	}
+	return pick;
+}
+
 /*
 * fetchInstructions
-* Fetch Instcutions
+* Fetch Instcutions, up to F from one thread. A branch predicted taken ends
+* the group, fetch goes on at its target next cycle; a mispredicted one stops
+* the thread's fetch until it resolves, standing in for the wrong path.
 *
 * parameters: 
 * none 
@@ -420,44 +665,94 @@ void fetchInstructions(){
 	//Node of new instruction
 	node* readNode;
 	//Instruction
-	proc_inst_t* p_inst;
+	proc_inst_t p_inst;
 	//Flag
 	int readFlag = TRUE;
+	//Thread fetching this cycle
+	hwThread* thread;
+	int t;
 
-	//Allocate memory for isntructions
-	p_inst = (proc_inst_t*) malloc(sizeof(proc_inst_t));
+	if ((P->dispatchPointers.size+P->addedAll) <= 0 || (t = fetchThread()) == FALSE){
+		return;
+	}
+	thread = &P->thread[t];
 
 	//Fetch F instructions at a time
-	for (int i = 0; i<f && readFlag==TRUE; i++){
-		if ((dispatchPointers.size+add0+add1+add2) > 0){		//if there is room in dispatcher queue
+	for (uint64_t i = 0; i<P->f && readFlag==TRUE; i++){
+		if ((P->dispatchPointers.size+P->addedAll) > 0){		//if there is room in dispatcher queue
 
 			//Read in  instruction
-			readFlag = read_instruction(p_inst);									//fetch instruction
+			readFlag = (thread->source != NULL) && thread->source(&p_inst, thread->sourceContext);									//fetch instruction
 			
 			//Check if end of file reached
 			if (readFlag==TRUE){		//If thre is an instruction
-				instruction++;									
+				//A register outside the file names none rather than a stray tag
+				for (int s = 0; s < 2; s++){
+					if (p_inst.src_reg[s] < -1 || p_inst.src_reg[s] >= PROC_REGISTERS){
+						p_inst.src_reg[s] = -1;
+					}
+				}
+				if (p_inst.dest_reg < -1 || p_inst.dest_reg >= PROC_REGISTERS){
+					p_inst.dest_reg = -1;
+				}
+				P->instruction++;									
+				thread->instruction++;
+				thread->inFlight++;
 				//Create new node
-				readNode = createNode(*p_inst, instruction);
-				readNode->fetch = cycle;
-				readNode->disp = cycle + 1;
+				readNode = createNode(p_inst, P->instruction, t, thread->instruction);
+				readNode->fetch = P->cycle;
+				readNode->disp = P->cycle + 1;
 				//Add node to list of instructions
-				addLL(&dispatchPointers, readNode);	//add to dispatch queue
+				addLL(&P->dispatchPointers, readNode);	//add to dispatch queue
+
+				//Predict branches with a known outcome
+				if (p_inst.branch != PROC_BRANCH_NONE && P->predictor.kind != PROC_PREDICT_NONE){
+					bool taken = (p_inst.branch == PROC_BRANCH_TAKEN);
+					bool predicted = predictor_predict(&P->predictor, p_inst.instruction_address);
+
+					predictor_update(&P->predictor, p_inst.instruction_address, taken);
+					if (predicted != taken){
+						readNode->mispredicted = 1;
+						thread->fetchResume = INT64_MAX;
+						break;
+					}
+					if (taken){
+						break;
+					}
+				}
 
 			}else{
-				readDoneFlag = 0;
+				//The trace ends once every thread's has
+				thread->drained = 1;
+				P->readDoneFlag = 0;
+				for (int j = 0; j < P->threads; j++){
+					if (!P->thread[j].drained){
+						P->readDoneFlag = 1;
+					}
+				}
 			}
 	
 		}else{
 			break;
 		}
 	}
-
-	//Free memory
-	free(p_inst);
 }
 
 ///////////////////////////DISPATCH///////////////////////////////////
+/*
+* schedQueue
+* Scheduler queue an instruction of a class waits in
+*
+* parameters: 
+* int c - FU class
+*
+* returns:
+* llPointers* - the class's queue, or the unified queue
+*/
+llPointers* schedQueue(int c){
+	return P->unified ? &P->unifiedQueue : &P->queue[c];
+}
+
 /*
 * setUpRegs
 * Reads the registers for instructions
@@ -475,10 +770,10 @@ void setUpRegs(){
 	node* dispatchNode, *dispatchNodeTemp;
 
 	//Initialize initial node to be dispatched
-	dispatchNode = dispatchPointers.head;
+	dispatchNode = P->dispatchPointers.head;
 
 	//Read from dispatch queue
-	while(i++<(add0+add1+add2) && dispatchNode!=NULL){
+	while(i++<P->addedAll && dispatchNode!=NULL){
 		//Add scheduling info
 		createNodeforSched(dispatchNode);
 
@@ -486,26 +781,31 @@ void setUpRegs(){
 		dispatchNodeTemp = dispatchNode;
 		dispatchNode = dispatchNode->next;
 		//Remove item from dispatcher queue
-		removeLL(&dispatchPointers, dispatchNodeTemp, FALSE);
-		//Add to queue linked list
-		if ((dispatchNodeTemp->p_inst.op_code == 0 || dispatchNodeTemp->p_inst.op_code == -1 )){
-			addLL(&k0QueuePointers, dispatchNodeTemp);	
-		}
-		//Add to queue linked list
-		if (dispatchNodeTemp->p_inst.op_code == 1){
-			addLL(&k1QueuePointers, dispatchNodeTemp);
-	
-		}
-		//Add to queue linked list
-		if (dispatchNodeTemp->p_inst.op_code == 2){
-			addLL(&k2QueuePointers, dispatchNodeTemp);
-	
-		}
+		removeLL(&P->dispatchPointers, dispatchNodeTemp);
+		//Add to the queue of its class
+		addLL(schedQueue(dispatchNodeTemp->fu), dispatchNodeTemp);
 
 	}
 }
 
 
+/*
+* classOf
+* FU class that executes an opcode
+*
+* parameters: 
+* int32_t op_code - opcode from the trace
+*
+* returns:
+* int - class, -1 if no class executes it
+*/
+int classOf(int32_t op_code){
+	if (op_code < -1 || op_code > PROC_MAX_OPCODE){
+		return -1;
+	}
+	return P->opClass[op_code+1];
+}
+
 /*
 * dispatchToScheduler
 * Dispatch to Scheduler
@@ -521,67 +821,37 @@ void dispatchToScheduler(){
 	node* dispatchNode;
 	//Flag
 	int dispatcherFlag = TRUE;
-	//Instruction being looked at
-	proc_inst_t instructionDispatch;
 	//Tag;
 	int ind; 
 
 	//Initialize initial node to be dispatched
-	dispatchNode = dispatchPointers.head;		//Node for instruction in dispatch queue
+	dispatchNode = P->dispatchPointers.head;		//Node for instruction in dispatch queue
 
 	//Read from dispatch queue
 	while(dispatcherFlag!=FALSE && dispatchNode!=NULL){
+		int c = classOf(dispatchNode->p_inst.op_code);
 
-		instructionDispatch = dispatchNode->p_inst; 	//Get instruction
-
-		//add to correct scheduling queue and ROB and remove from dispatcher
-		if ((instructionDispatch.op_code == 0 || instructionDispatch.op_code == -1 ) && (k0QueuePointers.size-add0)>0){
-
-			if (statusROB()!=FULL){
-				add0++;
-				//Add timing data	
-				dispatchNode->sched = cycle+1;
-
-				//Set so not in FU yet
-				dispatchNode->age = READY;
+		//Stop once the dispatch width is used up
+		if (P->dispatchWidth > 0 && (uint64_t)P->addedAll >= P->dispatchWidth){
+			break;
+		}
 
-				//Add to ROB
-				ind = addROB(dispatchNode);	
-				//Copy over data
-				dispatchNode->ind = ind;
+		//An instruction nothing can execute would wait here forever
+		if (c < 0 || P->fu[c].count == 0 || P->m == 0){
+			P->stopReason = PROC_STOP_BLOCKED;
+			break;
+		}
 
-				//Go to next item in scheduler
-				dispatchNode = dispatchNode->next;
-			}else{
-				//if ROB full, stop dispatch
-				dispatcherFlag = FALSE;
-			}
-		}else if(instructionDispatch.op_code == 1 && (k1QueuePointers.size-add1)>0){
+		//add to correct scheduling queue and ROB and remove from dispatcher
+		if ((P->unified ? P->unifiedQueue.size-P->addedAll : P->queue[c].size-P->added[c])>0){
 			if (statusROB()!=FULL){
-				add1++;
+				P->added[c]++;
+				P->addedAll++;
+				dispatchNode->fu = c;
 
 				//Add timing data
-				dispatchNode->sched = cycle+1;
-				//Set so not in FU yet
-				dispatchNode->age = READY;
-
-				//Add to ROB
-				ind = addROB(dispatchNode);	
-				//Copy over data
-				dispatchNode->ind = ind;
-
-				//Go to next item in scheduler
-				dispatchNode = dispatchNode->next;
-			}else{
-				//if ROB full, stop dispatch
-				dispatcherFlag = FALSE;
-			}
-		}else if(instructionDispatch.op_code == 2 && (k2QueuePointers.size-add2)>0){
-			if (statusROB()!=FULL){
-				add2++;
+				dispatchNode->sched = P->cycle+1;
 
-				//Add timing data
-				dispatchNode->sched = cycle+1;
 				//Set so not in FU yet
 				dispatchNode->age = READY;
 
@@ -590,7 +860,6 @@ void dispatchToScheduler(){
 				//Copy over data
 				dispatchNode->ind = ind;
 
-
 				//Go to next item in scheduler
 				dispatchNode = dispatchNode->next;
 			}else{
@@ -616,9 +885,10 @@ void dispatchToScheduler(){
 * none
 */
 void dispatchInstructions1(){
-	add0 = 0;
-	add1 = 0;
-	add2 = 0;
+	for (int c = 0; c < P->classes; c++){
+		P->added[c] = 0;
+	}
+	P->addedAll = 0;
 
 	dispatchToScheduler();
 }
@@ -641,42 +911,47 @@ void dispatchInstructions2(){
 ///////////////////////////SCHEDULE///////////////////////////////////
 
 /*
+* checkAge
+* Finds a unit of a class that can take an instruction this cycle. The reference
+* k0/k1/k2 classes keep the rules the original simulator applied: k1 and k2 issue
+* at most k per cycle counting their first 2*k slots, and k0 issue waits while k0
+* or more of the first k0 k1 slots hold an instruction in its last cycle.
+*
+* parameters: 
+* int unit - FU class
+*
+* returns:
+* int - unit to use, FALSE if none is free
 */
 int checkAge(int unit){
 	int count = 0;
 
-	if (unit == 0){
-		for (int j = 0; j<k0; j++){
-			if (inK1[j]!=NULL && inK1[j]->age == 1){
-				count++;
-			}
-			if (count>=k0){
-				return 0;
-			}
+	if (P->legacyIssue){
+		int watch = (unit == 0) ? 1 : unit;
+		int age = (unit == 0) ? 1 : P->fu[unit].latency;
+		int window = (unit == 0) ? P->k0 : 2*P->fu[unit].count;
+
+		if (window > P->slots[watch]){
+			window = P->slots[watch];
 		}
-	}
-	if (unit == 1){
-		for (int j = 0; j<k1*2; j++){
-			if (inK1[j]!=NULL && inK1[j]->age == 2){
+		for (int j = 0; j<window; j++){
+			if (P->inFU[watch][j]!=NULL && P->inFU[watch][j]->age == age){
 				count++;
 			}
-			if (count>=k1){
-				return 0;
+			if (count>=(int)P->fu[unit].count){
+				return FALSE;
 			}
 		}
+		return 0;
 	}
-	if (unit == 2){
-		for (int j = 0; j<k2*2; j++){
-			if (inK2[j]!=NULL && inK2[j]->age == 3){
-				count++;
-			}
-			if (count>=k2){
-				return 0;
-			}
+
+	//A unit is free once its issue interval has passed
+	for (int j = 0; j<(int)P->fu[unit].count; j++){
+		if (P->unitFree[unit][j] <= P->cycle){
+			return j;
 		}
 	}
-
-	return 1;
+	return FALSE;
 }
 
 /*
@@ -693,150 +968,276 @@ void scheduleUpdate(){
  	//temporary node
  	node* updateNode; 
 
- 	//update k0 queue
- 	updateNode = k0QueuePointers.head;
- 	while (updateNode!=NULL){
- 		//go through CDB
- 		for (int j = 0;j<CDBsize; j++){
- 			if(CDB[j].tag==updateNode->src1Tag){
- 				updateNode->src1Tag = READY;
- 			} 
- 			if (CDB[j].tag==updateNode->src2Tag){
- 				updateNode->src2Tag = READY;
- 			}
- 		}
- 		//go to next element
- 		updateNode = updateNode->next;
- 	}
-
- 	//update k1 queue
- 	updateNode = k1QueuePointers.head;
- 	while (updateNode!=NULL){
- 		//go through CDB
- 		for (int j = 0;j<CDBsize; j++){
- 			if(CDB[j].tag==updateNode->src1Tag){
- 				updateNode->src1Tag = READY;
- 			}
- 			if (CDB[j].tag==updateNode->src2Tag){
- 				updateNode->src2Tag = READY;
- 			}
- 		}
-  		//go to next element
- 		updateNode = updateNode->next;
- 	}
-
- 	//update k2 queue
- 	updateNode = k2QueuePointers.head;
- 	while (updateNode!=NULL){
- 		//go through CDB
- 		for (int j = 0;j<CDBsize; j++){
- 			if(CDB[j].tag==updateNode->src1Tag){
- 				updateNode->src1Tag = READY;
- 			}
- 			if (CDB[j].tag==updateNode->src2Tag){
- 				updateNode->src2Tag = READY;
+ 	for (int c = 0; c < (P->unified ? 1 : P->classes); c++){
+ 		updateNode = schedQueue(c)->head;
+ 		while (updateNode!=NULL){
+ 			//go through CDB
+ 			for (int j = 0;j<P->CDBsize; j++){
+ 				if(P->CDB[j].tag==updateNode->src1Tag){
+ 					updateNode->src1Tag = READY;
+ 				} 
+ 				if (P->CDB[j].tag==updateNode->src2Tag){
+ 					updateNode->src2Tag = READY;
+ 				}
  			}
+ 			//go to next element
+ 			updateNode = updateNode->next;
  		}
-  		//go to next element
- 		updateNode = updateNode->next;
  	}
 }
 
 
 /*
-* scheduleInstructionstoFU
-* Schedule Instrutions to FU
+* issueToFU
+* Starts an instruction on a unit of its class. With a data cache a memory
+* instruction accesses it now; the unit keeps it for the class's latency and
+* the rest of the cache's latency runs outside the unit.
 *
 * parameters: 
-* none 
+* node* temp - instruction
+* int c      - FU class
+* int unit   - unit from checkAge
 *
 * returns:
 * none
 */
-void scheduleInstructionstoFU(){
-	//Scheduler
-	node* temp0 = k0QueuePointers.head;
-	node* temp1 = k1QueuePointers.head;
-	node* temp2 = k2QueuePointers.head;
+void issueToFU(node* temp, int c, int unit){
+	//Add new node to list
+	P->queue[c].availExec--;
+	P->thread[temp->thread].inFlight--;
+	temp->age = P->fu[c].latency;
+	if (!P->legacyIssue){
+		P->unitFree[c][unit] = P->cycle + P->fu[c].interval;
+	}
 
-	//Do while there is room in all schedulers
-	while(temp0 != NULL || temp1 != NULL || temp2 != NULL ){
+	//Data access
+	if (P->dcache.levels > 0 && temp->p_inst.memory){
+		uint32_t latency;
 
-		//Check if item can be put in k0 execute
-		if (temp0!=NULL && k0QueuePointers.availExec>0 && temp0->src1Tag == READY && temp0->src2Tag == READY && temp0->age == READY && checkAge(0)){
+		temp->memLevel = dcache_access(&P->dcache, temp->p_inst.data_address);
+		latency = P->dcache.latency[temp->memLevel];
+		temp->memLeft = (latency > P->fu[c].latency) ? latency - P->fu[c].latency : 0;
+	}
 
-			//Add new node to list
-			k0QueuePointers.availExec--;
-			temp0->age  = 1;
+	//Add cycle info
+	temp->exec = P->cycle+1;
 
-			//Add cycle info
-			temp0->exec = cycle+1;
+	//Store pointers for things currently in FU
+	for (int j = 0; j<P->slots[c]; j++){
+		if (P->inFU[c][j]==NULL){
+			P->inFU[c][j] = temp;
+			break;
+		}
+	}
+}
 
-			//Store pointers for things currently in FU	
-			for (int j = 0; j<k0; j++){
-				if (inK0[j]==NULL){
-					inK0[j] = temp0;
-					break;
-				}
+/*
+* gatherReady
+* Collects the ready instructions of each class, oldest first
+*
+* parameters: 
+* none 
+*
+* returns:
+* int - ready instructions over all classes
+*/
+int gatherReady(){
+	int total = 0;
+
+	for (int c = 0; c < P->classes; c++){
+		P->readyCount[c] = 0;
+	}
+	for (int q = 0; q < (P->unified ? 1 : P->classes); q++){
+		for (node* temp = schedQueue(q)->head; temp != NULL; temp = temp->next){
+			if (temp->src1Tag == READY && temp->src2Tag == READY && temp->age == READY){
+				P->ready[temp->fu][P->readyCount[temp->fu]++] = temp;
+				total++;
 			}
-	
-			//Go to next element
-			temp0 = temp0->next;
-		}else if (temp0 != NULL){
-			//Go to next element
-			temp0 = temp0->next;
 		}
+	}
+	return total;
+}
 
-		//Check if item can be put in k1 execute
-		if (temp1!=NULL && k1QueuePointers.availExec>0 && temp1->src1Tag == READY && temp1->src2Tag== READY && temp1->age == READY && checkAge(1)){
-			//Add new node to list
-			k1QueuePointers.availExec--;
-			temp1->age  = 2;
-			
-			//Add cycle info
-			temp1->exec = cycle+1;
-
-			//Store pointers for things currently in FU	
-			for (int j = 0; j<k1*2; j++){
-				if (inK1[j]==NULL){
-					inK1[j] = temp1;
-					break;
+/*
+* priorityOf
+* Rank of a ready instruction under the bucketed policies, higher issues first
+*
+* parameters: 
+* node* temp - ready instruction
+*
+* returns:
+* int - bucket, 0 to PRIORITY_LEVELS-1
+*/
+int priorityOf(node* temp){
+	int priority = (P->policy == PROC_POLICY_CRITICAL) ? temp->consumers : (int)P->fu[temp->fu].latency;
+
+	return (priority < PRIORITY_LEVELS) ? priority : PRIORITY_LEVELS-1;
+}
+
+/*
+* orderReady
+* Puts the ready instructions in policy order. The per-class lists are merged by
+* age, then the bucketed policies apply a stable counting sort on their priority;
+* round-robin deals the classes' lists out in turn. All linear in the ready count
+* for the fixed number of classes and priority levels.
+*
+* parameters: 
+* int total - ready instructions
+*
+* returns:
+* none
+*/
+void orderReady(int total){
+	int next[PROC_MAX_CLASSES] = {0};
+	int n = 0;
+
+	if (P->policy == PROC_POLICY_ROUND_ROBIN){
+		while (n < total){
+			for (int i = 0; i < P->classes; i++){
+				int c = (P->rrNext + i) % P->classes;
+				if (next[c] < P->readyCount[c]){
+					P->order[n++] = P->ready[c][next[c]++];
 				}
 			}
+		}
+		P->rrNext = (P->rrNext + 1) % P->classes;
+		return;
+	}
 
-			//Go to next element
-			temp1 = temp1->next;
-		}else if (temp1 != NULL){
-			//Go to next element
-			temp1 = temp1->next;
+	//Merge by age, classes are few
+	while (n < total){
+		int oldest = -1;
+		for (int c = 0; c < P->classes; c++){
+			if (next[c] < P->readyCount[c] &&
+				(oldest < 0 || P->ready[c][next[c]]->line_number < P->ready[oldest][next[oldest]]->line_number)){
+				oldest = c;
+			}
 		}
-		
-
-		//Check if item can be put in k2 execute
-		if (temp2!=NULL && k2QueuePointers.availExec>0 && temp2->src1Tag == READY && temp2->src2Tag== READY && temp2->age == READY  && checkAge(2)){
-			//Add new node to list
-			k2QueuePointers.availExec--;
-			temp2->age  = 3;
-
-			//Add cycle info
-			temp2->exec = cycle+1;
-
-			//Store pointers for things currently in FU	
-			for (int j = 0; j<k2*3; j++){
-				if (inK2[j]==NULL){
-					inK2[j] = temp2;
-					break;
-				}
-			}	
+		P->order[n++] = P->ready[oldest][next[oldest]++];
+	}
+	if (P->policy == PROC_POLICY_OLDEST){
+		return;
+	}
 
-			//Go to next element
-			temp2 = temp2->next;
-		}else if (temp2 != NULL){
-			//Go to next element
-			temp2 = temp2->next;
+	//Stable counting sort, highest priority first
+	int start[PRIORITY_LEVELS+1] = {0};
+	for (int i = 0; i < total; i++){
+		start[PRIORITY_LEVELS-1-priorityOf(P->order[i])+1]++;
+	}
+	for (int b = 0; b < PRIORITY_LEVELS; b++){
+		start[b+1] += start[b];
+	}
+	for (int i = 0; i < total; i++){
+		P->sorted[start[PRIORITY_LEVELS-1-priorityOf(P->order[i])]++] = P->order[i];
+	}
+	memcpy(P->order, P->sorted, total*sizeof(node*));
+}
+
+/*
+* selectByPolicy
+* Issues ready instructions in the order of the issue policy, up to the units of
+* each class and the issue width
+*
+* parameters: 
+* none 
+*
+* returns:
+* none
+*/
+void selectByPolicy(){
+	bool blocked[PROC_MAX_CLASSES];
+	uint64_t issued = 0;
+	int total = gatherReady();
+
+	orderReady(total);
+	for (int c = 0; c < P->classes; c++){
+		blocked[c] = (P->queue[c].availExec <= 0);
+	}
+	for (int i = 0; i < total && (P->issueWidth == 0 || issued < P->issueWidth); i++){
+		node* temp = P->order[i];
+		int c = temp->fu;
+		if (blocked[c]){
+			continue;
+		}
+
+		//Once no unit of the class can take an instruction, later ones cannot either
+		int unit = checkAge(c);
+		if (unit == FALSE){
+			blocked[c] = true;
+			continue;
+		}
+		issueToFU(temp, c, unit);
+		issued++;
+		if (P->queue[c].availExec <= 0){
+			blocked[c] = true;
+		}
+	}
+}
+
+/*
+* scheduleInstructionstoFU
+* Schedule Instrutions to FU. Classes do not affect each other's choices within a
+* cycle, so each queue is scanned oldest first on its own. A unified queue is
+* scanned oldest first once, skipping classes that cannot issue any more.
+*
+* parameters: 
+* none 
+*
+* returns:
+* none
+*/
+void scheduleInstructionstoFU(){
+	if (P->policy != PROC_POLICY_OLDEST || P->issueWidth > 0){
+		selectByPolicy();
+		return;
+	}
+
+	if (P->unified){
+		bool blocked[PROC_MAX_CLASSES];
+		int open = 0;
+
+		for (int c = 0; c < P->classes; c++){
+			blocked[c] = (P->queue[c].availExec <= 0);
+			open += blocked[c] ? 0 : 1;
+		}
+		for (node* temp = P->unifiedQueue.head; temp != NULL && open > 0; temp = temp->next){
+			int c = temp->fu;
+			if (blocked[c] || temp->src1Tag != READY || temp->src2Tag != READY || temp->age != READY){
+				continue;
+			}
+
+			//Once no unit of the class can take an instruction, later ones cannot either
+			int unit = checkAge(c);
+			if (unit == FALSE){
+				blocked[c] = true;
+				open--;
+				continue;
+			}
+			issueToFU(temp, c, unit);
+			if (P->queue[c].availExec <= 0){
+				blocked[c] = true;
+				open--;
+			}
 		}
+		return;
 	}
 
+	for (int c = 0; c < P->classes; c++){
+		llPointers* queue = &P->queue[c];
+
+		for (node* temp = queue->head; temp != NULL && queue->availExec > 0; temp = temp->next){
+			if (temp->src1Tag != READY || temp->src2Tag != READY || temp->age != READY){
+				continue;
+			}
+
+			//Stop at the first instruction no unit can take, later ones cannot issue either
+			int unit = checkAge(c);
+			if (unit == FALSE){
+				break;
+			}
+			issueToFU(temp, c, unit);
+		}
+	}
 }
 
 /*
@@ -880,18 +1281,19 @@ void scheduleInstructions2(){
 */
 /*void updateReg(){
 	//Update register file
-	for (int i = 0; i < CDBsize; i++){
-		if (regFile[CDB[i].reg].tag == CDB[i].tag){
-			regFile[CDB[i].reg].tag = READY;
+	for (int i = 0; i < P->CDBsize; i++){
+		if (P->regFile[P->CDB[i].reg].tag == P->CDB[i].tag){
+			P->regFile[P->CDB[i].reg].tag = READY;
 		}
 	}
 }
 */
 void updateReg(){
-	//Update register file
-	for (int i = 0; i < tempCDBsize; i++){
-		if (regFile[tempCDB[i].reg].tag == tempCDB[i].tag){
-			regFile[tempCDB[i].reg].tag = READY;
+	//Update the register file of each result's thread, results without a destination write nothing
+	for (int i = 0; i < P->tempCDBsize; i++){
+		reg* regFile = P->thread[P->tempCDB[i].thread].regFile;
+		if (P->tempCDB[i].reg >= 0 && regFile[P->tempCDB[i].reg].tag == P->tempCDB[i].tag){
+			regFile[P->tempCDB[i].reg].tag = READY;
 		}
 	}
 }
@@ -908,43 +1310,20 @@ void updateReg(){
 * none
 */
 void removeFU(){
-	//Execute k0 instructions
-	for (int j= 0; j<k0; j++){
-		if (inK0[j] != NULL){
-			//Check if instructions is done
-			if (inK0[j]->age == DONE){
-				k0QueuePointers.availExec++;
-				inK0[j] = NULL;
-			}
-		}
-	}
-
-	//Execute k1 instructions
-	for (int j= 0; j<k1*2; j++){
-		if (inK1[j] != NULL){
-			//Check if instructions is done
-			if (inK1[j]->age == DONE){
-				k1QueuePointers.availExec++;
-				inK1[j] = NULL;
-			}
-		}
-	}	
-
-	//Execute k2 instructions
-	for (int j= 0; j<k2*3; j++){
-		if (inK2[j] != NULL){
+	for (int c = 0; c < P->classes; c++){
+		for (int j= 0; j<P->slots[c]; j++){
 			//Check if instructions is done
-			if (inK2[j]->age == DONE){
-				k2QueuePointers.availExec++;
-				inK2[j] = NULL;
+			if (P->inFU[c][j] != NULL && (P->inFU[c][j]->age == DONE || P->inFU[c][j]->age == MEMORY)){
+				P->queue[c].availExec++;
+				P->inFU[c][j] = NULL;
 			}
 		}
 	}
 }
 
 /*
-* incrementTimer
-* Increment Age
+* orderCDB
+* Order CDB
 *
 * parameters: 
 * none 
@@ -952,72 +1331,117 @@ void removeFU(){
 * returns:
 * none
 */
-void incrementTimer(){
-	//Reset CDB bus
-	tempCDBsize = 0;
+void orderCDB(){
+	//Temporary CDB holder
+	CDBbus tempCDB2;
 
-	//Execute k0 instructions
-	for (int j= 0; j<k0; j++){
-		if (inK0[j] != NULL){
-			//Decrease time left
-			inK0[j]->age--;
-			//Check if instructions is done
-			if (inK0[j]->age == 0){
-				tempCDB[tempCDBsize].tag = inK0[j]->destTag;
-				tempCDB[tempCDBsize].ind = inK0[j]->ind;
-				tempCDB[tempCDBsize].FU = 0;
-				tempCDB[tempCDBsize].line_number = inK0[j]->line_number;
-				tempCDB[tempCDBsize++].reg = inK0[j]->p_inst.dest_reg;
-				//Add cycle info
-				inK0[j]->state = cycle+1;
-
-				//Fix up FU array
-				inK0[j]->age = DONE;
-			}
+	//Go though all elements and switch as necessary
+	for(int i=0; i<P->tempCDBsize; i++){
+        for(int j=i; j<P->tempCDBsize; j++){
+           	if(P->tempCDB[i].line_number > P->tempCDB[j].line_number){
+           		tempCDB2=P->tempCDB[i];
+ 	      		P->tempCDB[i]=P->tempCDB[j];
+               	P->tempCDB[j]=tempCDB2;
+           	}
+        }
+    }
+
+}
+
+/*
+* requestCDB
+* Enters a finished instruction in this cycle's competition for the CDB
+*
+* parameters: 
+* node* ready - finished instruction
+* int c       - its FU class
+*
+* returns:
+* none
+*/
+void requestCDB(node* ready, int c){
+	P->tempCDB[P->tempCDBsize].tag = ready->destTag;
+	P->tempCDB[P->tempCDBsize].ind = ready->ind;
+	P->tempCDB[P->tempCDBsize].FU = c;
+	P->tempCDB[P->tempCDBsize].line_number = ready->line_number;
+	P->tempCDB[P->tempCDBsize].thread = ready->thread;
+	P->tempCDB[P->tempCDBsize++].reg = ready->p_inst.dest_reg;
+}
+
+/*
+* incrementTimer
+* Increment Age. Finished instructions compete for the CDB, the oldest win
+* and the rest keep their FU slot and try again next cycle. A memory
+* instruction still accessing the data cache leaves its unit to wait.
+*
+* parameters: 
+* none 
+*
+* returns:
+* none
+*/
+void incrementTimer(){
+	//Reset CDB bus
+	P->tempCDBsize = 0;
+
+	//Data accesses running outside their units
+	for (int i = 0; i < P->memWaitCount; i++){
+		node* wait = P->memWait[i];
+		if (wait->memLeft > 0){
+			wait->memLeft--;
+		}
+		if (wait->memLeft == 0){
+			requestCDB(wait, wait->fu);
 		}
 	}
 
-	//Execute k1 instructions
-	for (int j= 0; j<k1*2; j++){
-		if (inK1[j] != NULL){
-			//Decrease time left
-			inK1[j]->age--;
-			//Check if instructions is done
-			if (inK1[j]->age == 0){
-				tempCDB[tempCDBsize].tag = inK1[j]->destTag;
-				tempCDB[tempCDBsize].ind = inK1[j]->ind;
-				tempCDB[tempCDBsize].FU = 1;
-				tempCDB[tempCDBsize].line_number = inK1[j]->line_number;
-				tempCDB[tempCDBsize++].reg = inK1[j]->p_inst.dest_reg;	
-
-				//Add cycle info
-				inK1[j]->state = cycle+1;				
-				//Fix up FU array					
-				inK1[j]->age = DONE;
+	for (int c = 0; c < P->classes; c++){
+		for (int j= 0; j<P->slots[c]; j++){
+			node* inFU = P->inFU[c][j];
+			if (inFU != NULL && inFU->age != DONE){
+				//Decrease time left, a result waiting for the CDB stays at 0
+				if (inFU->age > 0){
+					inFU->age--;
+				}
+				//Check if instructions is done
+				if (inFU->age == 0 && inFU->memLeft > 0){
+					inFU->age = MEMORY;
+					P->memWait[P->memWaitCount++] = inFU;
+				}else if (inFU->age == 0){
+					requestCDB(inFU, c);
+				}
 			}
 		}
-	}	
+	}
 
-	//Execute k2 instructions
-	for (int j= 0; j<k2*3; j++){
-		if (inK2[j] != NULL){
-			//Decrease time left
-			inK2[j]->age--;
-			//Check if instructions is done
-			if (inK2[j]->age == 0){
-				tempCDB[tempCDBsize].tag = inK2[j]->destTag;
-				tempCDB[tempCDBsize].ind = inK2[j]->ind;
-				tempCDB[tempCDBsize].FU = 2;
-				tempCDB[tempCDBsize].line_number = inK2[j]->line_number;
-				tempCDB[tempCDBsize++].reg = inK2[j]->p_inst.dest_reg;
-				//Add cycle info
-				inK2[j]->state = cycle+1;					
-				//Fix up FU array					
-				inK2[j]->age = DONE;
-			}
+	//Oldest results take the broadcast slots
+	if (P->cdbWidth > 0 && (uint64_t)P->tempCDBsize > P->cdbWidth){
+		orderCDB();
+		P->tempCDBsize = P->cdbWidth;
+	}
+
+	for (int i = 0; i < P->tempCDBsize; i++){
+		node* done = &P->nodePool[P->tempCDB[i].tag];
+		//Add cycle info
+		done->state = P->cycle+1;
+
+		//Fix up FU array
+		done->age = DONE;
+
+		//A mispredicted branch lets its thread fetch again once resolved
+		if (done->mispredicted){
+			P->thread[done->thread].fetchResume = done->state + 1 + P->mispredictPenalty;
 		}
 	}
 
+	//Broadcast accesses stop waiting
+	int kept = 0;
+	for (int i = 0; i < P->memWaitCount; i++){
+		if (P->memWait[i]->age != DONE){
+			P->memWait[kept++] = P->memWait[i];
+		}
+	}
+	P->memWaitCount = kept;
 }
 
 /*
@@ -1032,38 +1456,11 @@ void incrementTimer(){
 */
 void exchangeCDB(){
 	//Put temporary in correct
-	for (int i = 0; i<tempCDBsize ;i++){
-		CDB[i] = tempCDB[i];
+	for (int i = 0; i<P->tempCDBsize ;i++){
+		P->CDB[i] = P->tempCDB[i];
 	}
-	CDBsize = tempCDBsize;
-}
-/*
-* orderCDB
-* Order CDB
-*
-* parameters: 
-* none 
-*
-* returns:
-* none
-*/
-void orderCDB(){
-	//Temporary CDB holder
-	CDBbus tempCDB2;
-
-	//Go though all elements and switch as necessary
-	for(int i=0; i<tempCDBsize; i++){
-        for(int j=i; j<tempCDBsize; j++){
-           	if(tempCDB[i].line_number > tempCDB[j].line_number){
-           		tempCDB2=tempCDB[i];
- 	      		tempCDB[i]=tempCDB[j];
-               	tempCDB[j]=tempCDB2;
-           	}
-        }
-    }
-
+	P->CDBsize = P->tempCDBsize;
 }
-
 /*
 * executeInstructions1
 * Execute Instcutions
@@ -1111,8 +1508,8 @@ void executeInstructions2(){
 * none
 */
 void markROBDone(){
-	for (int i= 0; i < CDBsize; i++){
-		updateROB(CDB[i].ind);
+	for (int i= 0; i < P->CDBsize; i++){
+		updateROB(P->CDB[i].ind);
 	}
 }
 
@@ -1130,54 +1527,28 @@ void removeScheduler(){
 	//Node for access to scheduler
 	node* updateNode;
 
-	for(int j = 0;j<CDBsize; j++){
-		if (CDB[j].FU == 0){
-			//Navigate though k0 scheduler
-			updateNode = k0QueuePointers.head;
- 			while (updateNode!=NULL){
- 				if (CDB[j].tag==updateNode->destTag){
- 					updateNode->retire = cycle;
- 					updateROBfromNode(updateNode);
- 					removeLL(&k0QueuePointers, updateNode,TRUE);
- 					break;
- 				}
- 				//go to next node
- 				updateNode = updateNode->next;
+	for(int j = 0;j<P->CDBsize; j++){
+		llPointers* queue = schedQueue(P->CDB[j].FU);
+
+		//Navigate though the scheduler of the class
+		updateNode = queue->head;
+		while (updateNode!=NULL){
+			if (P->CDB[j].tag==updateNode->destTag){
+				updateNode->retire = P->cycle;
+				updateROBfromNode(updateNode);
+				removeLL(queue, updateNode);
+				break;
 			}
-		}else if(CDB[j].FU == 1){
-			//Navigate though k0 scheduler
-			updateNode = k1QueuePointers.head;
- 			while (updateNode!=NULL){
- 				if (CDB[j].tag==updateNode->destTag){
- 					updateNode->retire = cycle;
- 					updateROBfromNode(updateNode);
- 					removeLL(&k1QueuePointers, updateNode,TRUE);
- 					break;
- 				}
- 				//go to next node
- 				updateNode = updateNode->next;
-			}
-		}else if (CDB[j].FU == 2){
-			//Navigate though k0 scheduler
-			updateNode = k2QueuePointers.head;
- 			while (updateNode!=NULL){
- 				if (CDB[j].tag==updateNode->destTag){
- 					updateNode->retire = cycle;
- 					updateROBfromNode(updateNode);
- 					removeLL(&k2QueuePointers, updateNode,TRUE);
- 					break;
- 				}
- 				//go to next node
- 				updateNode = updateNode->next;
-			}
-
+			//go to next node
+			updateNode = updateNode->next;
 		}
 	}
 }
 
 /*
 * retireInstructions
-* Retire completed instruction in ROB
+* Retire completed instruction in ROB. Each thread retires in its own program
+* order; the thread that goes first rotates every cycle.
 *
 * parameters: 
 * none 
@@ -1187,22 +1558,29 @@ void removeScheduler(){
 */
 void retireInstructions(){
 	int indexROB;
-	int initHead = ROBPointers.head;
+	uint64_t retiredNow = 0;
 
 	//Retire as many instructions as possible
-	for (int i = 0; i<f; i++){
-		indexROB = (initHead + i)%r;
-		//check if it is valid and remove if it is
-		if (ROBTable[indexROB].done ==1 && (cycle - ROBTable[indexROB].state)>0){	//change 2.2
-			removeROB();
-		}else{		//if not done, stop removing
-			break;
+	for (int i = 0; i < P->threads && retiredNow < P->retireWidth; i++){
+		int t = (P->retireNext + i)%P->threads;
+		FIFOPointers* rob = &P->thread[t].ROBPointers;
+
+		while (retiredNow < P->retireWidth && rob->size > 0){
+			indexROB = t*P->r + rob->head;
+			//check if it is valid and remove if it is
+			if (P->ROBTable[indexROB].done ==1 && (P->cycle - P->ROBTable[indexROB].state)>0){	//change 2.2
+				removeROB(t);
+				retiredNow++;
+			}else{		//if not done, stop removing
+				break;
+			}
 		}
 	}
+	P->retireNext = (P->retireNext+1)%P->threads;
 
-	//all instructions done
-	if (readDoneFlag == 0 && statusROB()==EMPTY){
-		flag = 0;
+	//all instructions done, none left waiting to dispatch either
+	if (P->readDoneFlag == 0 && statusROB()==EMPTY && P->dispatchPointers.head == NULL){
+		P->flag = 0;
 	}
 }
 
@@ -1236,15 +1614,749 @@ void updateState2(){
 	removeScheduler();
 	retireInstructions(); //change 2.2
 }
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////CHECKPOINTING////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+//Header written at the start of every checkpoint
+typedef struct _checkpointHeader{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nodeSize;
+	uint32_t ROBSize;
+	uint32_t CDBSize;
+} checkpointHeader;
+
+/*
+* setUpClasses
+* Derives the per-class slots and the opcode map from an FU table
+*
+* parameters: 
+* const proc_fu_t* table - FU classes
+* int classes            - entries in table
+* int legacy             - TRUE for the reference k0/k1/k2 classes
+*
+* returns:
+* none
+*/
+void setUpClasses(const proc_fu_t* table, int classes, int legacy){
+	P->classes = classes;
+	P->legacyIssue = (legacy == TRUE);
+	for (int op = 0; op < PROC_MAX_OPCODE+2; op++){
+		P->opClass[op] = -1;
+	}
+	for (int c = 0; c < classes; c++){
+		P->fu[c] = table[c];
+		if (P->fu[c].latency < 1){
+			P->fu[c].latency = 1;
+		}
+		if (P->fu[c].interval < 1){
+			P->fu[c].interval = 1;
+		}
+		//An instruction holds its slot for the whole latency, a unit takes one every interval
+		P->slots[c] = P->fu[c].count*((P->fu[c].latency + P->fu[c].interval - 1)/P->fu[c].interval);
+		//The first class claiming an opcode executes it
+		for (int op = 0; op < PROC_MAX_OPCODE+2; op++){
+			if ((P->fu[c].opcodes & (1u << op)) && P->opClass[op] < 0){
+				P->opClass[op] = c;
+			}
+		}
+	}
+}
+
+/*
+* allocateProc
+* Allocates the node pool, ROB, CDB, FU and retire arrays for the current parameters
+*
+* parameters: 
+* none
+*
+* returns:
+* none
+*/
+void allocateProc(){
+	 P->tags = P->threads*2*P->r;
+	 P->nodePool = (node*) calloc(P->tags, sizeof(node));		//Instructions in flight
+	 P->ROBTable = (ROB*) calloc(P->threads*P->r, sizeof(ROB));			//ROB
+	 int inFlight = 0;
+	 for (int c = 0; c < P->classes; c++){
+	 	inFlight += P->slots[c];
+	 }
+	 //Issue selection buffers, any class may hold every scheduler entry
+	 P->entries = 0;
+	 for (int c = 0; c < P->classes; c++){
+	 	P->entries += P->m*P->fu[c].count;
+	 }
+	 //Memory instructions waiting on the data cache are still in the scheduler
+	 P->memWait = (node**) malloc((P->entries+1)*sizeof(node*));
+	 P->CDBcapacity = inFlight+P->entries+10;
+	 P->CDB = (CDBbus *) malloc(P->CDBcapacity*sizeof(CDBbus));		//CDB
+	 P->tempCDB = (CDBbus *) malloc(P->CDBcapacity*sizeof(CDBbus));		//CDB
+	 //Arrays to hold pointers to currently in FU
+	 for (int c = 0; c < P->classes; c++){
+	 	P->inFU[c] = (node**) calloc(P->slots[c], sizeof(node*));
+	 	P->unitFree[c] = (int64_t*) calloc(P->fu[c].count, sizeof(int64_t));
+	 }
+	 for (int c = 0; c < P->classes; c++){
+	 	P->ready[c] = (node**) malloc((P->entries+1)*sizeof(node*));
+	 }
+	 P->order = (node**) malloc((P->entries+1)*sizeof(node*));
+	 P->sorted = (node**) malloc((P->entries+1)*sizeof(node*));
+	 P->retireBatch = (proc_retire_t*) malloc(RETIRE_BATCH*sizeof(proc_retire_t));
+}
+
+/*
+* freeProc
+* Frees what allocateProc and the configuration allocated, leaving NULL behind
+* so freeing an instance twice, or one never allocated, is harmless
+*
+* parameters: 
+* none
+*
+* returns:
+* none
+*/
+void freeProc(){
+	free(P->nodePool);
+	free(P->retireBatch);
+	free(P->pushBuffer);
+	free(P->CDB);
+	free(P->tempCDB);
+	free(P->ROBTable);
+	P->nodePool = NULL;
+	P->retireBatch = NULL;
+	P->pushBuffer = NULL;
+	P->CDB = NULL;
+	P->tempCDB = NULL;
+	P->ROBTable = NULL;
+	for (int c = 0; c < P->classes; c++){
+		free(P->inFU[c]);
+		free(P->unitFree[c]);
+		free(P->ready[c]);
+		P->inFU[c] = NULL;
+		P->unitFree[c] = NULL;
+		P->ready[c] = NULL;
+	}
+	free(P->order);
+	free(P->sorted);
+	free(P->windowIPC);
+	free(P->memWait);
+	P->order = NULL;
+	P->sorted = NULL;
+	P->windowIPC = NULL;
+	P->memWait = NULL;
+	predictor_free(&P->predictor);
+	dcache_free(&P->dcache);
+}
+
+/*
+* saveLL
+* Writes the nodes of a linked list in order
+*
+* parameters: 
+* FILE* out              - checkpoint file
+* llPointers* pointersIn - list to save
+*
+* returns:
+* none
+*/
+void saveLL(FILE* out, llPointers* pointersIn){
+	int count = 0;
+
+	for (node* n = pointersIn->head; n != NULL; n = n->next){
+		count++;
+	}
+	fwrite(&pointersIn->size, sizeof(int), 1, out);
+	fwrite(&pointersIn->availExec, sizeof(int), 1, out);
+	fwrite(&count, sizeof(int), 1, out);
+	for (node* n = pointersIn->head; n != NULL; n = n->next){
+		fwrite(n, sizeof(node), 1, out);
+	}
+}
+
+/*
+* restoreLL
+* Rebuilds a linked list written by saveLL
+*
+* parameters: 
+* FILE* in               - checkpoint file
+* llPointers* pointersIn - list to fill
+*
+* returns:
+* int - TRUE on success
+*/
+int restoreLL(FILE* in, llPointers* pointersIn){
+	int count;
+	int size;
+	int availExec;
+
+	if (fread(&size, sizeof(int), 1, in) != 1 || fread(&availExec, sizeof(int), 1, in) != 1 ||
+		fread(&count, sizeof(int), 1, in) != 1){
+		return FALSE;
+	}
+
+	*pointersIn = {NULL, NULL, 0, availExec};
+	for (int i = 0; i < count; i++){
+		node saved;
+		if (fread(&saved, sizeof(node), 1, in) != 1 || saved.destTag < 0 || saved.destTag >= P->tags){
+			return FALSE;
+		}
+		P->nodePool[saved.destTag] = saved;
+		addLL(pointersIn, &P->nodePool[saved.destTag]);
+	}
+	pointersIn->size = size;
+
+	return TRUE;
+}
+
+/*
+* saveFU
+* Writes each FU slot as the position of its node in the scheduler queue
+*
+* parameters: 
+* FILE* out              - checkpoint file
+* node** inK             - FU slots
+* int slots              - number of slots
+* llPointers* pointersIn - scheduler queue feeding the FU
+*
+* returns:
+* none
+*/
+void saveFU(FILE* out, node** inK, int slots, llPointers* pointersIn){
+	for (int j = 0; j < slots; j++){
+		int pos = FALSE;
+		int i = 0;
+		for (node* n = pointersIn->head; n != NULL && inK[j] != NULL; n = n->next, i++){
+			if (n == inK[j]){
+				pos = i;
+				break;
+			}
+		}
+		fwrite(&pos, sizeof(int), 1, out);
+	}
+}
+
+/*
+* restoreFU
+* Points each FU slot back at its node in the scheduler queue
+*
+* parameters: 
+* FILE* in               - checkpoint file
+* node** inK             - FU slots
+* int slots              - number of slots
+* llPointers* pointersIn - scheduler queue feeding the FU
+*
+* returns:
+* int - TRUE on success
+*/
+int restoreFU(FILE* in, node** inK, int slots, llPointers* pointersIn){
+	for (int j = 0; j < slots; j++){
+		int pos;
+		if (fread(&pos, sizeof(int), 1, in) != 1){
+			return FALSE;
+		}
+		inK[j] = NULL;
+		node* n = pointersIn->head;
+		for (int i = 0; pos != FALSE && n != NULL; i++, n = n->next){
+			if (i == pos){
+				inK[j] = n;
+				break;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+* writeCheckpoint
+* Writes the complete pipeline state of the current processor
+*
+* parameters: 
+* FILE* out - checkpoint file
+*
+* returns:
+* none
+*/
+void writeCheckpoint(FILE* out){
+	checkpointHeader header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, sizeof(node), sizeof(ROB), sizeof(CDBbus)};
+	uint64_t params[17] = {P->r, P->k0, P->k1, P->k2, P->f, P->m, P->dispatchWidth, P->cdbWidth, P->retireWidth,
+						   (uint64_t)P->unified, (uint64_t)P->policy, P->issueWidth, (uint64_t)P->threads,
+						   (uint64_t)P->fetchPolicy, (uint64_t)P->predictor.kind, P->predictor.bits,
+						   P->mispredictPenalty};
+	int64_t scalars[19] = {P->CDBsize, P->tempCDBsize, P->instruction, P->readDoneFlag, P->flag, P->cycle,
+						   P->addedAll, P->warmupCycle, P->retired, P->rrNext, P->fetchNext, P->retireNext,
+						   P->ROBUsed, P->branches, P->mispredictions, P->accesses, P->l1Misses, P->l2Misses,
+						   P->memWaitCount};
+	int32_t classes[2] = {P->classes, P->legacyIssue ? TRUE : FALSE};
+
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(params, sizeof(params), 1, out);
+	fwrite(classes, sizeof(classes), 1, out);
+	fwrite(P->fu, sizeof(proc_fu_t), P->classes, out);
+	fwrite(P->added, sizeof(int), P->classes, out);
+	fwrite(&P->warmup, sizeof(uint64_t), 1, out);
+	fwrite(scalars, sizeof(scalars), 1, out);
+
+	//Threads, with their register files and ROB FIFOs, and the ROB
+	fwrite(P->thread, sizeof(hwThread), P->threads, out);
+	fwrite(P->ROBTable, sizeof(ROB), P->threads*P->r, out);
+	predictor_save(&P->predictor, out);
+	fwrite(&P->memoryConfig, sizeof(proc_config_t), 1, out);
+	dcache_save(&P->dcache, out);
+
+	//Dispatch and scheduler queues
+	saveLL(out, &P->dispatchPointers);
+	for (int c = 0; c < P->classes; c++){
+		saveLL(out, &P->queue[c]);
+	}
+	saveLL(out, &P->unifiedQueue);
+
+	//FU occupancy
+	for (int c = 0; c < P->classes; c++){
+		saveFU(out, P->inFU[c], P->slots[c], schedQueue(c));
+		fwrite(P->unitFree[c], sizeof(int64_t), P->fu[c].count, out);
+	}
+	for (int i = 0; i < P->memWaitCount; i++){
+		fwrite(&P->memWait[i]->destTag, sizeof(int), 1, out);
+	}
+
+	//Both CDB buffers
+	fwrite(P->CDB, sizeof(CDBbus), P->CDBsize, out);
+	fwrite(P->tempCDB, sizeof(CDBbus), P->tempCDBsize, out);
+}
+
+/*
+* readCheckpoint
+* Replaces the current processor with the state in a checkpoint
+*
+* parameters: 
+* FILE* in - checkpoint file
+*
+* returns:
+* int - TRUE on success
+*/
+int readCheckpoint(FILE* in){
+	checkpointHeader header;
+	uint64_t params[17];
+	int64_t scalars[19];
+	int32_t classes[2];
+	proc_fu_t table[PROC_MAX_CLASSES];
+	proc_config_t config;
+
+	if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != CHECKPOINT_MAGIC ||
+		header.version != CHECKPOINT_VERSION || header.nodeSize != sizeof(node) ||
+		header.ROBSize != sizeof(ROB) || header.CDBSize != sizeof(CDBbus)){
+		return FALSE;
+	}
+	if (fread(params, sizeof(params), 1, in) != 1 || fread(classes, sizeof(classes), 1, in) != 1 ||
+		classes[0] < 1 || classes[0] > PROC_MAX_CLASSES ||
+		fread(table, sizeof(proc_fu_t), classes[0], in) != (size_t)classes[0]){
+		return FALSE;
+	}
+
+	//Allocation sizes and divisors come from the file, check them as a configuration
+	default_config_proc(&config);
+	config.r = params[0];
+	config.k0 = params[1];
+	config.k1 = params[2];
+	config.k2 = params[3];
+	config.f = params[4];
+	config.m = params[5];
+	config.dispatch = params[6];
+	config.cdb = params[7];
+	config.retire = params[8];
+	config.scheduler = params[9];
+	config.policy = params[10];
+	config.issue = params[11];
+	config.threads = params[12];
+	config.fetch = params[13];
+	config.predictor = params[14];
+	config.predictor_bits = params[15];
+	config.mispredict_penalty = params[16];
+	config.classes = classes[0];
+	memcpy(config.fu, table, classes[0]*sizeof(proc_fu_t));
+	if (check_config_proc(&config) != NULL){
+		return FALSE;
+	}
+	setUpClasses(table, classes[0], classes[1]);
+	if (fread(P->added, sizeof(int), P->classes, in) != (size_t)P->classes ||
+		fread(&P->warmup, sizeof(uint64_t), 1, in) != 1 ||
+		fread(scalars, sizeof(scalars), 1, in) != 1 || params[12] < 1 || params[12] > PROC_MAX_THREADS){
+		return FALSE;
+	}
+
+	P->r = params[0];
+	P->k0 = params[1];
+	P->k1 = params[2];
+	P->k2 = params[3];
+	P->f = params[4];
+	P->m = params[5];
+	P->dispatchWidth = params[6];
+	P->cdbWidth = params[7];
+	P->retireWidth = params[8];
+	P->unified = (int)params[9];
+	P->policy = (int)params[10];
+	P->issueWidth = params[11];
+	P->threads = (int)params[12];
+	P->fetchPolicy = (int)params[13];
+	P->mispredictPenalty = params[16];
+	P->CDBsize = scalars[0];
+	P->tempCDBsize = scalars[1];
+	P->instruction = scalars[2];
+	P->readDoneFlag = scalars[3];
+	P->flag = scalars[4];
+	P->cycle = scalars[5];
+	P->addedAll = scalars[6];
+	P->warmupCycle = scalars[7];
+	P->retired = scalars[8];
+	P->rrNext = scalars[9];
+	P->fetchNext = scalars[10];
+	P->retireNext = scalars[11];
+	P->ROBUsed = scalars[12];
+	P->branches = scalars[13];
+	P->mispredictions = scalars[14];
+	P->accesses = scalars[15];
+	P->l1Misses = scalars[16];
+	P->l2Misses = scalars[17];
+	P->memWaitCount = scalars[18];
+	allocateProc();
+	if (P->CDBsize < 0 || P->CDBsize > P->CDBcapacity || P->tempCDBsize < 0 || P->tempCDBsize > P->CDBcapacity){
+		return FALSE;
+	}
+	predictor_init(&P->predictor, (int)params[14], (uint32_t)params[15]);
+
+	//Threads and the ROB, sources are set again by the caller
+	if (fread(P->thread, sizeof(hwThread), P->threads, in) != (size_t)P->threads ||
+		fread(P->ROBTable, sizeof(ROB), P->threads*P->r, in) != P->threads*P->r ||
+		!predictor_restore(&P->predictor, in) || fread(&P->memoryConfig, sizeof(proc_config_t), 1, in) != 1 ||
+		check_config_proc(&P->memoryConfig) != NULL){
+		return FALSE;
+	}
+	dcache_init(&P->dcache, &P->memoryConfig);
+	if (!dcache_restore(&P->dcache, in)){
+		return FALSE;
+	}
+	for (int t = 0; t < P->threads; t++){
+		P->thread[t].source = NULL;
+		P->thread[t].sourceContext = NULL;
+	}
+
+	//Dispatch and scheduler queues
+	if (!restoreLL(in, &P->dispatchPointers)){
+		return FALSE;
+	}
+	for (int c = 0; c < P->classes; c++){
+		if (!restoreLL(in, &P->queue[c])){
+			return FALSE;
+		}
+	}
+	if (!restoreLL(in, &P->unifiedQueue)){
+		return FALSE;
+	}
+
+	//FU occupancy
+	for (int c = 0; c < P->classes; c++){
+		if (!restoreFU(in, P->inFU[c], P->slots[c], schedQueue(c)) ||
+			fread(P->unitFree[c], sizeof(int64_t), P->fu[c].count, in) != P->fu[c].count){
+			return FALSE;
+		}
+	}
+	if (P->memWaitCount < 0 || P->memWaitCount > P->entries){
+		return FALSE;
+	}
+	for (int i = 0; i < P->memWaitCount; i++){
+		int tag;
+		if (fread(&tag, sizeof(int), 1, in) != 1 || tag < 0 || tag >= P->tags){
+			return FALSE;
+		}
+		P->memWait[i] = &P->nodePool[tag];
+	}
+
+	//Both CDB buffers
+	if (fread(P->CDB, sizeof(CDBbus), P->CDBsize, in) != (size_t)P->CDBsize ||
+		fread(P->tempCDB, sizeof(CDBbus), P->tempCDBsize, in) != (size_t)P->tempCDBsize){
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+* checkpointProc
+* Atomically replaces the checkpoint file with the current state
+*
+* parameters: 
+* none
+*
+* returns:
+* none
+*/
+void checkpointProc(){
+	char tempPath[4096];
+	FILE* out;
+
+	//Everything retired before the checkpoint is reported before it is taken
+	flushRetired();
+
+	//Write beside the target and rename so a crash never leaves a torn checkpoint
+	snprintf(tempPath, sizeof(tempPath), "%s.tmp", P->checkpointPath);
+	out = fopen(tempPath, "wb");
+	if (out == NULL){
+		fprintf(stderr, "Failed to open %s for writing\n", tempPath);
+		return;
+	}
+	writeCheckpoint(out);
+	if (fclose(out) != 0 || rename(tempPath, P->checkpointPath) != 0){
+		fprintf(stderr, "Failed to write checkpoint %s\n", P->checkpointPath);
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////PIPELINE DRIVERS//////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////
 
 
+void initProc(const proc_config_t* config);
+
+/**
+ * Fills a configuration with the DEFAULT_* parameters.
+ *
+ * @config Configuration to fill
+ */
+void default_config_proc(proc_config_t* config) {
+	memset(config, 0, sizeof(proc_config_t));
+	config->r = DEFAULT_R;
+	config->k0 = DEFAULT_K0;
+	config->k1 = DEFAULT_K1;
+	config->k2 = DEFAULT_K2;
+	config->f = DEFAULT_F;
+	config->m = DEFAULT_M;
+}
+
+/**
+ * Checks that a configuration can be simulated: every parameter the engine
+ * divides by or sizes an array with is in range. A class of no units is
+ * accepted; a run stops with PROC_STOP_BLOCKED if one of its instructions
+ * reaches dispatch.
+ *
+ * @config Processor configuration
+ * @return NULL if valid, otherwise what is wrong with it
+ */
+const char* check_config_proc(const proc_config_t* config) {
+	proc_fu_t table[PROC_MAX_CLASSES];
+	uint64_t classes;
+	uint64_t entries = 0;
+	uint64_t slots = 0;
+	uint64_t line = (config->line > 0) ? config->line : DEFAULT_LINE;
+
+	if (config->r < 1 || config->r > PROC_MAX_ROB){
+		return "R must be between 1 and 65536";
+	}
+	if (config->f < 1 || config->f > PROC_MAX_WIDTH){
+		return "F must be between 1 and 65536";
+	}
+	if (config->m < 1 || config->m > PROC_MAX_ENTRIES){
+		return "M must be at least 1 and at most 1048576";
+	}
+	if (config->dispatch > PROC_MAX_WIDTH || config->cdb > PROC_MAX_WIDTH || config->retire > PROC_MAX_WIDTH ||
+		config->issue > PROC_MAX_WIDTH){
+		return "widths must be at most 65536";
+	}
+	if (config->scheduler > PROC_SCHED_UNIFIED || config->policy >= PROC_POLICIES ||
+		config->fetch >= PROC_FETCH_POLICIES || config->predictor >= PROC_PREDICTORS){
+		return "unknown scheduler, issue policy, fetch policy or predictor";
+	}
+	if (config->threads > PROC_MAX_THREADS){
+		return "at most 8 hardware threads";
+	}
+	if (config->classes > PROC_MAX_CLASSES){
+		return "at most 8 FU classes";
+	}
+
+	classes = fu_classes_proc(config, table);
+	for (uint64_t c = 0; c < classes; c++){
+		uint32_t latency = (table[c].latency > 0) ? table[c].latency : 1;
+		uint32_t interval = (table[c].interval > 0) ? table[c].interval : 1;
+
+		if (table[c].count > PROC_MAX_UNITS){
+			return "at most 65536 units per FU class";
+		}
+		if (latency > PROC_MAX_LATENCY){
+			return "FU latencies must be at most 1048576";
+		}
+		entries += config->m*table[c].count;
+		slots += table[c].count*((latency + interval - 1)/interval);
+	}
+	if (entries > PROC_MAX_ENTRIES || slots > PROC_MAX_ENTRIES){
+		return "M times the FU units, or the FU slots, exceed 1048576";
+	}
+
+	if (config->mispredict_penalty > PROC_MAX_LATENCY || config->memory_latency > PROC_MAX_LATENCY ||
+		config->l1.latency > PROC_MAX_LATENCY || config->l2.latency > PROC_MAX_LATENCY){
+		return "penalties and cache latencies must be at most 1048576";
+	}
+	if (config->l1.size > 0 && (line < 4 || config->l1.size/line > PROC_MAX_LINES || config->l2.size/line > PROC_MAX_LINES)){
+		return "cache lines must be at least 4 bytes, at most 2^24 per level";
+	}
+	return NULL;
+}
+
+/**
+ * Gives the FU classes a configuration simulates: its fu table, or without one
+ * the reference k0, k1 and k2 classes of latency 1, 2 and 3.
+ *
+ * @config Processor configuration
+ * @table Receives PROC_MAX_CLASSES or fewer classes
+ * @return Number of classes
+ */
+uint64_t fu_classes_proc(const proc_config_t* config, proc_fu_t* table) {
+	if (config->classes > 0){
+		uint64_t classes = (config->classes < PROC_MAX_CLASSES) ? config->classes : PROC_MAX_CLASSES;
+		memcpy(table, config->fu, classes*sizeof(proc_fu_t));
+		return classes;
+	}
+
+	memset(table, 0, 3*sizeof(proc_fu_t));
+	table[0] = {config->k0, 1, 1, PROC_OPCODE_BIT(-1) | PROC_OPCODE_BIT(0), 0};
+	table[1] = {config->k1, 2, 1, PROC_OPCODE_BIT(1), 0};
+	table[2] = {config->k2, 3, 1, PROC_OPCODE_BIT(2), 0};
+	return 3;
+}
+
+/**
+ * Gives the scheduler entries of a configuration, the same for either
+ * organization: M entries per functional unit.
+ *
+ * @config Processor configuration
+ * @return Total scheduler entries
+ */
+uint64_t scheduler_entries_proc(const proc_config_t* config) {
+	proc_fu_t table[PROC_MAX_CLASSES];
+	uint64_t classes = fu_classes_proc(config, table);
+	uint64_t entries = 0;
+
+	for (uint64_t c = 0; c < classes; c++){
+		entries += config->m*table[c].count;
+	}
+	return entries;
+}
+
+/**
+ * Initializes this thread's processor from a configuration.
+ *
+ * @config Processor configuration
+ */
+void configure_proc(const proc_config_t* config) {
+	//Bind this thread to its own processor instance
+	P = &threadProc;
+	initProc(config);
+}
+
+/*
+* initProc
+* Initializes the current processor instance from a configuration
+*
+* parameters: 
+* const proc_config_t* config - processor configuration
+*
+* returns:
+* none
+*/
+void initProc(const proc_config_t* config){
+	 //Set globally accessible
+	 P->r = config->r; 
+	 P->k0 = config->k0;
+	 P->k1 = config->k1;
+	 P->k2 = config->k2;
+	 P->f = config->f;
+	 P->m = config->m;
+	 P->dispatchWidth = config->dispatch;
+	 P->cdbWidth = config->cdb;
+	 P->retireWidth = (config->retire > 0) ? config->retire : config->f;
+
+	 //FU classes
+	 proc_fu_t table[PROC_MAX_CLASSES];
+	 int classes = fu_classes_proc(config, table);
+	 setUpClasses(table, classes, config->classes == 0 ? TRUE : FALSE);
+
+	 //Hardware threads, each with its own reg array and ROB FIFO
+	 P->threads = (config->threads > 1) ? config->threads : 1;
+	 if (P->threads > PROC_MAX_THREADS){
+	 	P->threads = PROC_MAX_THREADS;
+	 }
+	 P->fetchPolicy = (config->fetch < PROC_FETCH_POLICIES) ? config->fetch : PROC_FETCH_ROUND_ROBIN;
+	 P->fetchNext = 0;
+	 P->retireNext = 0;
+
+	 //Branch prediction
+	 predictor_init(&P->predictor, (config->predictor < PROC_PREDICTORS) ? config->predictor : PROC_PREDICT_NONE,
+	 				(config->predictor_bits > 0) ? config->predictor_bits : DEFAULT_PREDICTOR_BITS);
+	 P->mispredictPenalty = config->mispredict_penalty;
+	 P->branches = 0;
+	 P->mispredictions = 0;
+
+	 //Data cache
+	 P->memoryConfig = *config;
+	 dcache_init(&P->dcache, config);
+	 P->memWaitCount = 0;
+	 P->accesses = 0;
+	 P->l1Misses = 0;
+	 P->l2Misses = 0;
+	 memset(P->thread, 0, sizeof(P->thread));
+	 for (int t = 0; t < P->threads; t++){
+	 	for (int i = 0; i<32; i++){
+	 		P->thread[t].regFile[i].tag = READY;
+	 	}
+	 	P->thread[t].ROBPointers = {0,0,0};
+	 }
+
+	 //Allocate array
+	 allocateProc();
+
+	 //Initialize pointers
+	 //ROB FIFO
+	 P->ROBUsed = 0;
+	 //LL Pointers
+	 P->dispatchPointers = {NULL, NULL, (int)P->r      , (int)0}; 
+	 for (int c = 0; c < P->classes; c++){
+	 	P->queue[c] = {NULL, NULL, (int)(P->m*P->fu[c].count), P->slots[c]};
+	 	P->added[c] = 0;
+	 }
+	 P->unified = (config->scheduler == PROC_SCHED_UNIFIED);
+	 P->unifiedQueue = {NULL, NULL, (int)scheduler_entries_proc(config), 0};
+	 P->policy = (config->policy < PROC_POLICIES) ? config->policy : PROC_POLICY_OLDEST;
+	 P->issueWidth = config->issue;
+	 P->rrNext = 0;
+
+	 //Initialize counters and flags
+	 P->CDBsize = 0;
+	 P->tempCDBsize = 0;
+	 P->instruction = 0;
+	 P->readDoneFlag = 1;
+	 P->flag = 1;
+	 P->cycle = 0;
+	 P->addedAll = 0;
+	 P->retireSink = NULL;
+	 P->retireCount = 0;
+	 P->pushBuffer = NULL;
+	 P->pushHead = P->pushCount = P->pushCapacity = 0;
+	 P->warmup = 0;
+	 P->warmupCycle = 0;
+	 P->retired = 0;
+	 P->checkpointPath = NULL;
+	 P->checkpointInterval = 0;
+	 P->perf = NULL;
+	 memset(&P->stop, 0, sizeof(proc_stop_t));
+	 P->stopReason = PROC_STOP_NONE;
+	 P->windowRetired = 0;
+	 P->windowEnd = 0;
+	 P->windowIPC = NULL;
+	 P->samples = 0;
+}
+
 /**
  * Subroutine for initializing the processor. You many add and initialize any global or heap
  * variables as needed.
- * XXX: You're responsible for completing this routine
  *
  * @r ROB size
  * @k0 Number of k0 FUs
@@ -1254,56 +2366,260 @@ void updateState2(){
  * @m Schedule queue multiplier
  */
 void setup_proc(uint64_t rIn, uint64_t k0In, uint64_t k1In, uint64_t k2In, uint64_t fIn, uint64_t mIn) {
-	 //Set globally accessible
-	 r = rIn; 
-	 k0 = k0In;
-	 k1 = k1In;
-	 k2 = k2In;
-	 f = fIn;
-	 m = mIn;
-	printf("INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\tRETIRE\n");
-
-	 //Initialize reg array
-	 for (int i = 0; i<32; i++){
-	 	regFile[i].tag = READY;
-	 }
+	proc_config_t config;
+
+	default_config_proc(&config);
+	config.r = rIn;
+	config.k0 = k0In;
+	config.k1 = k1In;
+	config.k2 = k2In;
+	config.f = fIn;
+	config.m = mIn;
+	configure_proc(&config);
+}
 
-	 //Allocate array
-	 ROBTable = (ROB*) malloc(r*sizeof(ROB));			//ROB
-	 CDB = (CDBbus *) malloc((k0+k1+k2+10)*sizeof(CDBbus));		//CDB
-	 tempCDB = (CDBbus *) malloc((k0+k1+k2+10)*sizeof(CDBbus));		//CDB
-	 //Arrays to hold pointers to currently in FU
-	 inK0 = (node**) malloc(k0*sizeof(node*));
-	 inK1 = (node**) malloc(k1*2*sizeof(node*));
-	 inK2 = (node**) malloc(k2*3*sizeof(node*));
+/**
+ * Pulls instructions from a callback. Fetch calls it until it returns false, which
+ * marks the end of the trace. Must be called after setup_proc.
+ *
+ * @source Returns true and fills the instruction, or false at the end of the trace
+ * @context Passed back to source
+ */
+void set_source_proc(proc_source_fn source, void* context) {
+	set_thread_source_proc(0, source, context);
+}
 
-	 //Initialize pointers
-	 //ROB FIFO
-	 ROBPointers = {0,0,0};
-	 //LL Pointers
-	 dispatchPointers = {NULL, NULL, (int)r      , (int)0}; 
-	 k0QueuePointers =  {NULL, NULL, (int)(m*k0) , (int)k0};
-	 k1QueuePointers =  {NULL, NULL, (int)(m*k1) , (int)k1*2};
-	 k2QueuePointers =  {NULL, NULL, (int)(m*k2) , (int)k2*3};
+/**
+ * Pulls the instructions of one hardware thread from a callback, like
+ * set_source_proc does for thread 0. The run ends once every thread's source
+ * has returned false and the pipeline has drained.
+ * Must be called after setup_proc with a configuration of several threads.
+ *
+ * @thread Hardware thread, below the configured threads
+ * @source Returns true and fills the instruction, or false at the end of the trace
+ * @context Passed back to source
+ */
+void set_thread_source_proc(uint64_t thread, proc_source_fn source, void* context) {
+	if (thread < (uint64_t)P->threads){
+		P->thread[thread].source = source;
+		P->thread[thread].sourceContext = context;
+	}
+}
 
+/**
+ * Reports retired instructions in program order, in batches of up to RETIRE_BATCH
+ * records. The records are only valid during the call. Must be called after setup_proc
+ * or restore_proc.
+ *
+ * @sink Receives each batch
+ * @context Passed back to sink
+ */
+void set_retire_proc(proc_retire_fn sink, void* context) {
+	P->retireSink = sink;
+	P->retireContext = context;
 }
 
 /**
- * Subroutine that simulates the processor.
- *   The processor should fetch instructions as appropriate, until all instructions have executed
- * XXX: You're responsible for completing this routine
+ * Excludes the first instructions from the statistics. They still flow through
+ * the pipeline to fill the ROB and schedulers, but complete_proc only counts
+ * instructions and cycles after the last of them retires.
+ * Must be called after setup_proc.
  *
- * @p_stats Pointer to the statistics structure
+ * @warmup Number of leading instructions to exclude
  */
-void run_proc(proc_stats_t* p_stats) {
-	//Cycle timer
-	cycle = 0;
+void set_warmup_proc(uint64_t warmup) {
+	//Retired counts are signed, a longer warmup than they can reach never ends
+	P->warmup = (warmup < (uint64_t)INT64_MAX) ? warmup : (uint64_t)INT64_MAX;
+}
+
+/**
+ * Writes a checkpoint of this thread's processor to path every interval cycles.
+ * Each checkpoint atomically replaces the previous one. A checkpoint resumes a
+ * single trace offset, so processors of several hardware threads are refused.
+ * Must be called after setup_proc or restore_proc.
+ *
+ * @path Checkpoint file
+ * @interval Cycles between checkpoints, 0 to disable
+ *
+ * returns false if checkpoints were asked of several hardware threads
+ */
+bool set_checkpoint_proc(const char* path, uint64_t interval) {
+	if (interval != 0 && P->threads > 1){
+		P->checkpointPath = NULL;
+		P->checkpointInterval = 0;
+		return false;
+	}
+	P->checkpointPath = path;
+	P->checkpointInterval = interval;
+	return true;
+}
+
+/**
+ * Ends run_proc as soon as one of the criteria is met instead of when the trace
+ * drains. complete_proc then counts exactly the instructions retired and the
+ * cycles simulated up to that point and records the criterion in stop_reason.
+ * Must be called after setup_proc or restore_proc.
+ *
+ * @stop Criteria, zero fields are unused
+ */
+void set_stop_proc(const proc_stop_t* stop) {
+	P->stop = *stop;
+	free(P->windowIPC);
+	P->windowIPC = (stop->window > 0 && stop->windows > 0) ? (double*) calloc(stop->windows, sizeof(double)) : NULL;
+	P->windowEnd = stop->window;
+	P->samples = 0;
+}
 
-	//Line number
-	instruction = 0;
+/**
+ * Ends run_proc after a number of cycles even if instructions remain, complete_proc
+ * then reports that many cycles. Lets a caller give up on a run whose result is
+ * already decided. Must be called after setup_proc or restore_proc.
+ *
+ * @cycles Cycles to simulate at most, 0 for no limit
+ */
+void set_cycle_limit_proc(uint64_t cycles) {
+	P->stop.max_cycles = cycles;
+}
 
-	//Pipeline
-	while(flag){
+/**
+ * Attributes host counters to pipeline stages from now on, reading them after
+ * every stage of every cycle. The counters must count the calling thread and
+ * stay open while it runs. NULL stops the attribution.
+ *
+ * @perf Open counters, or NULL
+ */
+void set_stage_perf_proc(const perf_t* perf) {
+	perf_counts_t first;
+
+	P->perf = perf;
+	memset(P->stageCounts, 0, sizeof(P->stageCounts));
+	memset(&P->perfOverhead, 0, sizeof(perf_counts_t));
+	if (perf == NULL){
+		return;
+	}
+
+	//Calibrate the cost of the read between two stages
+	perf_read(perf, &first);
+	for (int i = 0; i < PERF_CALIBRATION; i++){
+		perf_read(perf, &P->perfLast);
+	}
+	for (int e = 0; e < PERF_EVENTS; e++){
+		P->perfOverhead.value[e] = (P->perfLast.value[e] - first.value[e])/PERF_CALIBRATION;
+	}
+}
+
+/**
+ * Gives the host counts attributed to a pipeline stage since set_stage_perf_proc.
+ *
+ * @stage PROC_STAGE_*
+ * @counts Receives the counts
+ */
+void stage_perf_proc(uint64_t stage, perf_counts_t* counts) {
+	*counts = P->stageCounts[stage < PROC_STAGES ? stage : 0];
+}
+
+/**
+ * Replaces setup_proc: rebuilds this thread's processor from a checkpoint so that
+ * run_proc continues bit-identically from the saved cycle. The caller must position
+ * the trace so the next read_instruction returns instruction *p_offset + 1.
+ *
+ * @path Checkpoint file
+ * @p_offset Receives the number of trace instructions already consumed
+ *
+ * returns true on success, false for a checkpoint of several hardware threads
+ */
+bool restore_proc(const char* path, uint64_t* p_offset) {
+	FILE* in;
+	int ok;
+
+	//Release the instance being replaced before clearing it
+	P = &threadProc;
+	freeProc();
+	memset(P, 0, sizeof(proc_t));
+
+	in = fopen(path, "rb");
+	if (in == NULL){
+		return false;
+	}
+	ok = readCheckpoint(in);
+	fclose(in);
+
+	//One offset positions one trace
+	*p_offset = P->thread[0].instruction;
+	return ok == TRUE && P->threads == 1;
+}
+
+/*
+* stageMark
+* Adds the host counts since the last boundary to a stage
+*
+* parameters:
+* int stage - PROC_STAGE_* that just ran
+*
+* returns:
+* none
+*/
+void stageMark(int stage){
+	perf_counts_t now;
+
+	perf_read(P->perf, &now);
+	for (int e = 0; e < PERF_EVENTS; e++){
+		uint64_t delta = now.value[e] - P->perfLast.value[e];
+		P->stageCounts[stage].value[e] += (delta > P->perfOverhead.value[e]) ? delta - P->perfOverhead.value[e] : 0;
+	}
+	P->perfLast = now;
+}
+
+/*
+* cycleStages
+* Simulates one clock cycle like cycleProc, reading the host counters after
+* every stage. Each read is a system call, so the run slows down; the cost of
+* a read measured up front is taken off every stage.
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+void cycleStages(){
+	updateState2();
+	stageMark(PROC_STAGE_STATE);
+	executeInstructions2();
+	stageMark(PROC_STAGE_EXECUTE);
+	scheduleInstructions2();
+	stageMark(PROC_STAGE_SCHEDULE);
+	dispatchInstructions2();
+	stageMark(PROC_STAGE_DISPATCH);
+
+	P->cycle++;
+
+	updateState1();
+	stageMark(PROC_STAGE_STATE);
+	executeInstructions1();
+	stageMark(PROC_STAGE_EXECUTE);
+	scheduleInstructions1();
+	stageMark(PROC_STAGE_SCHEDULE);
+	dispatchInstructions1();
+	stageMark(PROC_STAGE_DISPATCH);
+	fetchInstructions();
+	stageMark(PROC_STAGE_FETCH);
+}
+
+/*
+* cycleProc
+* Simulates one clock cycle
+*
+* parameters: 
+* none
+*
+* returns:
+* none
+*/
+void cycleProc(){
+	if (P->perf != NULL){
+		cycleStages();
+	}else{
 		//Change clock cycle
 		//////////////SECOND HALF OF CYCLE//////////////////////
 		//SU2
@@ -1316,7 +2632,7 @@ void run_proc(proc_stats_t* p_stats) {
 		dispatchInstructions2();
 		////////////////////////////////////////////////////////
 
-		cycle++;
+		P->cycle++;
 
 		//////////////FIRST HALF OF CYCLE///////////////////////
 		//SU1
@@ -1332,7 +2648,321 @@ void run_proc(proc_stats_t* p_stats) {
 		////////////////////////////////////////////////////////
 	}
 
-	cycle = cycle - 1; 		//correct for overcounting cycles at end
+	if (P->checkpointInterval != 0 && P->cycle % P->checkpointInterval == 0){
+		checkpointProc();
+	}
+}
+
+/*
+* checkStop
+* Tests the stop criteria after a cycle, safe to repeat for the same cycle.
+* Retirement for a cycle happens in the following cycleProc, so P->cycle-1
+* cycles have fully retired.
+*
+* parameters: 
+* none
+*
+* returns:
+* bool - true while the processor should keep running
+*/
+bool checkStop(){
+	int64_t cycles = P->cycle - 1 - P->warmupCycle;
+	int64_t retired = P->retired - (int64_t)P->warmup;
+
+	if (P->stopReason != PROC_STOP_NONE){
+		return false;
+	}
+	if (retired < 0){
+		return true;			//still warming up
+	}
+
+	if (P->stop.max_instructions > 0 && retired >= (int64_t)P->stop.max_instructions){
+		P->stopReason = PROC_STOP_INSTRUCTIONS;
+	}else if (P->stop.max_cycles > 0 && cycles >= (int64_t)P->stop.max_cycles){
+		P->stopReason = PROC_STOP_CYCLES;
+	}else if (P->windowIPC != NULL && cycles >= P->windowEnd){
+		//Close an IPC sample and compare the last stop.windows of them
+		double low, high, sum = 0;
+
+		P->windowIPC[P->samples++ % P->stop.windows] = ((double)(retired - P->windowRetired))/P->stop.window;
+		P->windowRetired = retired;
+		P->windowEnd += P->stop.window;
+		if (P->samples >= P->stop.windows){
+			low = high = P->windowIPC[0];
+			for (uint64_t i = 0; i < P->stop.windows; i++){
+				low = (P->windowIPC[i] < low) ? P->windowIPC[i] : low;
+				high = (P->windowIPC[i] > high) ? P->windowIPC[i] : high;
+				sum += P->windowIPC[i];
+			}
+			if (high - low <= P->stop.tolerance*sum/P->stop.windows){
+				P->stopReason = PROC_STOP_CONVERGED;
+			}
+		}
+	}
+
+	return P->stopReason == PROC_STOP_NONE;
+}
+
+/*
+* readPushed
+* Instruction source over the push_proc buffer
+*
+* parameters: 
+* proc_inst_t* p_inst - instruction to fill
+* void* context       - unused
+*
+* returns:
+* bool - false once the buffer is empty
+*/
+bool readPushed(proc_inst_t* p_inst, void* context){
+	if (P->pushCount == 0){
+		return false;
+	}
+	*p_inst = P->pushBuffer[P->pushHead];
+	P->pushHead = (P->pushHead+1)%P->pushCapacity;
+	P->pushCount--;
+	return true;
+}
+
+/**
+ * Feeds instructions to the processor instead of a pull source. Cycles are simulated
+ * only while at least F instructions are buffered, so fetch never runs dry and timing
+ * matches a pull source over the same stream. Call run_proc after the last push to
+ * drain the pipeline.
+ *
+ * @insts Instructions in program order
+ * @count Number of instructions
+ */
+void push_proc(const proc_inst_t* insts, uint64_t count) {
+	if (P->pushBuffer == NULL){
+		P->pushCapacity = (2*P->f > PUSH_BUFFER) ? 2*P->f : PUSH_BUFFER;
+		P->pushBuffer = (proc_inst_t*) malloc(P->pushCapacity*sizeof(proc_inst_t));
+		P->thread[0].source = readPushed;
+	}
+
+	for (uint64_t i = 0; i < count; i++){
+		//Make room by simulating, a full buffer always holds the F instructions fetch may take
+		while (P->pushCount == P->pushCapacity && P->flag){
+			cycleProc();
+		}
+		P->pushBuffer[(P->pushHead+P->pushCount)%P->pushCapacity] = insts[i];
+		P->pushCount++;
+	}
+}
+
+/**
+ * Subroutine that simulates the processor.
+ *   The processor should fetch instructions as appropriate, until all instructions have executed
+ *
+ * @p_stats Pointer to the statistics structure
+ */
+void run_proc(proc_stats_t* p_stats) {
+	//Pipeline
+	while(P->flag && checkStop()){
+		cycleProc();
+	}
+
+	P->cycle = P->cycle - 1; 		//correct for overcounting cycles at end
+
+	flushRetired();
+}
+
+/**
+ * Simulates at most a number of cycles and returns, so a caller can interleave
+ * several processors or sample one as it runs. run_proc finishes the run.
+ *
+ * @cycles Cycles to simulate
+ * @return False once the trace has drained or a stop criterion fired
+ */
+bool step_proc(uint64_t cycles) {
+	while (cycles-- > 0 && P->flag && checkStop()){
+		cycleProc();
+	}
+	return P->flag && P->stopReason == PROC_STOP_NONE;
+}
+
+/**
+ * Fills statistics for the instructions retired and cycles simulated so far,
+ * counted after the warmup like complete_proc, without ending the run.
+ *
+ * @p_stats Pointer to the statistics structure
+ */
+void snapshot_proc(proc_stats_t* p_stats) {
+	p_stats->retired_instruction = (P->retired > (int64_t)P->warmup) ? P->retired - P->warmup : 0;
+	p_stats->cycle_count = (P->cycle > P->warmupCycle) ? P->cycle - P->warmupCycle : 0;
+	p_stats->avg_inst_retired = (p_stats->cycle_count > 0) ? ((double)p_stats->retired_instruction)/p_stats->cycle_count : 0;
+	p_stats->stop_reason = P->stopReason;
+	p_stats->branches = P->branches;
+	p_stats->mispredictions = P->mispredictions;
+	p_stats->accesses = P->accesses;
+	p_stats->l1_misses = P->l1Misses;
+	p_stats->l2_misses = P->l2Misses;
+}
+
+/**
+ * Reads the ROB and CDB as they stand after the last simulated cycle, so a
+ * caller stepping the processor one cycle at a time can compare it with
+ * another model of the same pipeline.
+ *
+ * @probe Receives the state, its rob and cdb arrays sized by the caller
+ */
+void probe_proc(proc_probe_t* probe) {
+	probe->cycle = P->cycle;
+	probe->running = P->flag;
+	probe->rob_count = 0;
+	for (int t = 0; t < P->threads; t++){
+		FIFOPointers* rob = &P->thread[t].ROBPointers;
+		for (int i = 0; i < rob->size; i++){
+			ROB* entry = &P->ROBTable[t*P->r + (rob->head+i)%P->r];
+			probe->rob[probe->rob_count].line_number = entry->line_number;
+			probe->rob[probe->rob_count].reg = entry->p_inst.dest_reg;
+			probe->rob[probe->rob_count].done = entry->done;
+			probe->rob_count++;
+		}
+	}
+	probe->cdb_count = P->CDBsize;
+	for (int i = 0; i < P->CDBsize; i++){
+		probe->cdb[i].line_number = P->CDB[i].line_number;
+		probe->cdb[i].reg = P->CDB[i].reg;
+		probe->cdb[i].done = 0;
+	}
+}
+
+/**
+ * Fills statistics for one hardware thread: the instructions it retired after
+ * the warmup over the cycles of the whole run, so the threads' IPCs sum to the
+ * core's. Branch counts stay those of the whole core. Call before complete_proc.
+ *
+ * @thread Hardware thread
+ * @p_stats Pointer to the statistics structure
+ */
+void thread_stats_proc(uint64_t thread, proc_stats_t* p_stats) {
+	snapshot_proc(p_stats);
+	p_stats->retired_instruction = (thread < (uint64_t)P->threads) ? P->thread[thread].retired : 0;
+	p_stats->avg_inst_retired = (p_stats->cycle_count > 0) ? ((double)p_stats->retired_instruction)/p_stats->cycle_count : 0;
+}
+
+//Decoded instructions shared by all lanes of run_lanes_proc
+typedef struct _laneWindow{
+	proc_inst_t* inst;
+	uint64_t base;				//trace index of inst[0]
+	uint64_t end;				//trace index one past the last decoded instruction
+	uint64_t capacity;
+	bool traceDone;				//source is exhausted
+} laneWindow;
+
+//Position of one lane in the shared window
+typedef struct _laneCursor{
+	laneWindow* window;
+	uint64_t next;				//trace index of the lane's next fetch
+} laneCursor;
+
+/*
+* readLane
+* Instruction source of one lane over the shared window
+*
+* parameters: 
+* proc_inst_t* p_inst - instruction to fill
+* void* context       - laneCursor of the lane
+*
+* returns:
+* bool - false at the end of the trace
+*/
+bool readLane(proc_inst_t* p_inst, void* context){
+	laneCursor* cursor = (laneCursor*) context;
+
+	if (cursor->next == cursor->window->end){
+		return false;
+	}
+	*p_inst = cursor->window->inst[cursor->next - cursor->window->base];
+	cursor->next++;
+	return true;
+}
+
+/**
+ * Simulates several configurations over one pass of an instruction source. Only
+ * reading and decoding are batched: every instruction is read once into a shared
+ * window, but each lane is a whole processor of its own, stepped by its own cycle
+ * loop, as many cycles as the window allows before the window slides. Rename
+ * state, queues and loop overhead are not shared, so a sweep saves the trace I/O
+ * and decode of each run, not its per-cycle work. Each lane's timing is identical
+ * to a run_proc over the same stream.
+ *
+ * @configs Configuration of each lane
+ * @lanes Number of lanes
+ * @source Instruction source read once for all lanes
+ * @context Passed back to source
+ * @stop Stop criteria applied to every lane, NULL to run each to the end
+ * @stats Receives the final statistics of each lane
+ */
+void run_lanes_proc(const proc_config_t* configs, uint64_t lanes, proc_source_fn source, void* context,
+					const proc_stop_t* stop, proc_stats_t* stats) {
+	proc_t* lane = (proc_t*) calloc(lanes, sizeof(proc_t));
+	laneCursor* cursor = (laneCursor*) calloc(lanes, sizeof(laneCursor));
+	laneWindow window;
+	proc_t* saved = P;
+	uint64_t maxFetch = 1;
+	int running = lanes;
+
+	for (uint64_t i = 0; i < lanes; i++){
+		P = &lane[i];
+		initProc(&configs[i]);
+		cursor[i].window = &window;
+		P->thread[0].source = readLane;
+		P->thread[0].sourceContext = &cursor[i];
+		if (stop != NULL){
+			set_stop_proc(stop);
+		}
+		if (configs[i].f > maxFetch){
+			maxFetch = configs[i].f;
+		}
+	}
+
+	window.capacity = (PUSH_BUFFER > 4*maxFetch) ? PUSH_BUFFER : 4*maxFetch;
+	window.inst = (proc_inst_t*) malloc(window.capacity*sizeof(proc_inst_t));
+	window.base = 0;
+	window.end = 0;
+	window.traceDone = false;
+
+	while (running > 0){
+		//Slide the window past what every lane has fetched and decode more
+		uint64_t oldest = window.end;
+		for (uint64_t i = 0; i < lanes; i++){
+			if (lane[i].flag && lane[i].stopReason == PROC_STOP_NONE && cursor[i].next < oldest){
+				oldest = cursor[i].next;
+			}
+		}
+		memmove(window.inst, window.inst + (oldest - window.base), (window.end - oldest)*sizeof(proc_inst_t));
+		window.base = oldest;
+		while (!window.traceDone && window.end - window.base < window.capacity){
+			if (source(&window.inst[window.end - window.base], context)){
+				window.end++;
+			}else{
+				window.traceDone = true;
+			}
+		}
+
+		//Each lane runs while a full fetch group is decoded
+		running = 0;
+		for (uint64_t i = 0; i < lanes; i++){
+			P = &lane[i];
+			while (P->flag && checkStop() && (window.traceDone || cursor[i].next + P->f <= window.end)){
+				cycleProc();
+			}
+			running += P->flag && P->stopReason == PROC_STOP_NONE;
+		}
+	}
+
+	for (uint64_t i = 0; i < lanes; i++){
+		P = &lane[i];
+		P->cycle = P->cycle - 1; 		//correct for overcounting cycles at end
+		complete_proc(&stats[i]);
+	}
+
+	free(window.inst);
+	free(cursor);
+	free(lane);
+	P = saved;
 }
 
 /**
@@ -1343,18 +2973,8 @@ void run_proc(proc_stats_t* p_stats) {
  * @p_stats Pointer to the statistics structure
  */
 void complete_proc(proc_stats_t *p_stats) {
-	//stats
-	p_stats->retired_instruction = instruction;
-	p_stats->cycle_count = cycle;
-	p_stats->avg_inst_retired = ((double)instruction)/cycle;
-
-	printf("\n");
-
-	//Free allocated memory
-	free(CDB);
-	free(tempCDB);
-	free(ROBTable);
-	free(inK0);
-	free(inK1);
-	free(inK2);
+	//stats, counting only what retired so a run that stopped early stays exact
+	snapshot_proc(p_stats);
+
+	freeProc();
 }
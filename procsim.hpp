@@ -3,12 +3,28 @@
 
 #include <cstdint>
 
+//Bump whenever a change alters simulated timing, it keys cached results
+#define PROCSIM_VERSION 3
+
 #define DEFAULT_K0 1
 #define DEFAULT_K1 2
 #define DEFAULT_K2 3
 #define DEFAULT_R 8
 #define DEFAULT_M 2
 #define DEFAULT_F 4
+#define DEFAULT_SHARDS 1
+#define DEFAULT_WARMUP 512
+#define DEFAULT_EPOCH 10000
+#define DEFAULT_PREDICTOR_BITS 12
+#define DEFAULT_LINE 64
+
+//Architectural registers, an instruction names -1 or 0 up to PROC_REGISTERS-1
+#define PROC_REGISTERS 32
+
+//Branch outcome of a trace instruction, traces without one give PROC_BRANCH_NONE
+#define PROC_BRANCH_NONE      0
+#define PROC_BRANCH_NOT_TAKEN 1
+#define PROC_BRANCH_TAKEN     2
 
 typedef struct _proc_inst_t
 {
@@ -18,20 +34,212 @@ typedef struct _proc_inst_t
     int32_t dest_reg;
     
     // You may introduce other fields as needed
+    int32_t branch;                 //PROC_BRANCH_*
+    uint32_t branch_target;         //address fetched next when taken
+    int32_t memory;                 //nonzero when the instruction accesses data_address
+    uint32_t data_address;
     
 } proc_inst_t;
 
+//Why run_proc returned, see proc_stop_t
+#define PROC_STOP_NONE         0    //the trace drained
+#define PROC_STOP_INSTRUCTIONS 1
+#define PROC_STOP_CYCLES       2
+#define PROC_STOP_CONVERGED    3
+#define PROC_STOP_BLOCKED      4    //an instruction no functional unit executes reached dispatch
+
+//Largest parameters check_config_proc accepts
+#define PROC_MAX_ROB        65536   //r
+#define PROC_MAX_WIDTH      65536   //f and the dispatch, CDB, retire and issue widths
+#define PROC_MAX_UNITS      65536   //units of one class
+#define PROC_MAX_ENTRIES    1048576 //scheduler entries, and FU slots, over all classes
+#define PROC_MAX_LATENCY    1048576 //FU, cache and memory latencies and the mispredict penalty
+#define PROC_MAX_LINES      16777216    //lines of one data cache level
+
 typedef struct _proc_stats_t
 {
     float avg_inst_retired;
     unsigned long retired_instruction;
     unsigned long cycle_count;
+    int stop_reason;
+    unsigned long branches;         //retired branches with an outcome in the trace
+    unsigned long mispredictions;
+    unsigned long accesses;         //retired memory instructions, with a data cache model
+    unsigned long l1_misses;
+    unsigned long l2_misses;        //accesses served by memory
 } proc_stats_t;
 
+//Functional unit classes a configuration may describe
+#define PROC_MAX_CLASSES 8
+//Opcodes a class can claim, -1 up to PROC_MAX_OPCODE
+#define PROC_MAX_OPCODE 30
+#define PROC_OPCODE_BIT(op) (1u << ((op) + 1))
+
+//One class of functional units
+typedef struct _proc_fu_t
+{
+    uint64_t count;         //units
+    uint32_t latency;       //cycles from issue to result
+    uint32_t interval;      //cycles before a unit accepts the next instruction, 1 if pipelined
+    uint32_t opcodes;       //PROC_OPCODE_BIT of every opcode the class executes
+    uint32_t reserved;
+} proc_fu_t;
+
+//Scheduler organizations
+#define PROC_SCHED_SPLIT   0        //one queue of m*k entries per FU class
+#define PROC_SCHED_UNIFIED 1        //one queue of the same total size feeding every class
+
+//Issue selection policies, the order ready instructions compete for units
+#define PROC_POLICY_OLDEST      0   //program order
+#define PROC_POLICY_CRITICAL    1   //most consumers seen at dispatch first, then oldest
+#define PROC_POLICY_LATENCY     2   //longest latency class first, then oldest
+#define PROC_POLICY_ROUND_ROBIN 3   //oldest of each class in turn, starting class rotates
+#define PROC_POLICIES           4
+
+//Simultaneous multithreading: hardware threads sharing one core
+#define PROC_MAX_THREADS 8
+
+//Fetch policies, the thread that fetches each cycle
+#define PROC_FETCH_ROUND_ROBIN  0   //threads in turn
+#define PROC_FETCH_ICOUNT       1   //fewest instructions fetched but not yet issued
+#define PROC_FETCH_POLICIES     2
+
+//Branch direction predictors
+#define PROC_PREDICT_NONE       0   //every branch predicted correctly
+#define PROC_PREDICT_BIMODAL    1   //2-bit counter per address
+#define PROC_PREDICT_GSHARE     2   //2-bit counter per address xor global history
+#define PROC_PREDICT_TAGE       3   //bimodal base and four tagged tables of doubling history
+#define PROC_PREDICTORS         4
+
+//One level of the data cache
+typedef struct _proc_level_t
+{
+    uint64_t size;          //bytes, 0 for no such level
+    uint32_t assoc;         //ways
+    uint32_t latency;       //cycles added by an access that reaches the level
+} proc_level_t;
+
+//Processor configuration, see setup_proc for the meaning of each field. Without
+//an fu table the classes are the reference k0/k1/k2 units of latency 1, 2 and 3.
+typedef struct _proc_config_t
+{
+    uint64_t r;
+    uint64_t k0;
+    uint64_t k1;
+    uint64_t k2;
+    uint64_t f;
+    uint64_t m;
+    uint64_t dispatch;                  //instructions dispatched per cycle, 0 for no limit
+    uint64_t cdb;                       //results broadcast per cycle, oldest first, 0 for no limit
+    uint64_t retire;                    //instructions retired per cycle, 0 for F
+    uint64_t scheduler;                 //PROC_SCHED_*
+    uint64_t policy;                    //PROC_POLICY_*
+    uint64_t issue;                     //instructions issued per cycle over all classes, 0 for no limit
+    uint64_t threads;                   //hardware threads sharing the core, 0 for one
+    uint64_t fetch;                     //PROC_FETCH_*, with several threads
+    uint64_t predictor;                 //PROC_PREDICT_*
+    uint64_t predictor_bits;            //log2 of the predictor's table entries, 0 for the default
+    uint64_t mispredict_penalty;        //cycles fetch waits after a mispredicted branch resolves
+    proc_level_t l1;                    //data cache, memory instructions take its latency when l1 has a size
+    proc_level_t l2;
+    uint64_t line;                      //bytes per cache line, 0 for DEFAULT_LINE
+    uint64_t memory_latency;            //cycles added by an access that misses every level
+    uint64_t classes;                   //entries of fu in use, 0 for k0/k1/k2
+    proc_fu_t fu[PROC_MAX_CLASSES];
+} proc_config_t;
+
+//Criteria that end run_proc before the trace drains, zero fields are unused.
+//Instructions and cycles are counted after the warmup, like the statistics.
+typedef struct _proc_stop_t
+{
+    uint64_t max_instructions;      //stop once at least this many have retired
+    uint64_t max_cycles;            //stop after this many cycles
+    uint64_t window;                //cycles per IPC sample
+    uint64_t windows;               //consecutive samples that must agree
+    double tolerance;               //largest spread of those samples relative to their mean
+} proc_stop_t;
+
+//Timing of one retired instruction, one row of the INST..RETIRE table
+typedef struct _proc_retire_t
+{
+    proc_inst_t p_inst;
+    int64_t line_number;
+    int64_t fetch;
+    int64_t disp;
+    int64_t sched;
+    int64_t exec;
+    int64_t state;
+    int64_t retire;
+    int64_t thread;                 //hardware thread, line_number counts within it
+} proc_retire_t;
+
+//One ROB entry or CDB broadcast seen by probe_proc
+typedef struct _proc_probe_entry_t
+{
+    int64_t line_number;            //fetch order over all threads, from 1
+    int32_t reg;                    //destination register, -1 for none
+    int32_t done;                   //ROB: result written back, CDB: unused
+} proc_probe_entry_t;
+
+//Pipeline state at the end of a cycle. The caller provides the arrays, each
+//of R entries: at most R instructions are in the ROB, and so on the CDB.
+typedef struct _proc_probe_t
+{
+    int64_t cycle;
+    bool running;                   //false once the trace has drained
+    uint64_t rob_count;
+    uint64_t cdb_count;
+    proc_probe_entry_t* rob;        //oldest first, one thread after another
+    proc_probe_entry_t* cdb;        //results broadcast this cycle, in bus order
+} proc_probe_t;
+
+//Pipeline stages host counters are attributed to, fetch includes reading the
+//trace and state update includes the retire sink
+#define PROC_STAGE_FETCH    0
+#define PROC_STAGE_DISPATCH 1
+#define PROC_STAGE_SCHEDULE 2
+#define PROC_STAGE_EXECUTE  3
+#define PROC_STAGE_STATE    4
+#define PROC_STAGES         5
+
+//Host counters of procsim_perf.hpp
+typedef struct _perf_t perf_t;
+typedef struct _perf_counts_t perf_counts_t;
+
+//Pull source: fills the next instruction, false at the end of the trace
+typedef bool (*proc_source_fn)(proc_inst_t* p_inst, void* context);
+//Retire sink: receives retired instructions in program order, in batches
+typedef void (*proc_retire_fn)(const proc_retire_t* records, uint64_t count, void* context);
+
 bool read_instruction(proc_inst_t* p_inst);
 
+void default_config_proc(proc_config_t* config);
+const char* check_config_proc(const proc_config_t* config);
+uint64_t fu_classes_proc(const proc_config_t* config, proc_fu_t* table);
+uint64_t scheduler_entries_proc(const proc_config_t* config);
+void configure_proc(const proc_config_t* config);
 void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f, uint64_t m);
 void run_proc(proc_stats_t* p_stats);
+bool step_proc(uint64_t cycles);
+void snapshot_proc(proc_stats_t* p_stats);
+void probe_proc(proc_probe_t* probe);
 void complete_proc(proc_stats_t* p_stats);
 
+void set_source_proc(proc_source_fn source, void* context);
+void set_thread_source_proc(uint64_t thread, proc_source_fn source, void* context);
+void thread_stats_proc(uint64_t thread, proc_stats_t* p_stats);
+void set_retire_proc(proc_retire_fn sink, void* context);
+void push_proc(const proc_inst_t* insts, uint64_t count);
+void run_lanes_proc(const proc_config_t* configs, uint64_t lanes, proc_source_fn source, void* context,
+                    const proc_stop_t* stop, proc_stats_t* stats);
+void set_warmup_proc(uint64_t warmup);
+void set_stop_proc(const proc_stop_t* stop);
+void set_cycle_limit_proc(uint64_t cycles);
+
+void set_stage_perf_proc(const perf_t* perf);
+void stage_perf_proc(uint64_t stage, perf_counts_t* counts);
+
+bool set_checkpoint_proc(const char* path, uint64_t interval);
+bool restore_proc(const char* path, uint64_t* p_offset);
+
 #endif /* PROCSIM_HPP */
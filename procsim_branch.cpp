@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include "procsim_branch.hpp"
+
+//Saturation limits of the counters
+#define COUNTER_MAX   3
+#define TAGGED_MIN   -4
+#define TAGGED_MAX    3
+#define USEFUL_MAX    3
+
+/*
+* fold
+* Compresses the newest history bits into a field by xoring its chunks
+*
+* parameters:
+* uint64_t history - global history
+* uint32_t length  - newest bits to use, at most 64
+* uint32_t width   - bits of the result
+*
+* returns:
+* uint32_t - folded history
+*/
+static uint32_t fold(uint64_t history, uint32_t length, uint32_t width){
+	uint32_t folded = 0;
+
+	if (length < 64){
+		history &= (1ULL << length) - 1;
+	}
+	while (history != 0){
+		folded ^= history & ((1u << width) - 1);
+		history >>= width;
+	}
+	return folded;
+}
+
+/*
+* train
+* Moves a 2-bit counter toward an outcome
+*
+* parameters:
+* uint8_t* counter - counter to train
+* bool taken       - outcome
+*
+* returns:
+* none
+*/
+static void train(uint8_t* counter, bool taken){
+	if (taken && *counter < COUNTER_MAX){
+		(*counter)++;
+	}else if (!taken && *counter > 0){
+		(*counter)--;
+	}
+}
+
+/*
+* predictor_init
+* Allocates a predictor with every counter weakly not taken
+*
+* parameters:
+* predictor_t* bp - predictor
+* int kind        - PROC_PREDICT_*
+* uint32_t bits   - log2 of the entries of the base table, at least 4
+*
+* returns:
+* none
+*/
+void predictor_init(predictor_t* bp, int kind, uint32_t bits){
+	memset(bp, 0, sizeof(predictor_t));
+	bp->kind = kind;
+	if (kind == PROC_PREDICT_NONE){
+		return;
+	}
+	bp->bits = (bits < 4) ? 4 : (bits > 28 ? 28 : bits);
+	bp->mask = (1u << bp->bits) - 1;
+	bp->counters = (uint8_t*) malloc(1u << bp->bits);
+	memset(bp->counters, 1, 1u << bp->bits);
+
+	if (kind == PROC_PREDICT_TAGE){
+		//Each tagged table has a quarter of the base table's entries
+		bp->taggedBits = bp->bits - 2;
+		for (int i = 0; i < TAGE_TABLES; i++){
+			bp->tags[i] = (uint16_t*) calloc(1u << bp->taggedBits, sizeof(uint16_t));
+			bp->taken[i] = (int8_t*) malloc(1u << bp->taggedBits);
+			bp->useful[i] = (uint8_t*) calloc(1u << bp->taggedBits, sizeof(uint8_t));
+			memset(bp->taken[i], -1, 1u << bp->taggedBits);
+		}
+	}
+}
+
+/*
+* predictor_predict
+* Predicts the direction of a branch: a 2-bit counter per address (bimodal),
+* per address xor global history (gshare), or the counter of the longest
+* history table whose tag matches, over a bimodal base (TAGE)
+*
+* parameters:
+* predictor_t* bp - predictor
+* uint32_t pc     - branch address
+*
+* returns:
+* bool - true if predicted taken
+*/
+bool predictor_predict(predictor_t* bp, uint32_t pc){
+	uint32_t word = pc >> 2;
+
+	if (bp->kind == PROC_PREDICT_BIMODAL){
+		bp->slot = word & bp->mask;
+		return bp->counters[bp->slot] >= 2;
+	}
+	if (bp->kind == PROC_PREDICT_GSHARE){
+		bp->slot = (word ^ (uint32_t)bp->history) & bp->mask;
+		return bp->counters[bp->slot] >= 2;
+	}
+	if (bp->kind != PROC_PREDICT_TAGE){
+		return false;
+	}
+
+	bp->slot = word & bp->mask;
+	bp->provider = -1;
+	bp->providerPrediction = bp->altPrediction = bp->counters[bp->slot] >= 2;
+	for (int i = 0; i < TAGE_TABLES; i++){
+		uint32_t length = TAGE_MIN_HISTORY << i;
+
+		bp->index[i] = (word ^ (word >> bp->taggedBits) ^ fold(bp->history, length, bp->taggedBits)) &
+					   ((1u << bp->taggedBits) - 1);
+		bp->tag[i] = (word ^ fold(bp->history, length, TAGE_TAG_BITS) ^ (fold(bp->history, length, TAGE_TAG_BITS-1) << 1)) &
+					 ((1u << TAGE_TAG_BITS) - 1);
+		if (bp->tags[i][bp->index[i]] == bp->tag[i]){
+			bp->altPrediction = bp->providerPrediction;
+			bp->providerPrediction = bp->taken[i][bp->index[i]] >= 0;
+			bp->provider = i;
+		}
+	}
+	return bp->providerPrediction;
+}
+
+/*
+* predictor_update
+* Trains the entries of the last lookup on the outcome and shifts it into the
+* history. A TAGE mispredict claims an entry in a longer history table whose
+* entry is no longer useful, or ages the candidates when none is free.
+*
+* parameters:
+* predictor_t* bp - predictor
+* uint32_t pc     - branch address, the one just predicted
+* bool taken      - outcome
+*
+* returns:
+* none
+*/
+void predictor_update(predictor_t* bp, uint32_t pc, bool taken){
+	if (bp->kind == PROC_PREDICT_NONE){
+		return;
+	}
+
+	if (bp->kind != PROC_PREDICT_TAGE || bp->provider < 0){
+		train(&bp->counters[bp->slot], taken);
+	}
+	if (bp->kind == PROC_PREDICT_TAGE){
+		int p = bp->provider;
+
+		if (p >= 0){
+			int8_t* counter = &bp->taken[p][bp->index[p]];
+			if (taken && *counter < TAGGED_MAX){
+				(*counter)++;
+			}else if (!taken && *counter > TAGGED_MIN){
+				(*counter)--;
+			}
+			//The provider is useful when it alone got the branch right
+			if (bp->providerPrediction != bp->altPrediction){
+				uint8_t* useful = &bp->useful[p][bp->index[p]];
+				if (bp->providerPrediction == taken && *useful < USEFUL_MAX){
+					(*useful)++;
+				}else if (bp->providerPrediction != taken && *useful > 0){
+					(*useful)--;
+				}
+			}
+		}
+
+		if (bp->providerPrediction != taken){
+			bool claimed = false;
+			for (int i = p + 1; i < TAGE_TABLES && !claimed; i++){
+				if (bp->useful[i][bp->index[i]] == 0){
+					bp->tags[i][bp->index[i]] = bp->tag[i];
+					bp->taken[i][bp->index[i]] = taken ? 0 : -1;
+					claimed = true;
+				}
+			}
+			for (int i = p + 1; i < TAGE_TABLES && !claimed; i++){
+				bp->useful[i][bp->index[i]]--;
+			}
+		}
+	}
+
+	bp->history = (bp->history << 1) | (taken ? 1 : 0);
+}
+
+/*
+* predictor_save
+* Writes the tables and history of a predictor
+*
+* parameters:
+* const predictor_t* bp - predictor
+* FILE* out             - checkpoint file
+*
+* returns:
+* none
+*/
+void predictor_save(const predictor_t* bp, FILE* out){
+	fwrite(&bp->history, sizeof(uint64_t), 1, out);
+	if (bp->counters != NULL){
+		fwrite(bp->counters, 1, 1u << bp->bits, out);
+	}
+	for (int i = 0; i < TAGE_TABLES && bp->tags[i] != NULL; i++){
+		fwrite(bp->tags[i], sizeof(uint16_t), 1u << bp->taggedBits, out);
+		fwrite(bp->taken[i], 1, 1u << bp->taggedBits, out);
+		fwrite(bp->useful[i], 1, 1u << bp->taggedBits, out);
+	}
+}
+
+/*
+* predictor_restore
+* Reads the state written by predictor_save into a predictor initialized
+* with the same kind and size
+*
+* parameters:
+* predictor_t* bp - predictor
+* FILE* in        - checkpoint file
+*
+* returns:
+* bool - true on success
+*/
+bool predictor_restore(predictor_t* bp, FILE* in){
+	size_t entries = (size_t)1 << bp->taggedBits;
+
+	if (fread(&bp->history, sizeof(uint64_t), 1, in) != 1){
+		return false;
+	}
+	if (bp->counters != NULL && fread(bp->counters, 1, 1u << bp->bits, in) != (1u << bp->bits)){
+		return false;
+	}
+	for (int i = 0; i < TAGE_TABLES && bp->tags[i] != NULL; i++){
+		if (fread(bp->tags[i], sizeof(uint16_t), entries, in) != entries ||
+			fread(bp->taken[i], 1, entries, in) != entries || fread(bp->useful[i], 1, entries, in) != entries){
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+* predictor_free
+* Releases the tables of a predictor
+*
+* parameters:
+* predictor_t* bp - predictor
+*
+* returns:
+* none
+*/
+void predictor_free(predictor_t* bp){
+	free(bp->counters);
+	for (int i = 0; i < TAGE_TABLES; i++){
+		free(bp->tags[i]);
+		free(bp->taken[i]);
+		free(bp->useful[i]);
+	}
+	memset(bp, 0, sizeof(predictor_t));
+}
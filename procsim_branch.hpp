@@ -0,0 +1,43 @@
+#ifndef PROCSIM_BRANCH_HPP
+#define PROCSIM_BRANCH_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Tagged tables of the TAGE predictor, history lengths double from TAGE_MIN_HISTORY
+#define TAGE_TABLES      4
+#define TAGE_MIN_HISTORY 8
+#define TAGE_TAG_BITS    9
+
+//Direction predictor. predictor_predict looks a branch up and predictor_update
+//trains on its outcome; each update must follow the predict of the same branch.
+typedef struct _predictor_t
+{
+    int kind;                       //PROC_PREDICT_*
+    uint32_t bits;                  //log2 of the entries of the base table
+    uint32_t mask;
+    uint64_t history;               //global outcomes, the newest in bit 0
+    uint8_t* counters;              //2-bit counters: bimodal, gshare, or the TAGE base table
+    uint32_t slot;                  //counter of the last lookup
+
+    //TAGE tagged tables, one array per field
+    uint32_t taggedBits;            //log2 of the entries of each tagged table
+    uint16_t* tags[TAGE_TABLES];
+    int8_t* taken[TAGE_TABLES];     //3-bit signed counters, taken when >= 0
+    uint8_t* useful[TAGE_TABLES];   //2-bit usefulness
+    uint32_t index[TAGE_TABLES];    //entries of the last lookup
+    uint16_t tag[TAGE_TABLES];
+    int provider;                   //longest matching table of the last lookup, -1 for the base
+    bool providerPrediction;
+    bool altPrediction;             //prediction without the provider
+} predictor_t;
+
+void predictor_init(predictor_t* bp, int kind, uint32_t bits);
+bool predictor_predict(predictor_t* bp, uint32_t pc);
+void predictor_update(predictor_t* bp, uint32_t pc, bool taken);
+void predictor_save(const predictor_t* bp, FILE* out);
+bool predictor_restore(predictor_t* bp, FILE* in);
+void predictor_free(predictor_t* bp);
+
+#endif /* PROCSIM_BRANCH_HPP */
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <functional>
+#include <thread>
+#include "procsim_cache.hpp"
+
+//FNV-1a parameters
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+//Bytes hashed per read of the trace
+#define HASH_BLOCK 65536
+
+//Header of a cached result, followed by blob_size bytes of blob
+typedef struct _cacheHeader{
+	char magic[4];
+	uint32_t version;
+	uint64_t traceHash;
+	uint64_t traceSize;
+	proc_config_t config;
+	uint32_t simulatorVersion;
+	uint32_t reserved;
+	proc_stats_t stats;
+	uint64_t blobSize;
+	uint64_t checksum;			//FNV-1a of stats and blob
+} cacheHeader;
+
+/*
+* hashBytes
+* Continues an FNV-1a hash over a buffer
+*
+* parameters:
+* uint64_t hash     - hash so far
+* const void* data  - bytes to add
+* uint64_t size     - number of bytes
+*
+* returns:
+* uint64_t - updated hash
+*/
+static uint64_t hashBytes(uint64_t hash, const void* data, uint64_t size){
+	const unsigned char* bytes = (const unsigned char*) data;
+
+	for (uint64_t i = 0; i < size; i++){
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+/*
+* cachePath
+* File holding a cached result
+*
+* parameters:
+* const char* dir         - cache directory
+* const cache_key_t* key  - result key
+* char* out               - buffer for the path
+* size_t size             - size of the buffer
+*
+* returns:
+* none
+*/
+static void cachePath(const char* dir, const cache_key_t* key, char* out, size_t size){
+	snprintf(out, size, "%s/%s.result", dir, key->name);
+}
+
+/*
+* cache_key
+* Hashes the trace contents, configuration and simulator version
+*
+* parameters:
+* const char* trace_path      - trace file
+* const proc_config_t* config - processor configuration
+* cache_key_t* key            - key to fill
+*
+* returns:
+* bool - false if the trace cannot be read
+*/
+bool cache_key(const char* trace_path, const proc_config_t* config, cache_key_t* key){
+	unsigned char* block;
+	size_t count;
+	uint64_t hash = FNV_OFFSET;
+	FILE* in;
+
+	in = fopen(trace_path, "rb");
+	if (in == NULL){
+		return false;
+	}
+
+	memset(key, 0, sizeof(cache_key_t));
+	block = (unsigned char*) malloc(HASH_BLOCK);
+	while ((count = fread(block, 1, HASH_BLOCK, in)) > 0){
+		hash = hashBytes(hash, block, count);
+		key->trace_size += count;
+	}
+	free(block);
+	fclose(in);
+
+	key->trace_hash = hash;
+	key->config = *config;
+	key->simulator_version = PROCSIM_VERSION;
+
+	hash = hashBytes(hash, &key->trace_size, sizeof(key->trace_size));
+	hash = hashBytes(hash, &key->config, sizeof(key->config));
+	hash = hashBytes(hash, &key->simulator_version, sizeof(key->simulator_version));
+	snprintf(key->name, sizeof(key->name), "%016llx", (unsigned long long) hash);
+
+	return true;
+}
+
+/*
+* cache_load
+* Reads a cached result. The file is checked against the full key and its checksum,
+* so a hash collision or a damaged file reads as a miss.
+*
+* parameters:
+* const char* dir         - cache directory
+* const cache_key_t* key  - result key
+* proc_stats_t* p_stats   - receives the statistics
+* void** blob             - receives a malloc'd copy of the blob, may be NULL
+* uint64_t* blob_size     - receives the blob size, may be NULL
+*
+* returns:
+* bool - true on a hit
+*/
+bool cache_load(const char* dir, const cache_key_t* key, proc_stats_t* p_stats, void** blob, uint64_t* blob_size){
+	char path[4096];
+	cacheHeader header;
+	void* data;
+	FILE* in;
+
+	cachePath(dir, key, path, sizeof(path));
+	in = fopen(path, "rb");
+	if (in == NULL){
+		return false;
+	}
+
+	if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, CACHE_MAGIC, 4) != 0 ||
+		header.version != CACHE_VERSION || header.traceHash != key->trace_hash ||
+		header.traceSize != key->trace_size || memcmp(&header.config, &key->config, sizeof(proc_config_t)) != 0 ||
+		header.simulatorVersion != key->simulator_version){
+		fclose(in);
+		return false;
+	}
+
+	data = malloc(header.blobSize > 0 ? header.blobSize : 1);
+	if (fread(data, 1, header.blobSize, in) != header.blobSize ||
+		hashBytes(hashBytes(FNV_OFFSET, &header.stats, sizeof(proc_stats_t)), data, header.blobSize) != header.checksum){
+		free(data);
+		fclose(in);
+		return false;
+	}
+	fclose(in);
+
+	*p_stats = header.stats;
+	if (blob != NULL){
+		*blob = data;
+	}else{
+		free(data);
+	}
+	if (blob_size != NULL){
+		*blob_size = header.blobSize;
+	}
+
+	return true;
+}
+
+/*
+* cache_store
+* Writes a result. The file is built under a name private to this process and
+* thread and renamed into place, so concurrent readers only ever see complete
+* files and concurrent writers of the same key simply replace each other.
+*
+* parameters:
+* const char* dir          - cache directory, created if missing
+* const cache_key_t* key   - result key
+* const proc_stats_t* p_stats - statistics to store
+* const void* blob         - optional extra data, may be NULL
+* uint64_t blob_size       - size of the blob
+*
+* returns:
+* bool - true on success
+*/
+bool cache_store(const char* dir, const cache_key_t* key, const proc_stats_t* p_stats, const void* blob, uint64_t blob_size){
+	char path[4096];
+	char tempPath[4096+64];
+	cacheHeader header;
+	bool failed;
+	FILE* out;
+
+	mkdir(dir, 0777);
+	cachePath(dir, key, path, sizeof(path));
+	snprintf(tempPath, sizeof(tempPath), "%s.%d.%zx.tmp", path, (int) getpid(),
+			 std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.traceHash = key->trace_hash;
+	header.traceSize = key->trace_size;
+	header.config = key->config;
+	header.simulatorVersion = key->simulator_version;
+	header.stats = *p_stats;
+	header.blobSize = (blob != NULL) ? blob_size : 0;
+	header.checksum = hashBytes(hashBytes(FNV_OFFSET, &header.stats, sizeof(proc_stats_t)), blob, header.blobSize);
+
+	out = fopen(tempPath, "wb");
+	if (out == NULL){
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, out);
+	if (header.blobSize > 0){
+		fwrite(blob, 1, header.blobSize, out);
+	}
+	failed = fflush(out) != 0 || fsync(fileno(out)) != 0;
+	failed = (fclose(out) != 0) || failed;
+	if (failed || rename(tempPath, path) != 0){
+		unlink(tempPath);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef PROCSIM_CACHE_HPP
+#define PROCSIM_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "procsim.hpp"
+
+#define CACHE_MAGIC   "PSRC"
+#define CACHE_VERSION 3
+
+//Identifies one (trace, configuration, simulator version) result
+typedef struct _cache_key_t
+{
+    uint64_t trace_hash;
+    uint64_t trace_size;
+    proc_config_t config;
+    uint32_t simulator_version;
+    char name[17];          //hex digest used as the file name
+} cache_key_t;
+
+bool cache_key(const char* trace_path, const proc_config_t* config, cache_key_t* key);
+bool cache_load(const char* dir, const cache_key_t* key, proc_stats_t* p_stats, void** blob, uint64_t* blob_size);
+bool cache_store(const char* dir, const cache_key_t* key, const proc_stats_t* p_stats, const void* blob, uint64_t blob_size);
+
+#endif /* PROCSIM_CACHE_HPP */
@@ -0,0 +1,156 @@
+#include <string.h>
+#include "procsim_dataflow.hpp"
+
+//Architectural registers named by the trace
+#define REGISTERS 32
+
+/*
+* latencyOf
+* Execute latency of an opcode, the ages given by scheduleInstructionstoFU
+*
+* parameters:
+* int32_t op_code - opcode from the trace
+*
+* returns:
+* uint64_t - cycles in the functional unit
+*/
+static uint64_t latencyOf(int32_t op_code){
+	if (op_code == 1){
+		return 2;
+	}else if (op_code == 2){
+		return 3;
+	}
+	return 1;		//k0, including -1
+}
+
+/*
+* bucketOf
+* Histogram bucket of a dependency distance
+*
+* parameters:
+* uint64_t distance - instructions between producer and consumer, at least 1
+*
+* returns:
+* int - bucket, distance in (2^(b-1), 2^b]
+*/
+static int bucketOf(uint64_t distance){
+	int bucket = 0;
+
+	distance--;
+	while (distance > 0 && bucket < DATAFLOW_BUCKETS-1){
+		distance >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/*
+* dataflow_analyze
+* One streaming pass that measures the opcode mix, producer to consumer
+* distances and the critical path through register dependences
+*
+* parameters:
+* proc_source_fn source - instruction source
+* void* context         - passed back to source
+* dataflow_t* result    - receives the measurements
+*
+* returns:
+* none
+*/
+void dataflow_analyze(proc_source_fn source, void* context, dataflow_t* result){
+	uint64_t writer[REGISTERS];		//1-based index of the last writer, 0 for none
+	uint64_t ready[REGISTERS];		//cycle the register's value is produced
+	proc_inst_t inst;
+
+	memset(result, 0, sizeof(dataflow_t));
+	memset(writer, 0, sizeof(writer));
+	memset(ready, 0, sizeof(ready));
+
+	while (source(&inst, context)){
+		uint64_t start = 0;
+		uint64_t index = ++result->instructions;
+
+		if (inst.op_code >= -1 && inst.op_code <= 2){
+			result->op_mix[inst.op_code + 1]++;
+		}else{
+			result->op_mix[DATAFLOW_CLASSES-1]++;
+		}
+
+		for (int i = 0; i < 2; i++){
+			int32_t reg = inst.src_reg[i];
+			if (reg < 0 || reg >= REGISTERS){
+				continue;
+			}
+			if (writer[reg] == 0){
+				result->no_producer++;
+				continue;
+			}
+			result->distance[bucketOf(index - writer[reg])]++;
+			if (ready[reg] > start){
+				start = ready[reg];
+			}
+		}
+
+		uint64_t done = start + latencyOf(inst.op_code);
+		if (done > result->critical_path){
+			result->critical_path = done;
+		}
+		if (inst.dest_reg >= 0 && inst.dest_reg < REGISTERS){
+			writer[inst.dest_reg] = index;
+			ready[inst.dest_reg] = done;
+		}
+	}
+
+	if (result->critical_path > 0){
+		result->ipc_bound = ((double)result->instructions)/result->critical_path;
+	}
+}
+
+/*
+* dataflow_config_bound
+* Upper bound on the IPC a configuration can reach: the fetch, dispatch, issue,
+* CDB and retire widths, the issue rate of each FU class and, for the reference
+* classes whose latencies the critical path assumes, the dataflow limit
+*
+* parameters:
+* const dataflow_t* result    - measurements of the trace
+* const proc_config_t* config - configuration to bound
+*
+* returns:
+* double - IPC no simulation of this configuration can exceed
+*/
+double dataflow_config_bound(const dataflow_t* result, const proc_config_t* config){
+	proc_fu_t fu[PROC_MAX_CLASSES];
+	uint64_t perClass[PROC_MAX_CLASSES] = {0};
+	int classes = fu_classes_proc(config, fu);
+	double bound = (config->classes == 0) ? result->ipc_bound : (double)config->f;
+
+	//Opcodes outside -1..2 are not told apart, leaving them out only loosens the bound
+	for (int op = -1; op <= 2; op++){
+		for (int c = 0; c < classes; c++){
+			if (fu[c].opcodes & PROC_OPCODE_BIT(op)){
+				perClass[c] += result->op_mix[op + 1];
+				break;
+			}
+		}
+	}
+
+	uint64_t widths[5] = {config->f, config->dispatch, config->cdb, config->retire, config->issue};
+	for (int i = 0; i < 5; i++){
+		if (widths[i] > 0 && (double)widths[i] < bound){
+			bound = widths[i];
+		}
+	}
+	for (int c = 0; c < classes; c++){
+		uint32_t interval = (fu[c].interval > 0) ? fu[c].interval : 1;
+
+		if (perClass[c] == 0){
+			continue;
+		}
+		double classBound = ((double)result->instructions) * fu[c].count / interval / perClass[c];
+		if (classBound < bound){
+			bound = classBound;
+		}
+	}
+	return bound;
+}
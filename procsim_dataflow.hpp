@@ -0,0 +1,26 @@
+#ifndef PROCSIM_DATAFLOW_HPP
+#define PROCSIM_DATAFLOW_HPP
+
+#include <cstdint>
+#include "procsim.hpp"
+
+//Dependency distances are bucketed by powers of two: 1, 2, 3-4, 5-8, ...
+#define DATAFLOW_BUCKETS 24
+
+//Opcode classes -1, 0, 1 and 2, anything else is counted as other
+#define DATAFLOW_CLASSES 5
+
+typedef struct _dataflow_t
+{
+    uint64_t instructions;
+    uint64_t op_mix[DATAFLOW_CLASSES];          //index op_code + 1, other last
+    uint64_t distance[DATAFLOW_BUCKETS];        //producer to consumer distances
+    uint64_t no_producer;                       //sources never written before
+    uint64_t critical_path;                     //cycles with unlimited resources
+    double ipc_bound;                           //instructions / critical path
+} dataflow_t;
+
+void dataflow_analyze(proc_source_fn source, void* context, dataflow_t* result);
+double dataflow_config_bound(const dataflow_t* result, const proc_config_t* config);
+
+#endif /* PROCSIM_DATAFLOW_HPP */
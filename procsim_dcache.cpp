@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "procsim_dcache.hpp"
+
+//Block number of an invalid way, no 32-bit address with a line of 4 or more bytes reaches it
+#define DCACHE_EMPTY UINT32_MAX
+
+/*
+* log2Floor
+* Largest power of two exponent not above a value
+*
+* parameters:
+* uint64_t value - value, at least 1
+*
+* returns:
+* uint32_t - floor(log2(value))
+*/
+static uint32_t log2Floor(uint64_t value){
+	uint32_t bits = 0;
+
+	while (value > 1){
+		value >>= 1;
+		bits++;
+	}
+	return bits;
+}
+
+/*
+* levelInit
+* Allocates one empty level
+*
+* parameters:
+* dcache_level_t* level      - level to fill
+* const proc_level_t* config - its size, ways and latency
+* uint32_t lineBits          - log2 of the line size
+*
+* returns:
+* none
+*/
+static void levelInit(dcache_level_t* level, const proc_level_t* config, uint32_t lineBits){
+	uint64_t ways = (config->assoc > 0) ? config->assoc : 1;
+	uint64_t lines = config->size >> lineBits;
+
+	if (ways > lines){
+		ways = (lines > 0) ? lines : 1;
+	}
+	level->ways = ways;
+	level->sets = 1u << log2Floor((lines/ways > 0) ? lines/ways : 1);
+	level->blocks = (uint32_t*) malloc(level->sets*level->ways*sizeof(uint32_t));
+	level->stamps = (uint32_t*) calloc(level->sets*level->ways, sizeof(uint32_t));
+	level->clock = 0;
+	for (uint32_t i = 0; i < level->sets*level->ways; i++){
+		level->blocks[i] = DCACHE_EMPTY;
+	}
+}
+
+/*
+* levelAccess
+* Looks a block up in one level and makes it the most recently used, filling
+* the least recently used way on a miss
+*
+* parameters:
+* dcache_level_t* level - level
+* uint32_t block        - block number
+*
+* returns:
+* bool - true on a hit
+*/
+static bool levelAccess(dcache_level_t* level, uint32_t block){
+	uint32_t base = (block & (level->sets - 1))*level->ways;
+	uint32_t* blocks = level->blocks + base;
+	uint32_t* stamps = level->stamps + base;
+	uint32_t victim = 0;
+
+	level->clock++;
+	for (uint32_t w = 0; w < level->ways; w++){
+		if (blocks[w] == block){
+			stamps[w] = level->clock;
+			return true;
+		}
+	}
+	for (uint32_t w = 1; w < level->ways; w++){
+		if (level->clock - stamps[w] > level->clock - stamps[victim]){
+			victim = w;
+		}
+	}
+	blocks[victim] = block;
+	stamps[victim] = level->clock;
+	return false;
+}
+
+/*
+* dcache_init
+* Builds the data cache a configuration describes, none if its L1 has no size.
+* Each level rounds its sets down to a power of two.
+*
+* parameters:
+* dcache_t* cache             - cache
+* const proc_config_t* config - configuration
+*
+* returns:
+* none
+*/
+void dcache_init(dcache_t* cache, const proc_config_t* config){
+	uint64_t line = (config->line >= 4) ? config->line : DEFAULT_LINE;
+
+	memset(cache, 0, sizeof(dcache_t));
+	if (config->l1.size == 0){
+		return;
+	}
+	cache->lineBits = log2Floor(line);
+	levelInit(&cache->level[0], &config->l1, cache->lineBits);
+	cache->levels = 1;
+	if (config->l2.size > 0){
+		levelInit(&cache->level[1], &config->l2, cache->lineBits);
+		cache->levels = 2;
+	}
+
+	cache->latency[DCACHE_NONE] = 0;
+	cache->latency[DCACHE_L1] = config->l1.latency;
+	cache->latency[DCACHE_L2] = config->l1.latency + config->l2.latency;
+	cache->latency[DCACHE_MEMORY] = cache->latency[cache->levels] + config->memory_latency;
+}
+
+/*
+* dcache_access
+* Reads or writes an address, allocating its line in every level it missed
+*
+* parameters:
+* dcache_t* cache  - cache with at least one level
+* uint32_t address - data address
+*
+* returns:
+* int - DCACHE_L1, DCACHE_L2 or DCACHE_MEMORY, the level that served it
+*/
+int dcache_access(dcache_t* cache, uint32_t address){
+	uint32_t block = address >> cache->lineBits;
+
+	for (int i = 0; i < cache->levels; i++){
+		if (levelAccess(&cache->level[i], block)){
+			return DCACHE_L1 + i;
+		}
+	}
+	return DCACHE_MEMORY;
+}
+
+/*
+* dcache_save
+* Writes the contents of every level
+*
+* parameters:
+* const dcache_t* cache - cache
+* FILE* out             - checkpoint file
+*
+* returns:
+* none
+*/
+void dcache_save(const dcache_t* cache, FILE* out){
+	for (int i = 0; i < cache->levels; i++){
+		const dcache_level_t* level = &cache->level[i];
+		fwrite(&level->clock, sizeof(uint32_t), 1, out);
+		fwrite(level->blocks, sizeof(uint32_t), level->sets*level->ways, out);
+		fwrite(level->stamps, sizeof(uint32_t), level->sets*level->ways, out);
+	}
+}
+
+/*
+* dcache_restore
+* Reads the contents written by dcache_save into a cache built from the same
+* configuration
+*
+* parameters:
+* dcache_t* cache - cache
+* FILE* in        - checkpoint file
+*
+* returns:
+* bool - true on success
+*/
+bool dcache_restore(dcache_t* cache, FILE* in){
+	for (int i = 0; i < cache->levels; i++){
+		dcache_level_t* level = &cache->level[i];
+		size_t entries = level->sets*level->ways;
+		if (fread(&level->clock, sizeof(uint32_t), 1, in) != 1 ||
+			fread(level->blocks, sizeof(uint32_t), entries, in) != entries ||
+			fread(level->stamps, sizeof(uint32_t), entries, in) != entries){
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+* dcache_free
+* Releases the levels of a cache
+*
+* parameters:
+* dcache_t* cache - cache
+*
+* returns:
+* none
+*/
+void dcache_free(dcache_t* cache){
+	for (int i = 0; i < DCACHE_LEVELS; i++){
+		free(cache->level[i].blocks);
+		free(cache->level[i].stamps);
+	}
+	memset(cache, 0, sizeof(dcache_t));
+}
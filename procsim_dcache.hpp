@@ -0,0 +1,42 @@
+#ifndef PROCSIM_DCACHE_HPP
+#define PROCSIM_DCACHE_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Levels of the data cache, an access that misses both goes to memory
+#define DCACHE_LEVELS 2
+
+//Level that served an access
+#define DCACHE_NONE   0     //not a memory access
+#define DCACHE_L1     1
+#define DCACHE_L2     2
+#define DCACHE_MEMORY 3
+
+//One set-associative LRU level. Block numbers and use stamps sit in separate
+//arrays, so a lookup scans the ways of a set in one or two cache lines.
+typedef struct _dcache_level_t
+{
+    uint32_t sets;          //power of two
+    uint32_t ways;
+    uint32_t* blocks;       //sets*ways block numbers, DCACHE_EMPTY when invalid
+    uint32_t* stamps;       //sets*ways accesses at the last use
+    uint32_t clock;         //accesses so far
+} dcache_level_t;
+
+typedef struct _dcache_t
+{
+    int levels;             //0 without a data cache model
+    uint32_t lineBits;
+    dcache_level_t level[DCACHE_LEVELS];
+    uint32_t latency[DCACHE_MEMORY+1];  //total latency of an access served by each level
+} dcache_t;
+
+void dcache_init(dcache_t* cache, const proc_config_t* config);
+int dcache_access(dcache_t* cache, uint32_t address);
+void dcache_save(const dcache_t* cache, FILE* out);
+bool dcache_restore(dcache_t* cache, FILE* in);
+void dcache_free(dcache_t* cache);
+
+#endif /* PROCSIM_DCACHE_HPP */
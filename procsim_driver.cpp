@@ -3,9 +3,106 @@
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "procsim.hpp"
+#include "procsim_trace.hpp"
+#include "procsim_cache.hpp"
+#include "procsim_dataflow.hpp"
+#include "procsim_interval.hpp"
+#include "procsim_reference.hpp"
+#include "procsim_perf.hpp"
+#include "procsim_kanata.hpp"
 
-FILE* inFile = stdin;
+//Trace read by the main thread
+trace_t* inTrace = NULL;
+const char* inPath = NULL;
+
+//Instruction source of the calling thread: a trace, or an in-memory range
+static thread_local trace_t* threadTrace = NULL;
+static thread_local uint64_t threadRemaining = UINT64_MAX;
+static thread_local const proc_inst_t* shardNext = NULL;
+static thread_local const proc_inst_t* shardEnd = NULL;
+
+//One contiguous slice of the trace simulated on its own thread
+typedef struct _shard_t {
+    const char* path;               //trace reopened and seeked by the worker, NULL if in memory
+    const proc_inst_t* memory;      //whole trace when it cannot be reopened
+    uint64_t first;                 //first instruction, including warmup prefix
+    uint64_t end;                   //one past the last instruction
+    uint64_t warmup;                //leading instructions not counted
+    proc_stats_t stats;
+} shard_t;
+
+//Outcome of one configuration considered by the guided search
+enum {
+    SEARCH_PENDING,
+    SEARCH_RUNNING,
+    SEARCH_PASS,                    //simulated, meets the target on every trace
+    SEARCH_FAIL,                    //simulated, misses the target on some trace
+    SEARCH_BOUND,                   //dataflow bound below the target, not simulated
+    SEARCH_DOMINATED,               //no larger than a failing configuration, not simulated
+    SEARCH_ABANDONED,               //stopped once a cheaper configuration passed
+    SEARCH_SKIPPED                  //no cheaper than the best passing configuration
+};
+
+//Resources the guided search compares, the sweep keys
+#define SEARCH_KEYS "rjklfmdbwq"
+
+//Host counter modes of -H
+#define HOST_OFF    0
+#define HOST_RUN    1               //totals around run_proc
+#define HOST_STAGES 2               //totals and a breakdown by pipeline stage
+
+//Table columns of the widths and issue policy
+#define WIDTH_COLUMNS "D\tB\tW\tQ\tPOLICY\t"
+
+//One configuration considered by the guided search
+typedef struct _candidate_t {
+    proc_config_t config;
+    double cost;
+    int status;
+    double ipc;                     //lowest IPC over the traces, passing candidates only
+} candidate_t;
+
+//State shared by the search workers
+typedef struct _search_t {
+    std::vector<candidate_t> candidates;    //ascending cost
+    std::vector<size_t> order;              //candidates in the order they are tried
+    std::vector<const char*> traces;
+    std::vector<uint64_t> lengths;          //instructions in each trace
+    double target;
+    size_t next;                            //first candidate not yet handed out
+    std::mutex lock;
+    std::atomic<double> bestCost;           //cost of the cheapest passing configuration
+} search_t;
+
+//Cores of a multi-core run and the barrier they meet at every epoch
+typedef struct _multicore_t {
+    std::vector<const char*> traces;        //one per core
+    std::vector<proc_stats_t> now;          //per-core statistics at the latest barrier
+    std::vector<proc_stats_t> last;         //per-core statistics at the barrier before
+    std::vector<bool> running;
+    uint64_t epoch;                         //cycles between barriers, 0 to meet only at the end
+    uint64_t epochs;                        //barriers passed
+    size_t arrived;                         //cores waiting at the current barrier
+    uint64_t generation;                    //barriers released
+    bool done;                              //every core has finished
+    std::mutex lock;
+    std::condition_variable release;
+} multicore_t;
+
+//Instruction source of one search simulation
+typedef struct _search_cursor_t {
+    trace_t* trace;
+    search_t* search;
+    double cost;
+    bool abandoned;
+} search_cursor_t;
 
 void print_help_and_exit(void) {
     printf("procsim [OPTIONS]\n");
@@ -15,75 +112,1470 @@ void print_help_and_exit(void) {
     printf("  -m M\t\tScheduler Queue Multiplier\n");    
     printf("  -f N\t\tNumber of instructions to fetch\n");
     printf("  -r R\t\tROB Size\n");
+    printf("  -D D\t\tDispatch width (default no limit)\n");
+    printf("  -B B\t\tCDB broadcasts per cycle, oldest results first (default no limit)\n");
+    printf("  -W W\t\tRetire width (default F)\n");
+    printf("  -Q Q\t\tIssue width over all classes (default no limit)\n");
+    printf("  -P policy\tIssue selection: oldest (default), critical, latency or rr\n");
+    printf("  -u\t\tOne unified scheduler of M entries per FU instead of a queue per class\n");
+    printf("  -p bp[:bits]\tBranch predictor for traces with outcomes: none (default), bimodal, gshare\n");
+    printf("\t\tor tage, with 2^bits entries (default %d)\n", DEFAULT_PREDICTOR_BITS);
+    printf("  -Z P\t\tCycles fetch waits after a mispredicted branch resolves (default 0)\n");
+    printf("  -L spec\tData cache timing memory instructions, e.g. l1=32k:8:3,l2=256k:8:12,mem=100\n");
+    printf("\t\t(size:ways:latency per level, line=bytes, default %d)\n", DEFAULT_LINE);
     printf("  -i traces/file.trace\n");
+    printf("  -s K\t\tSplit the trace into K shards simulated in parallel\n");
+    printf("  -w W\t\tWarmup instructions replayed ahead of each shard\n");
+    printf("  -c N\t\tCheckpoint every N cycles\n");
+    printf("  -C file\tCheckpoint file written by -c\n");
+    printf("  -R file\tResume from a checkpoint, skipping the instructions it consumed\n");
+    printf("  -U file\tFU classes, one per line: count latency interval op,op,... (replaces -j -k -l)\n");
+    printf("  -S spec\tSweep in one pass, e.g. r=8,16,32:m=1,2 (keys r j k l f m d b w q p u,\n");
+    printf("\t\tp takes 0-3 in the order of -P)\n");
+    printf("  -a\t\tPrint the dataflow limits of the trace and exit\n");
+    printf("  -E\t\tEstimate cycles with the analytical interval model instead of simulating\n");
+    printf("  -T IPC\t\tWith -S, skip configurations whose IPC bound is below IPC\n");
+    printf("  -G spec\tWith -S and -T, search for the cheapest configuration reaching IPC on\n");
+    printf("\t\tthe -i trace and any traces after the options, e.g. r=1:j=4:k=6:l=8:f=10:m=2\n");
+    printf("\t\tweighs each unit of each key (default 1, 0 for d b w)\n");
+    printf("  -n N\t\tStop once N instructions have retired after the warmup\n");
+    printf("  -N C\t\tStop after C cycles after the warmup\n");
+    printf("  -v W:K:TOL\tStop once the IPC of K consecutive W-cycle windows spreads by at most\n");
+    printf("\t\tTOL of their mean, e.g. 1000:5:0.01\n");
+    printf("  -M\t\tMulti-core: one core per trace, the -i trace and any after the options,\n");
+    printf("\t\teach on its own host thread\n");
+    printf("  -e E\t\tWith -M, report per-core IPC every E cycles (default %d, 0 only at the end)\n", DEFAULT_EPOCH);
+    printf("  -t policy\tSMT: one hardware thread per trace, the -i trace and any after the options,\n");
+    printf("\t\tsharing one core; fetch policy rr or icount\n");
+    printf("  -x dir\t\tReuse results cached in dir for the -i trace, prints statistics only\n");
+    printf("  -V T\t\tCheck every cycle against the original simulator, on T host threads (1 or 2);\n");
+    printf("\t\tk0/k1/k2 configurations without the later pipeline options only\n");
+    printf("  -H mode\tReport host instructions, cycles, L1D and LLC misses, branch mispredictions\n");
+    printf("\t\tand CPU time per simulated instruction on stderr, counted by perf_event_open\n");
+    printf("\t\taround the run (run) or also per pipeline stage (stages, slower)\n");
+    printf("  -K file\tWrite the pipeline of the run as a Kanata log for the Konata viewer\n");
+    printf("  -Y window\tWith -K, export instructions A to B (i:A-B) or those in flight during\n");
+    printf("\t\tcycles A to B (c:A-B), e.g. i:1000-2000 or c:5000-\n");
+    printf("  -I N\t\tWrite the sidecar index of the -i trace every N instructions and exit\n");
+    printf("  -b file\tConvert the trace to binary format and exit\n");
     printf("  -h\t\tThis helpful output\n");
     exit(0);
 }
 
 //
-// read_instruction
+// read_instruction
+//
+//  returns true if an instruction was read successfully
+//
+bool read_instruction(proc_inst_t* p_inst)
+{
+    if (p_inst == NULL)
+    {
+        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+        return false;
+    }
+
+    if (threadRemaining == 0) {
+        return false;
+    }
+
+    if (shardNext != NULL) {
+        if (shardNext == shardEnd) {
+            return false;
+        }
+        *p_inst = *shardNext++;
+        return true;
+    }
+
+    if (!trace_read(threadTrace, p_inst)) {
+        return false;
+    }
+    threadRemaining--;
+    
+    return true;
+}
+
+void print_statistics(proc_stats_t* p_stats);
+void print_settings(const proc_config_t* config);
+
+//
+// read_source
+//
+//  instruction source handed to the simulator library
+//
+bool read_source(proc_inst_t* p_inst, void* context)
+{
+    return read_instruction(p_inst);
+}
+
+//
+// print_retired
+//
+//  retire callback printing one table row per instruction
+//
+void print_retired(const proc_retire_t* records, uint64_t count, void* context)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        printf("%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\n",
+               records[i].line_number, records[i].fetch, records[i].disp, records[i].sched,
+               records[i].exec, records[i].state, records[i].retire);
+    }
+}
+
+//
+// export_retired
+//
+//  retire callback printing the table and adding the rows to a Kanata log
+//
+void export_retired(const proc_retire_t* records, uint64_t count, void* context)
+{
+    print_retired(records, count, NULL);
+    kanata_retire((kanata_t*) context, records, count);
+}
+
+//
+// read_window
+//
+//  parses the range of -Y, "i:A-B" for instructions A to B or "c:A-B" for
+//  the instructions in flight during cycles A to B, either end may be left out
+//
+bool read_window(const char* spec, kanata_window_t* window)
+{
+    int64_t* first;
+    int64_t* last;
+    const char* dash = strchr(spec, '-');
+
+    kanata_all(window);
+    if (strncmp(spec, "i:", 2) == 0) {
+        first = &window->first_line;
+        last = &window->last_line;
+    } else if (strncmp(spec, "c:", 2) == 0) {
+        first = &window->first_cycle;
+        last = &window->last_cycle;
+    } else {
+        fprintf(stderr, "Bad export window %s, expected i:A-B or c:A-B\n", spec);
+        return false;
+    }
+    if (dash == NULL) {
+        fprintf(stderr, "Bad export window %s, expected i:A-B or c:A-B\n", spec);
+        return false;
+    }
+    if (dash > spec + 2) {
+        *first = atoll(spec + 2);
+    }
+    if (dash[1] != '\0') {
+        *last = atoll(dash + 1);
+    }
+    return true;
+}
+
+//
+// run_shard
+//
+//  simulates one shard on the calling thread with a private processor
+//
+void run_shard(shard_t* shard, const proc_config_t* config)
+{
+    if (shard->path != NULL) {
+        threadTrace = trace_open(shard->path);
+        if (threadTrace == NULL || !trace_seek(threadTrace, shard->first)) {
+            fprintf(stderr, "Failed to seek %s to instruction %" PRIu64 "\n", shard->path, shard->first);
+            exit(1);
+        }
+        threadRemaining = shard->end - shard->first;
+    } else {
+        shardNext = shard->memory + shard->first;
+        shardEnd = shard->memory + shard->end;
+    }
+
+    configure_proc(config);
+    set_source_proc(read_source, NULL);
+    set_warmup_proc(shard->warmup);
+
+    memset(&shard->stats, 0, sizeof(proc_stats_t));
+    run_proc(&shard->stats);
+    complete_proc(&shard->stats);
+
+    if (threadTrace != NULL) {
+        trace_close(threadTrace);
+    }
+}
+
+//
+// run_sharded
+//
+//  splits the whole trace into contiguous shards, simulates them in parallel
+//  and stitches the per-shard cycle counts into one estimate. Traces with a
+//  known length are reopened and seeked by each worker, others are loaded.
+//
+void run_sharded(proc_stats_t* p_stats, uint64_t shards, uint64_t warmup, const proc_config_t* config)
+{
+    std::vector<proc_inst_t> trace;
+    proc_inst_t inst;
+    uint64_t length = inTrace->length;
+
+    if (inPath == NULL || length == TRACE_LENGTH_UNKNOWN) {
+        while (read_instruction(&inst)) {
+            trace.push_back(inst);
+        }
+        length = trace.size();
+    }
+    if (shards > length) {
+        shards = length > 0 ? length : 1;
+    }
+
+    //Each shard owns [i*n/K, (i+1)*n/K) and replays up to W instructions before it
+    std::vector<shard_t> shard(shards);
+    std::vector<std::thread> workers;
+    for (uint64_t i = 0; i < shards; i++) {
+        uint64_t begin = i * length / shards;
+        uint64_t pre = begin < warmup ? begin : warmup;
+
+        shard[i].path = trace.empty() ? inPath : NULL;
+        shard[i].memory = trace.data();
+        shard[i].first = begin - pre;
+        shard[i].end = (i + 1) * length / shards;
+        shard[i].warmup = pre;
+        workers.push_back(std::thread(run_shard, &shard[i], config));
+    }
+
+    printf("SHARD\tFIRST\tLAST\tWARMUP\tCYCLES\tIPC\n");
+    for (uint64_t i = 0; i < shards; i++) {
+        workers[i].join();
+        p_stats->retired_instruction += shard[i].stats.retired_instruction;
+        p_stats->cycle_count += shard[i].stats.cycle_count;
+        p_stats->branches += shard[i].stats.branches;
+        p_stats->mispredictions += shard[i].stats.mispredictions;
+        p_stats->accesses += shard[i].stats.accesses;
+        p_stats->l1_misses += shard[i].stats.l1_misses;
+        p_stats->l2_misses += shard[i].stats.l2_misses;
+        printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%lu\t%f\n", i,
+               shard[i].first + shard[i].warmup + 1, shard[i].end,
+               shard[i].warmup, shard[i].stats.cycle_count, shard[i].stats.avg_inst_retired);
+    }
+    printf("\n");
+
+    if (p_stats->cycle_count > 0) {
+        p_stats->avg_inst_retired = ((double)p_stats->retired_instruction)/p_stats->cycle_count;
+    }
+}
+
+//
+// multicore_epoch
+//
+//  prints the IPC of each core over the epoch that just ended and their sum,
+//  called by the last core to reach the barrier
+//
+void multicore_epoch(multicore_t* multi)
+{
+    double total = 0;
+
+    if (multi->epoch == 0) {
+        return;
+    }
+    if (multi->epochs == 0) {
+        printf("EPOCH\tCYCLE");
+        for (size_t i = 0; i < multi->traces.size(); i++) {
+            printf("\tIPC%zu", i);
+        }
+        printf("\tTOTAL\n");
+    }
+    printf("%" PRIu64 "\t%" PRIu64, multi->epochs, (multi->epochs + 1) * multi->epoch);
+    for (size_t i = 0; i < multi->traces.size(); i++) {
+        uint64_t cycles = multi->now[i].cycle_count - multi->last[i].cycle_count;
+        uint64_t retired = multi->now[i].retired_instruction - multi->last[i].retired_instruction;
+        double ipc = (cycles > 0) ? ((double)retired)/cycles : 0;
+
+        printf("\t%f", ipc);
+        total += ipc;
+    }
+    printf("\t%f\n", total);
+}
+
+//
+// multicore_barrier
+//
+//  waits until every core has reached the end of the epoch
+//
+//  returns false once no core is running
+//
+bool multicore_barrier(multicore_t* multi, size_t core, bool running, const proc_stats_t* stats)
+{
+    std::unique_lock<std::mutex> hold(multi->lock);
+    uint64_t generation = multi->generation;
+
+    multi->now[core] = *stats;
+    multi->running[core] = running;
+    if (++multi->arrived == multi->traces.size()) {
+        multicore_epoch(multi);
+        multi->last = multi->now;
+        multi->epochs++;
+        multi->arrived = 0;
+        multi->done = std::find(multi->running.begin(), multi->running.end(), true) == multi->running.end();
+        multi->generation++;
+        multi->release.notify_all();
+    } else {
+        multi->release.wait(hold, [&] { return multi->generation != generation; });
+    }
+    return !multi->done;
+}
+
+//
+// run_core
+//
+//  simulates one core of a multi-core run on the calling thread, pausing at
+//  every epoch boundary until the other cores catch up
+//
+void run_core(multicore_t* multi, size_t core, const proc_config_t* config, const proc_stop_t* stop)
+{
+    proc_stats_t stats;
+    bool running = true;
+
+    threadTrace = trace_open(multi->traces[core]);
+    if (threadTrace == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", multi->traces[core]);
+        exit(1);
+    }
+    configure_proc(config);
+    set_source_proc(read_source, NULL);
+    set_stop_proc(stop);
+
+    do {
+        if (running) {
+            running = step_proc(multi->epoch > 0 ? multi->epoch : UINT64_MAX);
+        }
+        snapshot_proc(&stats);
+    } while (multicore_barrier(multi, core, running, &stats));
+
+    run_proc(&stats);
+    complete_proc(&multi->now[core]);
+    trace_close(threadTrace);
+    threadTrace = NULL;
+}
+
+//
+// run_multicore
+//
+//  simulates one core per trace, each on its own host thread. The cores share
+//  nothing and only meet every epoch cycles to report their IPC.
+//
+void run_multicore(proc_stats_t* p_stats, const std::vector<const char*>& traces, uint64_t epoch,
+                   const proc_config_t* config, const proc_stop_t* stop)
+{
+    multicore_t multi;
+    std::vector<std::thread> workers;
+    double total = 0;
+
+    multi.traces = traces;
+    multi.now.assign(traces.size(), proc_stats_t());
+    multi.last.assign(traces.size(), proc_stats_t());
+    multi.running.assign(traces.size(), true);
+    multi.epoch = epoch;
+    multi.epochs = 0;
+    multi.arrived = 0;
+    multi.generation = 0;
+    multi.done = false;
+
+    for (size_t i = 0; i < traces.size(); i++) {
+        workers.push_back(std::thread(run_core, &multi, i, config, stop));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    if (epoch > 0) {
+        printf("\n");
+    }
+
+    printf("CORE\tINSTS\tCYCLES\tIPC\tTRACE\n");
+    for (size_t i = 0; i < traces.size(); i++) {
+        printf("%zu\t%lu\t%lu\t%f\t%s\n", i, multi.now[i].retired_instruction, multi.now[i].cycle_count,
+               multi.now[i].avg_inst_retired, traces[i]);
+        p_stats->retired_instruction += multi.now[i].retired_instruction;
+        p_stats->branches += multi.now[i].branches;
+        p_stats->mispredictions += multi.now[i].mispredictions;
+        p_stats->accesses += multi.now[i].accesses;
+        p_stats->l1_misses += multi.now[i].l1_misses;
+        p_stats->l2_misses += multi.now[i].l2_misses;
+        if (multi.now[i].cycle_count > p_stats->cycle_count) {
+            p_stats->cycle_count = multi.now[i].cycle_count;
+        }
+        total += multi.now[i].avg_inst_retired;
+    }
+    printf("Sum of per-core IPC: %f\n\n", total);
+
+    if (p_stats->cycle_count > 0) {
+        p_stats->avg_inst_retired = ((double)p_stats->retired_instruction)/p_stats->cycle_count;
+    }
+}
+
+//
+// read_thread_source
+//
+//  instruction source of one SMT thread, its context is the thread's trace
+//
+bool read_thread_source(proc_inst_t* p_inst, void* context)
+{
+    return trace_read((trace_t*) context, p_inst);
+}
+
+//
+// print_thread_retired
+//
+//  retire callback of an SMT run, one table row per instruction led by its thread
+//
+void print_thread_retired(const proc_retire_t* records, uint64_t count, void* context)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        printf("%" PRId64 "\t", records[i].thread);
+        print_retired(&records[i], 1, context);
+    }
+}
+
+//
+// run_smt
+//
+//  simulates one core whose hardware threads each run one trace, sharing its
+//  ROB, schedulers and functional units
+//
+void run_smt(proc_stats_t* p_stats, const std::vector<const char*>& traces, const proc_config_t* config,
+             const proc_stop_t* stop)
+{
+    std::vector<trace_t*> inputs;
+    std::vector<proc_stats_t> threads(traces.size());
+    double total = 0;
+
+    configure_proc(config);
+    for (size_t i = 0; i < traces.size(); i++) {
+        inputs.push_back(trace_open(traces[i]));
+        if (inputs[i] == NULL) {
+            fprintf(stderr, "Failed to open %s for reading\n", traces[i]);
+            exit(1);
+        }
+        set_thread_source_proc(i, read_thread_source, inputs[i]);
+    }
+    set_retire_proc(print_thread_retired, NULL);
+    set_stop_proc(stop);
+
+    printf("THREAD\tINST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\tRETIRE\n");
+    run_proc(p_stats);
+    for (size_t i = 0; i < traces.size(); i++) {
+        thread_stats_proc(i, &threads[i]);
+    }
+    complete_proc(p_stats);
+    printf("\n");
+
+    printf("THREAD\tINSTS\tCYCLES\tIPC\tTRACE\n");
+    for (size_t i = 0; i < traces.size(); i++) {
+        printf("%zu\t%lu\t%lu\t%f\t%s\n", i, threads[i].retired_instruction, threads[i].cycle_count,
+               threads[i].avg_inst_retired, traces[i]);
+        total += threads[i].avg_inst_retired;
+        trace_close(inputs[i]);
+    }
+    printf("Sum of per-thread IPC: %f\n\n", total);
+}
+
+//
+// sweep_field
+//
+//  maps a sweep key to the configuration field set by the same option letter
+//
+uint64_t* sweep_field(proc_config_t* config, char key)
+{
+    switch (key) {
+    case 'r': return &config->r;
+    case 'j': return &config->k0;
+    case 'k': return &config->k1;
+    case 'l': return &config->k2;
+    case 'f': return &config->f;
+    case 'm': return &config->m;
+    case 'd': return &config->dispatch;
+    case 'b': return &config->cdb;
+    case 'w': return &config->retire;
+    case 'u': return &config->scheduler;
+    case 'p': return &config->policy;
+    case 'q': return &config->issue;
+    default: return NULL;
+    }
+}
+
+//
+// sweep_rank
+//
+//  size of a resource for comparing configurations, a width of 0 has no limit
+//
+uint64_t sweep_rank(proc_config_t* config, char key)
+{
+    uint64_t value = *sweep_field(config, key);
+
+    if (value == 0 && (key == 'd' || key == 'b' || key == 'w' || key == 'q')) {
+        return UINT64_MAX;
+    }
+    return value;
+}
+
+//
+// unified_set
+//
+//  true if any configuration uses the unified scheduler, the tables then
+//  compare organizations by IPC per scheduler entry
+//
+bool unified_set(const std::vector<proc_config_t>& configs)
+{
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (configs[i].scheduler == PROC_SCHED_UNIFIED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// sweep_cost
+//
+//  size of a resource when pricing a configuration, a width of 0 is priced as
+//  the widest it can usefully be: F for dispatch and retire, every unit for the CDB
+//  and for issue
+//
+uint64_t sweep_cost(proc_config_t* config, char key)
+{
+    proc_fu_t table[PROC_MAX_CLASSES];
+    uint64_t value = *sweep_field(config, key);
+    uint64_t units = 0;
+
+    if (value > 0 || (key != 'd' && key != 'b' && key != 'w' && key != 'q')) {
+        return value;
+    }
+    if (key == 'd' || key == 'w') {
+        return config->f;
+    }
+    for (uint64_t c = 0, classes = fu_classes_proc(config, table); c < classes; c++) {
+        units += table[c].count;
+    }
+    return units;
+}
+
+//
+// policy_name
+//
+//  names an issue policy, as -P takes it
+//
+const char* policy_name(uint64_t policy)
+{
+    const char* names[PROC_POLICIES] = {"oldest", "critical", "latency", "rr"};
+
+    return policy < PROC_POLICIES ? names[policy] : "?";
+}
+
+//
+// fetch_name
+//
+//  names an SMT fetch policy, as -t takes it
+//
+const char* fetch_name(uint64_t fetch)
+{
+    const char* names[PROC_FETCH_POLICIES] = {"rr", "icount"};
+
+    return fetch < PROC_FETCH_POLICIES ? names[fetch] : "?";
+}
+
+//
+// predictor_name
+//
+//  names a branch predictor, as -p takes it
+//
+const char* predictor_name(uint64_t predictor)
+{
+    const char* names[PROC_PREDICTORS] = {"none", "bimodal", "gshare", "tage"};
+
+    return predictor < PROC_PREDICTORS ? names[predictor] : "?";
+}
+
+//
+// widths_set
+//
+//  true if any configuration limits its dispatch, CDB, retire or issue width or
+//  changes the issue policy, the tables then show those columns
+//
+bool widths_set(const std::vector<proc_config_t>& configs)
+{
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (configs[i].dispatch > 0 || configs[i].cdb > 0 || configs[i].retire > 0 || configs[i].issue > 0 ||
+            configs[i].policy != PROC_POLICY_OLDEST) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// print_widths
+//
+//  prints the width and policy columns of a table row
+//
+void print_widths(const proc_config_t* config)
+{
+    printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\t", config->dispatch, config->cdb, config->retire,
+           config->issue, policy_name(config->policy));
+}
+
+//
+// stop_name
+//
+//  names the criterion that ended a run
+//
+const char* stop_name(int reason)
+{
+    switch (reason) {
+    case PROC_STOP_INSTRUCTIONS: return "instructions";
+    case PROC_STOP_CYCLES: return "cycles";
+    case PROC_STOP_CONVERGED: return "converged";
+    case PROC_STOP_BLOCKED: return "blocked";
+    default: return "drained";
+    }
+}
+
+//
+// expand_sweep
+//
+//  expands "key=v1,v2:key=..." into the cross product of configurations,
+//  false after printing the offending term
+//
+bool expand_sweep(const char* spec, const proc_config_t* base, std::vector<proc_config_t>* configs)
+{
+    char* text = strdup(spec);
+    char* save = NULL;
+
+    configs->assign(1, *base);
+    for (char* term = strtok_r(text, ":", &save); term != NULL; term = strtok_r(NULL, ":", &save)) {
+        std::vector<proc_config_t> expanded;
+        proc_config_t probe;
+        char* values = strchr(term, '=');
+
+        if (values == NULL || sweep_field(&probe, term[0]) == NULL || values != term + 1) {
+            fprintf(stderr, "Bad sweep term %s\n", term);
+            free(text);
+            return false;
+        }
+        for (char* value = strtok(values + 1, ","); value != NULL; value = strtok(NULL, ",")) {
+            for (size_t i = 0; i < configs->size(); i++) {
+                proc_config_t config = (*configs)[i];
+                *sweep_field(&config, term[0]) = atoi(value);
+                expanded.push_back(config);
+            }
+        }
+        *configs = expanded;
+    }
+    free(text);
+
+    for (size_t i = 0; i < configs->size(); i++) {
+        const char* error = check_config_proc(&(*configs)[i]);
+        if (error != NULL) {
+            fprintf(stderr, "Bad configuration %" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                            " in the sweep: %s\n", (*configs)[i].r, (*configs)[i].k0, (*configs)[i].k1,
+                    (*configs)[i].k2, (*configs)[i].f, (*configs)[i].m, error);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// run_sweep
+//
+//  expands "key=v1,v2:key=..." into the cross product of configurations and
+//  simulates all of them as lanes over one pass of the trace, which shares
+//  the trace decode between them but not their cycle loops
+//
+int run_sweep(const char* spec, const proc_config_t* base, double target, bool estimate, const proc_stop_t* stop)
+{
+    std::vector<proc_config_t> configs;
+
+    if (!expand_sweep(spec, base, &configs)) {
+        return 1;
+    }
+
+    if (target > 0) {
+        /* Drop configurations that cannot reach the target even with perfect scheduling */
+        std::vector<proc_config_t> kept;
+        dataflow_t limits;
+
+        dataflow_analyze(read_source, NULL, &limits);
+        if (!trace_seek(inTrace, 0)) {
+            fprintf(stderr, "Pruning needs a seekable trace\n");
+            return 1;
+        }
+        for (size_t i = 0; i < configs.size(); i++) {
+            if (dataflow_config_bound(&limits, &configs[i]) >= target) {
+                kept.push_back(configs[i]);
+            }
+        }
+        printf("Pruned %zu of %zu configurations below IPC %f\n\n", configs.size() - kept.size(), configs.size(), target);
+        configs = kept;
+    }
+
+    std::vector<proc_stats_t> stats(configs.size());
+    if (estimate) {
+        /* One estimator per configuration, all fed from the same pass */
+        std::vector<interval_t> est(configs.size());
+        proc_inst_t inst;
+
+        for (size_t i = 0; i < configs.size(); i++) {
+            interval_init(&est[i], &configs[i]);
+        }
+        while (read_instruction(&inst)) {
+            for (size_t i = 0; i < configs.size(); i++) {
+                interval_step(&est[i], &inst);
+            }
+        }
+        for (size_t i = 0; i < configs.size(); i++) {
+            interval_finish(&est[i], &stats[i]);
+        }
+    } else {
+        run_lanes_proc(configs.data(), configs.size(), read_source, NULL, stop, stats.data());
+    }
+
+    bool widths = widths_set(configs);
+    bool unified = unified_set(configs);
+    printf("R\tk0\tk1\tk2\tF\tM\t%sCYCLES\tIPC%s%s\n", widths ? WIDTH_COLUMNS : "",
+           unified ? "\tSCHED\tIPC/ENTRY" : "", stop != NULL ? "\tINSTS\tSTOP" : "");
+    for (size_t i = 0; i < configs.size(); i++) {
+        printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t",
+               configs[i].r, configs[i].k0, configs[i].k1, configs[i].k2, configs[i].f, configs[i].m);
+        if (widths) {
+            print_widths(&configs[i]);
+        }
+        printf("%lu\t%f", stats[i].cycle_count, stats[i].avg_inst_retired);
+        if (unified) {
+            uint64_t entries = scheduler_entries_proc(&configs[i]);
+            printf("\t%s\t%f", configs[i].scheduler == PROC_SCHED_UNIFIED ? "unified" : "split",
+                   entries > 0 ? stats[i].avg_inst_retired / entries : 0);
+        }
+        if (stop != NULL) {
+            printf("\t%lu\t%s", stats[i].retired_instruction, stop_name(stats[i].stop_reason));
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+//
+// search_dominated
+//
+//  true if a configuration is no larger in any resource than one that failed,
+//  since IPC does not drop as resources are added it must fail as well
+//
+bool search_dominated(const search_t* search, const candidate_t* candidate)
+{
+    for (size_t i = 0; i < search->candidates.size(); i++) {
+        proc_config_t failed = search->candidates[i].config;
+        proc_config_t config = candidate->config;
+        int status = search->candidates[i].status;
+        bool smaller = (status == SEARCH_FAIL || status == SEARCH_BOUND) && config.scheduler == failed.scheduler &&
+                       config.policy == failed.policy;
+
+        for (const char* key = SEARCH_KEYS; *key != 0 && smaller; key++) {
+            smaller = sweep_rank(&config, *key) <= sweep_rank(&failed, *key);
+        }
+        if (smaller) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// search_source
+//
+//  instruction source of a search simulation, ends the trace early once a
+//  configuration no more expensive than this one has passed
+//
+bool search_source(proc_inst_t* p_inst, void* context)
+{
+    search_cursor_t* cursor = (search_cursor_t*) context;
+
+    if (cursor->search->bestCost.load() <= cursor->cost) {
+        cursor->abandoned = true;
+        return false;
+    }
+    return trace_read(cursor->trace, p_inst);
+}
+
+//
+// search_evaluate
+//
+//  simulates one candidate on each trace in turn and returns its SEARCH_*
+//  status, which the caller publishes under the lock. A run stops at the last
+//  cycle count that still meets the target, so failing runs end early too.
+//
+int search_evaluate(search_t* search, candidate_t* candidate)
+{
+    candidate->ipc = 0;
+
+    for (size_t t = 0; t < search->traces.size(); t++) {
+        uint64_t maxCycles = (uint64_t)(search->lengths[t] / search->target);
+        search_cursor_t cursor = {trace_open(search->traces[t]), search, candidate->cost, false};
+        proc_stats_t stats;
+
+        if (cursor.trace == NULL) {
+            fprintf(stderr, "Failed to open %s for reading\n", search->traces[t]);
+            exit(1);
+        }
+
+        configure_proc(&candidate->config);
+        set_source_proc(search_source, &cursor);
+        set_cycle_limit_proc(maxCycles + 1);
+        memset(&stats, 0, sizeof(proc_stats_t));
+        run_proc(&stats);
+        complete_proc(&stats);
+        trace_close(cursor.trace);
+
+        if (cursor.abandoned) {
+            return SEARCH_ABANDONED;
+        }
+        if (t == 0 || stats.avg_inst_retired < candidate->ipc) {
+            candidate->ipc = stats.avg_inst_retired;
+        }
+        if (stats.cycle_count > maxCycles) {
+            return SEARCH_FAIL;
+        }
+    }
+    return SEARCH_PASS;
+}
+
+//
+// search_worker
+//
+//  takes the cheapest candidate that is still worth simulating until none is left
+//
+void search_worker(search_t* search)
+{
+    while (true) {
+        candidate_t* candidate = NULL;
+
+        search->lock.lock();
+        while (candidate == NULL && search->next < search->order.size()) {
+            candidate_t* next = &search->candidates[search->order[search->next++]];
+
+            if (next->status != SEARCH_PENDING) {
+                continue;
+            }
+            if (next->cost >= search->bestCost.load()) {
+                next->status = SEARCH_SKIPPED;
+            } else if (search_dominated(search, next)) {
+                next->status = SEARCH_DOMINATED;
+            } else {
+                next->status = SEARCH_RUNNING;
+                candidate = next;
+            }
+        }
+        search->lock.unlock();
+
+        if (candidate == NULL) {
+            return;
+        }
+
+        int status = search_evaluate(search, candidate);
+
+        search->lock.lock();
+        candidate->status = status;
+        if (status == SEARCH_PASS && candidate->cost < search->bestCost.load()) {
+            search->bestCost.store(candidate->cost);
+        }
+        search->lock.unlock();
+    }
+}
+
+//
+// run_search
 //
-//  returns true if an instruction was read successfully
+//  finds the cheapest configuration of the -S space that reaches the target IPC
+//  on every trace. Slab probes go first: each value of each key with every other
+//  key at its largest value, so one failing probe rules out every configuration
+//  at or below it. The rest are tried cheapest first on parallel workers; ones
+//  the dataflow bound or a failing larger configuration rules out are never
+//  simulated, and the first pass makes every dearer candidate moot.
 //
-bool read_instruction(proc_inst_t* p_inst)
+int run_search(const char* spec, const char* weights, const proc_config_t* base, double target,
+               const std::vector<const char*>& traces)
 {
-    int ret;
-    
-    if (p_inst == NULL)
-    {
-        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+    std::vector<proc_config_t> configs;
+    std::vector<dataflow_t> limits(traces.size());
+    proc_config_t weight;
+    search_t search;
+    char* text = strdup(weights);
+    char* save = NULL;
+
+    if (target <= 0) {
+        fprintf(stderr, "The search needs a target IPC (-T)\n");
+        free(text);
+        return 1;
+    }
+    /* Widths are free unless weighed */
+    memset(&weight, 0, sizeof(proc_config_t));
+    for (const char* key = "rjklfm"; *key != 0; key++) {
+        *sweep_field(&weight, *key) = 1;
+    }
+    for (char* term = strtok_r(text, ":", &save); term != NULL; term = strtok_r(NULL, ":", &save)) {
+        if (sweep_field(&weight, term[0]) == NULL || term[1] != '=') {
+            fprintf(stderr, "Bad weight term %s\n", term);
+            free(text);
+            return 1;
+        }
+        *sweep_field(&weight, term[0]) = atoi(term + 2);
+    }
+    free(text);
+    if (!expand_sweep(spec, base, &configs)) {
+        return 1;
+    }
+
+    /* One pass over each trace for its length and dataflow limits */
+    for (size_t t = 0; t < traces.size(); t++) {
+        threadTrace = trace_open(traces[t]);
+        if (threadTrace == NULL) {
+            fprintf(stderr, "Failed to open %s for reading\n", traces[t]);
+            return 1;
+        }
+        dataflow_analyze(read_source, NULL, &limits[t]);
+        trace_close(threadTrace);
+        threadTrace = NULL;
+        search.traces.push_back(traces[t]);
+        search.lengths.push_back(limits[t].instructions);
+    }
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        const proc_config_t* config = &configs[i];
+        candidate_t candidate = {*config, 0, SEARCH_PENDING, 0};
+
+        for (const char* key = SEARCH_KEYS; *key != 0; key++) {
+            proc_config_t copy = *config;
+            candidate.cost += (double)(*sweep_field(&weight, *key) * sweep_cost(&copy, *key));
+        }
+        for (size_t t = 0; t < traces.size(); t++) {
+            if (dataflow_config_bound(&limits[t], config) < target) {
+                candidate.status = SEARCH_BOUND;
+            }
+        }
+        search.candidates.push_back(candidate);
+    }
+    std::stable_sort(search.candidates.begin(), search.candidates.end(),
+                     [](const candidate_t& a, const candidate_t& b) { return a.cost < b.cost; });
+
+    /* Probes first, each key's values ascending, then everything else by cost */
+    const char keys[] = SEARCH_KEYS;
+    proc_config_t largest = configs[0];
+    std::vector<bool> queued(search.candidates.size(), false);
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        for (const char* key = keys; *key != 0; key++) {
+            if (sweep_rank(&configs[i], *key) > sweep_rank(&largest, *key)) {
+                *sweep_field(&largest, *key) = *sweep_field(&configs[i], *key);
+            }
+        }
+    }
+    for (const char* key = keys; *key != 0; key++) {
+        std::vector<size_t> probes;
+
+        for (size_t i = 0; i < search.candidates.size(); i++) {
+            proc_config_t probe = search.candidates[i].config;
+            *sweep_field(&probe, *key) = *sweep_field(&largest, *key);
+            if (!queued[i] && memcmp(&probe, &largest, sizeof(proc_config_t)) == 0 &&
+                sweep_rank(&search.candidates[i].config, *key) < sweep_rank(&largest, *key)) {
+                probes.push_back(i);
+            }
+        }
+        std::sort(probes.begin(), probes.end(), [&](size_t a, size_t b) {
+            return sweep_rank(&search.candidates[a].config, *key) < sweep_rank(&search.candidates[b].config, *key);
+        });
+        for (size_t i = 0; i < probes.size(); i++) {
+            search.order.push_back(probes[i]);
+            queued[probes[i]] = true;
+        }
+    }
+    for (size_t i = 0; i < search.candidates.size(); i++) {
+        if (!queued[i]) {
+            search.order.push_back(i);
+        }
+    }
+
+    search.target = target;
+    search.next = 0;
+    search.bestCost.store(1e300);
+
+    /* Simulate on every hardware thread */
+    unsigned threads = std::thread::hardware_concurrency();
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < (threads > 0 ? threads : 1); i++) {
+        workers.push_back(std::thread(search_worker, &search));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    const char* names[] = {"pending", "running", "pass", "fail", "bound", "dominated", "abandoned", "skipped"};
+    uint64_t counts[SEARCH_SKIPPED + 1] = {0};
+    const candidate_t* best = NULL;
+
+    bool widths = widths_set(configs);
+    printf("R\tk0\tk1\tk2\tF\tM\t%sCOST\tIPC\tRESULT\n", widths ? WIDTH_COLUMNS : "");
+    for (size_t i = 0; i < search.candidates.size(); i++) {
+        const candidate_t* candidate = &search.candidates[i];
+
+        counts[candidate->status]++;
+        if (candidate->status == SEARCH_PASS && best == NULL) {
+            best = candidate;
+        }
+        if (candidate->status != SEARCH_PASS && candidate->status != SEARCH_FAIL) {
+            continue;
+        }
+        printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t",
+               candidate->config.r, candidate->config.k0, candidate->config.k1, candidate->config.k2,
+               candidate->config.f, candidate->config.m);
+        if (widths) {
+            print_widths(&candidate->config);
+        }
+        printf("%g\t%s%f\t%s\n", candidate->cost,
+               candidate->status == SEARCH_FAIL ? "<" : "", candidate->status == SEARCH_FAIL ? target : candidate->ipc,
+               names[candidate->status]);
+    }
+    printf("\n");
+
+    printf("Configurations: %zu\n", search.candidates.size());
+    for (int s = SEARCH_PASS; s <= SEARCH_SKIPPED; s++) {
+        printf("%s: %" PRIu64 "\n", names[s], counts[s]);
+    }
+    printf("\n");
+
+    if (best == NULL) {
+        printf("No configuration reaches IPC %f\n", target);
+        return 0;
+    }
+    printf("Cheapest configuration reaching IPC %f: R %" PRIu64 " k0 %" PRIu64 " k1 %" PRIu64 " k2 %" PRIu64
+           " F %" PRIu64 " M %" PRIu64, target, best->config.r, best->config.k0,
+           best->config.k1, best->config.k2, best->config.f, best->config.m);
+    if (widths) {
+        printf(" D %" PRIu64 " B %" PRIu64 " W %" PRIu64 " Q %" PRIu64 " policy %s", best->config.dispatch,
+               best->config.cdb, best->config.retire, best->config.issue, policy_name(best->config.policy));
+    }
+    printf(" (cost %g, IPC %f)\n", best->cost, best->ipc);
+
+    return 0;
+}
+
+//
+// read_fu_table
+//
+//  loads FU classes into a configuration, one class per line as
+//  "count latency interval op,op,..." with # starting a comment
+//
+bool read_fu_table(const char* path, proc_config_t* config)
+{
+    char line[256];
+    FILE* in = fopen(path, "r");
+
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", path);
         return false;
     }
-    
-    ret = fscanf(stdin, "%x %d %d %d %d\n", &p_inst->instruction_address,
-                 &p_inst->op_code, &p_inst->dest_reg, &p_inst->src_reg[0], &p_inst->src_reg[1]); 
-    if (ret != 5) {
+
+    config->classes = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        proc_fu_t fu;
+        char ops[128];
+        char* save = NULL;
+
+        *strchrnul(line, '#') = '\0';
+        memset(&fu, 0, sizeof(proc_fu_t));
+        if (sscanf(line, "%" SCNu64 " %" SCNu32 " %" SCNu32 " %127s", &fu.count, &fu.latency, &fu.interval, ops) != 4) {
+            if (strspn(line, " \t\r\n") != strlen(line)) {
+                fprintf(stderr, "Bad FU class %s", line);
+                fclose(in);
+                return false;
+            }
+            continue;
+        }
+        if (config->classes == PROC_MAX_CLASSES || fu.latency == 0 || fu.interval == 0) {
+            fprintf(stderr, "Bad FU class %s", line);
+            fclose(in);
+            return false;
+        }
+        for (char* op = strtok_r(ops, ",", &save); op != NULL; op = strtok_r(NULL, ",", &save)) {
+            int code = atoi(op);
+            if (code < -1 || code > PROC_MAX_OPCODE) {
+                fprintf(stderr, "Opcode %s out of range\n", op);
+                fclose(in);
+                return false;
+            }
+            fu.opcodes |= PROC_OPCODE_BIT(code);
+        }
+        config->fu[config->classes++] = fu;
+    }
+    fclose(in);
+
+    if (config->classes == 0) {
+        fprintf(stderr, "No FU classes in %s\n", path);
         return false;
     }
-    
     return true;
 }
 
-void print_statistics(proc_stats_t* p_stats);
+//
+// read_memory_spec
+//
+//  parses the data cache of -L, "l1=size:ways:latency,l2=...,line=bytes,mem=latency"
+//  with sizes in bytes or with a k or m suffix
+//
+//  returns false after printing the offending term
+//
+bool read_memory_spec(const char* spec, proc_config_t* config)
+{
+    char copy[256];
+    char* save = NULL;
+
+    snprintf(copy, sizeof(copy), "%s", spec);
+    for (char* term = strtok_r(copy, ",", &save); term != NULL; term = strtok_r(NULL, ",", &save)) {
+        proc_level_t* level = NULL;
+        char* value = strchr(term, '=');
+        char* end;
+
+        if (value == NULL) {
+            fprintf(stderr, "Bad data cache term %s\n", term);
+            return false;
+        }
+        *value++ = '\0';
+        if (strcmp(term, "line") == 0) {
+            config->line = strtoull(value, &end, 10);
+        } else if (strcmp(term, "mem") == 0) {
+            config->memory_latency = strtoull(value, &end, 10);
+        } else if (strcmp(term, "l1") == 0 || strcmp(term, "l2") == 0) {
+            level = (term[1] == '1') ? &config->l1 : &config->l2;
+            level->size = strtoull(value, &end, 10);
+            if (*end == 'k' || *end == 'K') {
+                level->size <<= 10;
+                end++;
+            } else if (*end == 'm' || *end == 'M') {
+                level->size <<= 20;
+                end++;
+            }
+            if (sscanf(end, ":%" SCNu32 ":%" SCNu32, &level->assoc, &level->latency) != 2) {
+                fprintf(stderr, "Bad data cache level %s=%s\n", term, value);
+                return false;
+            }
+            continue;
+        } else {
+            fprintf(stderr, "Unknown data cache term %s\n", term);
+            return false;
+        }
+        if (*end != '\0') {
+            fprintf(stderr, "Bad data cache term %s=%s\n", term, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// print_dataflow
+//
+//  prints the measurements of a dataflow pre-pass
+//
+void print_dataflow(const dataflow_t* limits)
+{
+    const char* names[DATAFLOW_CLASSES] = {"-1", "0", "1", "2", "other"};
+
+    printf("Dataflow limits\n");
+    printf("Instructions: %" PRIu64 "\n", limits->instructions);
+    printf("Critical path (cycles): %" PRIu64 "\n", limits->critical_path);
+    printf("Infinite-resource IPC bound: %f\n", limits->ipc_bound);
+    printf("\n");
+
+    printf("OPCODE\tCOUNT\tFRACTION\n");
+    for (int c = 0; c < DATAFLOW_CLASSES; c++) {
+        printf("%s\t%" PRIu64 "\t%f\n", names[c], limits->op_mix[c],
+               limits->instructions > 0 ? ((double)limits->op_mix[c])/limits->instructions : 0.0);
+    }
+    printf("\n");
+
+    printf("DISTANCE\tCOUNT\n");
+    printf("none\t%" PRIu64 "\n", limits->no_producer);
+    for (int b = 0; b < DATAFLOW_BUCKETS; b++) {
+        if (limits->distance[b] == 0) {
+            continue;
+        }
+        uint64_t low = (b == 0) ? 1 : (1ULL << (b-1)) + 1;
+        uint64_t high = 1ULL << b;
+        if (b == DATAFLOW_BUCKETS-1) {
+            printf("%" PRIu64 "+\t%" PRIu64 "\n", low, limits->distance[b]);
+        } else if (low == high) {
+            printf("%" PRIu64 "\t%" PRIu64 "\n", low, limits->distance[b]);
+        } else {
+            printf("%" PRIu64 "-%" PRIu64 "\t%" PRIu64 "\n", low, high, limits->distance[b]);
+        }
+    }
+}
+
+//
+// print_host_row
+//
+//  prints one row of host counts per simulated instruction, n/a for the
+//  events the host does not count
+//
+void print_host_row(const char* name, const perf_t* perf, const perf_counts_t* counts, uint64_t retired)
+{
+    fprintf(stderr, "%-10s", name);
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (perf_available(perf, e)) {
+            fprintf(stderr, "\t%.3f", ((double)counts->value[e])/retired);
+        } else {
+            fprintf(stderr, "\tn/a");
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+//
+// print_host_counters
+//
+//  prints the host counts of a run per simulated instruction, and with a
+//  stage breakdown where the rest of the run loop went
+//
+void print_host_counters(const perf_t* perf, const perf_counts_t* run, uint64_t retired, bool stages)
+{
+    static const char* stageNames[PROC_STAGES] = {"fetch", "dispatch", "schedule", "execute", "state"};
+    perf_counts_t other = *run;
+
+    retired = (retired > 0) ? retired : 1;
+    fprintf(stderr, "Host counts per simulated instruction:\n");
+    fprintf(stderr, "%-10s", "");
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        fprintf(stderr, "\t%s", perf_event_name(e));
+    }
+    fprintf(stderr, "\n");
+    if (stages) {
+        for (int s = 0; s < PROC_STAGES; s++) {
+            perf_counts_t counts;
+            stage_perf_proc(s, &counts);
+            print_host_row(stageNames[s], perf, &counts, retired);
+            for (int e = 0; e < PERF_EVENTS; e++) {
+                other.value[e] -= (counts.value[e] < other.value[e]) ? counts.value[e] : other.value[e];
+            }
+        }
+        print_host_row("other", perf, &other, retired);
+    }
+    print_host_row("run", perf, run, retired);
+    if (stages) {
+        fprintf(stderr, "(other is the run loop and the counter reads)\n");
+    }
+}
 
 int main(int argc, char* argv[]) {
     int opt;
-    uint64_t f = DEFAULT_F;
-    uint64_t m = DEFAULT_M;
-    uint64_t k0 = DEFAULT_K0;
-    uint64_t k1 = DEFAULT_K1;
-    uint64_t k2 = DEFAULT_K2;
-    uint64_t r = DEFAULT_R;
+    proc_config_t config;
+    uint64_t shards = DEFAULT_SHARDS;
+    uint64_t warmup = DEFAULT_WARMUP;
+    uint64_t checkpointInterval = 0;
+    const char* checkpointPath = "procsim.ckpt";
+    const char* restorePath = NULL;
+    const char* binaryPath = NULL;
+    const char* sweepSpec = NULL;
+    const char* cacheDir = NULL;
+    const char* searchWeights = NULL;
+    bool analyze = false;
+    bool stopping = false;
+    proc_stop_t stop;
+    bool estimate = false;
+    double target = 0;
+    uint64_t indexStride = 0;
+    bool multicore = false;
+    uint64_t epoch = DEFAULT_EPOCH;
+    bool smt = false;
+    int validateThreads = 0;
+    int host = HOST_OFF;
+    const char* kanataPath = NULL;
+    kanata_window_t window;
+
+    default_config_proc(&config);
+    memset(&stop, 0, sizeof(proc_stop_t));
+    kanata_all(&window);
 
     /* Read arguments */ 
-    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:m:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:m:D:B:W:Q:P:p:Z:L:uMe:t:s:w:c:C:R:I:b:S:G:U:x:V:H:K:Y:n:N:v:aT:Eh"))) {
         switch(opt) {
         case 'r':
-            r = atoi(optarg);
+            config.r = atoi(optarg);
             break;
         case 'j':
-            k0 = atoi(optarg);
+            config.k0 = atoi(optarg);
             break;
         case 'k':
-            k1 = atoi(optarg);
+            config.k1 = atoi(optarg);
             break;
         case 'l':
-            k2 = atoi(optarg);
+            config.k2 = atoi(optarg);
             break;
         case 'm':
-            m = atoi(optarg);
+            config.m = atoi(optarg);
             break;
         case 'f':
-            f = atoi(optarg);
+            config.f = atoi(optarg);
+            break;
+        case 'D':
+            config.dispatch = atoi(optarg);
+            break;
+        case 'B':
+            config.cdb = atoi(optarg);
+            break;
+        case 'W':
+            config.retire = atoi(optarg);
+            break;
+        case 'Q':
+            config.issue = atoi(optarg);
+            break;
+        case 'P':
+            for (config.policy = 0; config.policy < PROC_POLICIES; config.policy++) {
+                if (strcmp(optarg, policy_name(config.policy)) == 0) {
+                    break;
+                }
+            }
+            if (config.policy == PROC_POLICIES) {
+                fprintf(stderr, "Unknown issue policy %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            for (config.predictor = 0; config.predictor < PROC_PREDICTORS; config.predictor++) {
+                size_t length = strlen(predictor_name(config.predictor));
+                if (strncmp(optarg, predictor_name(config.predictor), length) == 0 &&
+                    (optarg[length] == '\0' || optarg[length] == ':')) {
+                    break;
+                }
+            }
+            if (config.predictor == PROC_PREDICTORS) {
+                fprintf(stderr, "Unknown branch predictor %s\n", optarg);
+                return 1;
+            }
+            if (strchr(optarg, ':') != NULL) {
+                config.predictor_bits = atoi(strchr(optarg, ':') + 1);
+            }
+            break;
+        case 'Z':
+            config.mispredict_penalty = atoi(optarg);
+            break;
+        case 'L':
+            if (!read_memory_spec(optarg, &config)) {
+                return 1;
+            }
+            break;
+        case 'u':
+            config.scheduler = PROC_SCHED_UNIFIED;
+            break;
+        case 'M':
+            multicore = true;
+            break;
+        case 'e':
+            epoch = atoll(optarg);
+            break;
+        case 't':
+            for (config.fetch = 0; config.fetch < PROC_FETCH_POLICIES; config.fetch++) {
+                if (strcmp(optarg, fetch_name(config.fetch)) == 0) {
+                    break;
+                }
+            }
+            if (config.fetch == PROC_FETCH_POLICIES) {
+                fprintf(stderr, "Unknown fetch policy %s\n", optarg);
+                return 1;
+            }
+            smt = true;
+            break;
+        case 's':
+            shards = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'c':
+            checkpointInterval = atoi(optarg);
+            break;
+        case 'C':
+            checkpointPath = optarg;
+            break;
+        case 'R':
+            restorePath = optarg;
             break;
         case 'i':
-            inFile = fopen(optarg, "r");
-            if (inFile == NULL)
-            {
-                fprintf(stderr, "Failed to open %s for reading\n", optarg);
-                print_help_and_exit();
+            inPath = optarg;
+            break;
+        case 'S':
+            sweepSpec = optarg;
+            break;
+        case 'n':
+            stop.max_instructions = atoll(optarg);
+            stopping = true;
+            break;
+        case 'N':
+            stop.max_cycles = atoll(optarg);
+            stopping = true;
+            break;
+        case 'v':
+            if (sscanf(optarg, "%" SCNu64 ":%" SCNu64 ":%lf", &stop.window, &stop.windows, &stop.tolerance) != 3 ||
+                stop.window == 0 || stop.windows == 0) {
+                fprintf(stderr, "Bad convergence rule %s\n", optarg);
+                return 1;
+            }
+            stopping = true;
+            break;
+        case 'G':
+            searchWeights = optarg;
+            break;
+        case 'U':
+            if (!read_fu_table(optarg, &config)) {
+                return 1;
             }
             break;
+        case 'a':
+            analyze = true;
+            break;
+        case 'E':
+            estimate = true;
+            break;
+        case 'T':
+            target = atof(optarg);
+            break;
+        case 'V':
+            validateThreads = atoi(optarg);
+            if (validateThreads < 1 || validateThreads > 2) {
+                fprintf(stderr, "Validation runs on 1 or 2 threads\n");
+                return 1;
+            }
+            break;
+        case 'H':
+            if (strcmp(optarg, "run") == 0) {
+                host = HOST_RUN;
+            } else if (strcmp(optarg, "stages") == 0) {
+                host = HOST_STAGES;
+            } else {
+                fprintf(stderr, "Unknown host counter mode %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'K':
+            kanataPath = optarg;
+            break;
+        case 'Y':
+            if (!read_window(optarg, &window)) {
+                return 1;
+            }
+            break;
+        case 'x':
+            cacheDir = optarg;
+            break;
+        case 'I':
+            indexStride = atoi(optarg);
+            break;
+        case 'b':
+            binaryPath = optarg;
+            break;
         case 'h':
             /* Fall through */
         default:
@@ -92,29 +1584,261 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    printf("Processor Settings\n");
-    printf("R: %" PRIu64 "\n", r);
-    printf("k0: %" PRIu64 "\n", k0);
-    printf("k1: %" PRIu64 "\n", k1);
-    printf("k2: %" PRIu64 "\n", k2);
-    printf("F: %"  PRIu64 "\n", f);
-    printf("M: %" PRIu64 "\n", m);
-    printf("\n");
+    const char* error = check_config_proc(&config);
+    if (error != NULL) {
+        fprintf(stderr, "Bad configuration: %s\n", error);
+        return 1;
+    }
+    if (host != HOST_OFF && (sweepSpec != NULL || multicore || smt || restorePath != NULL || cacheDir != NULL ||
+                             shards > 1 || estimate || validateThreads > 0)) {
+        fprintf(stderr, "Host counters measure one run on this thread, not with -S -M -t -R -x -s -E or -V\n");
+        return 1;
+    }
+    if (kanataPath != NULL && (sweepSpec != NULL || multicore || smt || restorePath != NULL || cacheDir != NULL ||
+                               shards > 1 || estimate)) {
+        fprintf(stderr, "Kanata export follows one run, not with -S -M -t -R -x -s or -E\n");
+        return 1;
+    }
+
+    /* Trace utilities */
+    if (indexStride > 0) {
+        if (inPath == NULL || !trace_build_index(inPath, indexStride)) {
+            fprintf(stderr, "Failed to index %s\n", inPath == NULL ? "stdin" : inPath);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (searchWeights != NULL) {
+        std::vector<const char*> traces;
+
+        if (sweepSpec == NULL || inPath == NULL) {
+            fprintf(stderr, "The search needs a space (-S) and a -i trace\n");
+            return 1;
+        }
+        traces.push_back(inPath);
+        for (int i = optind; i < argc; i++) {
+            traces.push_back(argv[i]);
+        }
+        return run_search(sweepSpec, searchWeights, &config, target, traces);
+    }
+
+    if (multicore) {
+        std::vector<const char*> traces;
+        proc_stats_t stats;
+
+        if (inPath == NULL) {
+            fprintf(stderr, "Multi-core runs need a -i trace\n");
+            return 1;
+        }
+        traces.push_back(inPath);
+        for (int i = optind; i < argc; i++) {
+            traces.push_back(argv[i]);
+        }
+        print_settings(&config);
+        memset(&stats, 0, sizeof(proc_stats_t));
+        run_multicore(&stats, traces, epoch, &config, &stop);
+        print_statistics(&stats);
+        return 0;
+    }
+
+    if (smt) {
+        std::vector<const char*> traces;
+        proc_stats_t stats;
 
-    /* Setup the processor */
-    setup_proc(r, k0, k1, k2, f, m);
+        if (inPath == NULL) {
+            fprintf(stderr, "SMT runs need a -i trace\n");
+            return 1;
+        }
+        if (sweepSpec != NULL || estimate || checkpointInterval > 0 || restorePath != NULL || cacheDir != NULL ||
+            shards > 1) {
+            fprintf(stderr, "SMT runs simulate one core, not with -S, -E, -c, -R, -x or -s\n");
+            return 1;
+        }
+        traces.push_back(inPath);
+        for (int i = optind; i < argc; i++) {
+            traces.push_back(argv[i]);
+        }
+        if (traces.size() > PROC_MAX_THREADS) {
+            fprintf(stderr, "SMT runs take at most %d traces\n", PROC_MAX_THREADS);
+            return 1;
+        }
+        config.threads = traces.size();
+        print_settings(&config);
+        memset(&stats, 0, sizeof(proc_stats_t));
+        run_smt(&stats, traces, &config, &stop);
+        print_statistics(&stats);
+        return 0;
+    }
+
+    inTrace = trace_open(inPath);
+    if (inTrace == NULL)
+    {
+        fprintf(stderr, "Failed to open %s for reading\n", inPath == NULL ? "stdin" : inPath);
+        print_help_and_exit();
+    }
+    threadTrace = inTrace;
+
+    if (binaryPath != NULL) {
+        FILE* out = fopen(binaryPath, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", binaryPath);
+            return 1;
+        }
+        trace_write_binary(inTrace, out);
+        fclose(out);
+        return 0;
+    }
+
+    if (analyze) {
+        dataflow_t limits;
+        dataflow_analyze(read_source, NULL, &limits);
+        print_dataflow(&limits);
+        return 0;
+    }
+
+    if (sweepSpec != NULL) {
+        return run_sweep(sweepSpec, &config, target, estimate, stopping ? &stop : NULL);
+    }
+
+    if (validateThreads > 0 && (stopping || checkpointInterval > 0 || restorePath != NULL || cacheDir != NULL ||
+                                shards > 1 || estimate || !validate_config(&config))) {
+        fprintf(stderr, "Validation needs a k0/k1/k2 configuration of at least one unit each, without\n"
+                        "-D -B -W -Q -P -u -p -L -U, and runs the whole trace, not with -n -N -v -c -R -x -s or -E\n");
+        return 1;
+    }
 
     /* Setup statistics */
     proc_stats_t stats;
     memset(&stats, 0, sizeof(proc_stats_t));
 
-    /* Run the processor */
-    run_proc(&stats);
+    if (restorePath != NULL) {
+        /* Resume a checkpointed processor, its table continues where it left off */
+        uint64_t offset;
+
+        if (!restore_proc(restorePath, &offset)) {
+            fprintf(stderr, "Failed to restore checkpoint %s\n", restorePath);
+            return 1;
+        }
+        if (!trace_seek(inTrace, offset)) {
+            fprintf(stderr, "Trace is shorter than checkpoint offset %" PRIu64 "\n", offset);
+            return 1;
+        }
+        set_source_proc(read_source, NULL);
+        set_retire_proc(print_retired, NULL);
+        set_checkpoint_proc(checkpointPath, checkpointInterval);
+        set_stop_proc(&stop);
+
+        run_proc(&stats);
+        complete_proc(&stats);
+        printf("\n");
+        print_statistics(&stats);
+        return 0;
+    }
+
+    print_settings(&config);
+
+    if (estimate) {
+        /* Analytical estimate in one pass, no cycle loop */
+        interval_t est;
+        proc_inst_t inst;
+
+        interval_init(&est, &config);
+        while (read_instruction(&inst)) {
+            interval_step(&est, &inst);
+        }
+        interval_finish(&est, &stats);
+    } else if (stopping && (cacheDir != NULL || shards > 1)) {
+        fprintf(stderr, "Stop criteria apply to single runs and sweeps, not to -x or -s\n");
+        return 1;
+    } else if (cacheDir != NULL) {
+        /* Look the result up before simulating, store it after a miss */
+        cache_key_t key;
+
+        if (inPath == NULL || !cache_key(inPath, &config, &key)) {
+            fprintf(stderr, "The result cache needs a readable -i trace\n");
+            return 1;
+        }
+        if (!cache_load(cacheDir, &key, &stats, NULL, NULL)) {
+            configure_proc(&config);
+            set_source_proc(read_source, NULL);
+            run_proc(&stats);
+            complete_proc(&stats);
+            if (!cache_store(cacheDir, &key, &stats, NULL, 0)) {
+                fprintf(stderr, "Failed to store result %s in %s\n", key.name, cacheDir);
+            }
+        }
+    } else if (shards > 1) {
+        /* Run the processor as parallel shards */
+        run_sharded(&stats, shards, warmup, &config);
+    } else {
+        perf_t perf;
+        perf_counts_t before;
+        perf_counts_t after;
+        kanata_t kanata;
+
+        /* Setup the processor */
+        configure_proc(&config);
+        set_source_proc(read_source, NULL);
+        set_retire_proc(print_retired, NULL);
+        if (kanataPath != NULL) {
+            /* Only an export pays for it, the table printer is wrapped */
+            if (!kanata_open(&kanata, kanataPath, &config, &window)) {
+                fprintf(stderr, "Failed to open %s for writing\n", kanataPath);
+                return 1;
+            }
+            set_retire_proc(export_retired, &kanata);
+        }
+        set_checkpoint_proc(checkpointPath, checkpointInterval);
+        set_stop_proc(&stop);
+
+        /* Count host events from here, events the host lacks are reported as n/a */
+        if (host != HOST_OFF && !perf_open(&perf)) {
+            fprintf(stderr, "Host counters unavailable: %s\n", strerror(perf.error));
+            host = HOST_OFF;
+        }
+        if (host == HOST_STAGES) {
+            set_stage_perf_proc(&perf);
+        }
+        if (host != HOST_OFF) {
+            perf_read(&perf, &before);
+        }
+
+        /* Run the processor */
+        printf("INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\tRETIRE\n");
+        if (validateThreads > 0 && !validate_proc(&config, read_source, NULL, validateThreads > 1, stderr)) {
+            fflush(stdout);
+            fprintf(stderr, "Validation failed\n");
+            return 1;
+        }
+        run_proc(&stats);
 
-    /* Finalize stats */
-    complete_proc(&stats);
+        if (host != HOST_OFF) {
+            perf_read(&perf, &after);
+            for (int e = 0; e < PERF_EVENTS; e++) {
+                after.value[e] -= before.value[e];
+            }
+        }
+
+        if (kanataPath != NULL) {
+            fprintf(stderr, "Exported %" PRIu64 " instructions to %s\n", kanata_close(&kanata), kanataPath);
+        }
+
+        /* Finalize stats */
+        complete_proc(&stats);
+        printf("\n");
+
+        if (host != HOST_OFF) {
+            fflush(stdout);
+            print_host_counters(&perf, &after, stats.retired_instruction, host == HOST_STAGES);
+            perf_close(&perf);
+        }
+    }
 
     print_statistics(&stats);
+    if (validateThreads > 0) {
+        fprintf(stderr, "Validated %lu cycles against the original simulator\n", stats.cycle_count);
+    }
 
     return 0;
 }
@@ -124,5 +1848,68 @@ void print_statistics(proc_stats_t* p_stats) {
 	printf("Avg inst retired per cycle: %f\n", p_stats->avg_inst_retired);
 	printf("Total instructions: %lu\n", p_stats->retired_instruction);
 	printf("Total run time (cycles): %lu\n", p_stats->cycle_count);
+	if (p_stats->branches > 0) {
+		printf("Branches: %lu, mispredicted: %lu (%f%%)\n", p_stats->branches, p_stats->mispredictions,
+		       100.0*p_stats->mispredictions/p_stats->branches);
+	}
+	if (p_stats->accesses > 0) {
+		printf("Memory accesses: %lu, L1 miss rate: %f, L2 miss rate: %f\n", p_stats->accesses,
+		       ((double)p_stats->l1_misses)/p_stats->accesses,
+		       p_stats->l1_misses > 0 ? ((double)p_stats->l2_misses)/p_stats->l1_misses : 0);
+	}
+	if (p_stats->stop_reason != PROC_STOP_NONE) {
+		printf("Stopped early: %s\n", stop_name(p_stats->stop_reason));
+	}
 }
 
+void print_settings(const proc_config_t* config) {
+    printf("Processor Settings\n");
+    printf("R: %" PRIu64 "\n", config->r);
+    if (config->classes == 0) {
+        printf("k0: %" PRIu64 "\n", config->k0);
+        printf("k1: %" PRIu64 "\n", config->k1);
+        printf("k2: %" PRIu64 "\n", config->k2);
+    }
+    printf("F: %"  PRIu64 "\n", config->f);
+    printf("M: %" PRIu64 "\n", config->m);
+    if (config->dispatch > 0) {
+        printf("D: %" PRIu64 "\n", config->dispatch);
+    }
+    if (config->cdb > 0) {
+        printf("B: %" PRIu64 "\n", config->cdb);
+    }
+    if (config->retire > 0) {
+        printf("W: %" PRIu64 "\n", config->retire);
+    }
+    if (config->issue > 0) {
+        printf("Q: %" PRIu64 "\n", config->issue);
+    }
+    if (config->policy != PROC_POLICY_OLDEST) {
+        printf("Issue policy: %s\n", policy_name(config->policy));
+    }
+    if (config->predictor != PROC_PREDICT_NONE) {
+        printf("Branch predictor: %s, 2^%" PRIu64 " entries, penalty %" PRIu64 "\n", predictor_name(config->predictor),
+               config->predictor_bits > 0 ? config->predictor_bits : DEFAULT_PREDICTOR_BITS, config->mispredict_penalty);
+    }
+    if (config->l1.size > 0) {
+        printf("L1: %" PRIu64 " bytes, %" PRIu32 "-way, latency %" PRIu32 "\n", config->l1.size, config->l1.assoc,
+               config->l1.latency);
+        if (config->l2.size > 0) {
+            printf("L2: %" PRIu64 " bytes, %" PRIu32 "-way, latency %" PRIu32 "\n", config->l2.size, config->l2.assoc,
+                   config->l2.latency);
+        }
+        printf("Line: %" PRIu64 " bytes, memory latency %" PRIu64 "\n", config->line > 0 ? config->line : DEFAULT_LINE,
+               config->memory_latency);
+    }
+    if (config->threads > 1) {
+        printf("Threads: %" PRIu64 ", fetch %s\n", config->threads, fetch_name(config->fetch));
+    }
+    if (config->scheduler == PROC_SCHED_UNIFIED) {
+        printf("Scheduler: unified, %" PRIu64 " entries\n", scheduler_entries_proc(config));
+    }
+    for (uint64_t c = 0; c < config->classes; c++) {
+        printf("FU%" PRIu64 ": %" PRIu64 " x latency %" PRIu32 " interval %" PRIu32 " opcodes 0x%" PRIx32 "\n",
+               c, config->fu[c].count, config->fu[c].latency, config->fu[c].interval, config->fu[c].opcodes);
+    }
+    printf("\n");
+}
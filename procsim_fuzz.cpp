@@ -0,0 +1,651 @@
+#include <cstdio>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "procsim.hpp"
+#include "procsim_synth.hpp"
+#include "procsim_reference.hpp"
+
+//Exit status of a case's child process, anything else is a failure
+#define CASE_DRAINED   0    //every instruction retired
+#define CASE_FAILED    1    //an invariant was broken, the child printed which
+#define CASE_REJECTED  3    //check_config_proc refused the configuration
+#define CASE_BLOCKED   4    //stopped at an instruction no unit executes, as the trace implies
+#define CASE_VALIDATED 5    //drained and matched the reference cycle by cycle
+
+//Most instructions of a case, split between its hardware threads
+#define FUZZ_MAX_INSTRUCTIONS 2000
+
+//One generated case: a configuration and a trace for each hardware thread
+typedef struct _fuzz_case_t
+{
+    uint64_t seed;
+    proc_config_t config;
+    uint64_t threads;               //traces, 1 unless the configuration runs several threads
+    std::vector<proc_inst_t> trace[PROC_MAX_THREADS];
+    bool validate;                  //also compare against the reference
+} fuzz_case_t;
+
+//Trace handed to the engine
+typedef struct _array_source_t
+{
+    const std::vector<proc_inst_t>* trace;
+    size_t next;
+} array_source_t;
+
+//What the retire sink saw, per hardware thread
+typedef struct _retire_check_t
+{
+    const fuzz_case_t* fuzz;
+    int64_t retired[PROC_MAX_THREADS];
+    int64_t lastRetire[PROC_MAX_THREADS];
+    char failure[256];
+} retire_check_t;
+
+void print_help_and_exit(void) {
+    printf("procsim_fuzz [OPTIONS]\n");
+    printf("  -n N\t\tCases to run (default 1000)\n");
+    printf("  -s seed\tSeed of the first case, case i uses seed+i (default 1)\n");
+    printf("  -t S\t\tSeconds a case may take before it counts as a hang, 0 for no limit (default 60)\n");
+    printf("  -m MB\t\tAddress space of a case in megabytes (default 1024)\n");
+    printf("  -c seed\tRun one case in this process and write its traces to fuzz-<seed>[-<thread>].trace\n");
+    printf("  -h\t\tThis helpful output\n");
+    exit(0);
+}
+
+//
+// next_random
+//
+//  advances an xorshift64* generator
+//
+uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+//
+// below
+//
+//  random value in [0, n)
+//
+uint64_t below(uint64_t* state, uint64_t n)
+{
+    return next_random(state) % n;
+}
+
+//
+// one_of
+//
+//  random entry of a list, the edge cases the production sweeps hit
+//
+uint64_t one_of(uint64_t* state, const uint64_t* values, size_t count)
+{
+    return values[below(state, count)];
+}
+
+//
+// unit_count
+//
+//  units of a class, now and then none
+//
+uint64_t unit_count(uint64_t* state, const uint64_t* values, size_t count)
+{
+    return (below(state, 16) == 0) ? 0 : one_of(state, values, count);
+}
+
+//
+// random_config
+//
+//  draws a configuration: usually a k0/k1/k2 one the reference can check,
+//  otherwise any mix of the later pipeline options, now and then on several
+//  hardware threads, and now and then one check_config_proc must refuse
+//
+void random_config(uint64_t* state, proc_config_t* config)
+{
+    static const uint64_t robs[] = {1, 1, 2, 3, 4, 8, 16, 32, 64, 256, 1024};
+    static const uint64_t units[] = {1, 1, 1, 2, 3, 4, 8, 64, 1000};
+    static const uint64_t widths[] = {1, 1, 2, 3, 4, 8, 16, 64, 512};
+    static const uint64_t multipliers[] = {1, 1, 2, 2, 3, 8};
+    static const uint64_t limits[] = {0, 0, 0, 1, 2, 3, 8};
+    static const uint64_t bad[] = {0, 0, UINT64_MAX, 1u << 30, 70000};
+
+    default_config_proc(config);
+    config->r = one_of(state, robs, sizeof(robs)/sizeof(robs[0]));
+    config->k0 = unit_count(state, units, sizeof(units)/sizeof(units[0]));
+    config->k1 = unit_count(state, units, sizeof(units)/sizeof(units[0]));
+    config->k2 = unit_count(state, units, sizeof(units)/sizeof(units[0]));
+    config->f = one_of(state, widths, sizeof(widths)/sizeof(widths[0]));
+    config->m = one_of(state, multipliers, sizeof(multipliers)/sizeof(multipliers[0]));
+
+    if (below(state, 10) < 4) {
+        config->dispatch = one_of(state, limits, sizeof(limits)/sizeof(limits[0]));
+        config->cdb = one_of(state, limits, sizeof(limits)/sizeof(limits[0]));
+        config->retire = one_of(state, limits, sizeof(limits)/sizeof(limits[0]));
+        config->issue = one_of(state, limits, sizeof(limits)/sizeof(limits[0]));
+        config->policy = below(state, PROC_POLICIES);
+        config->scheduler = below(state, 2) ? PROC_SCHED_UNIFIED : PROC_SCHED_SPLIT;
+        config->predictor = below(state, PROC_PREDICTORS);
+        config->predictor_bits = below(state, 3) ? 0 : below(state, 14);
+        config->mispredict_penalty = below(state, 2) ? 0 : below(state, 20);
+        if (below(state, 2)) {
+            config->l1.size = 1024u << below(state, 6);
+            config->l1.assoc = 1 + below(state, 8);
+            config->l1.latency = below(state, 5);
+            if (below(state, 2)) {
+                config->l2.size = config->l1.size << below(state, 4);
+                config->l2.assoc = 1 + below(state, 16);
+                config->l2.latency = below(state, 20);
+            }
+            config->line = below(state, 2) ? 0 : 4u << below(state, 6);
+            config->memory_latency = below(state, 200);
+        }
+        if (below(state, 2)) {
+            /* Arbitrary classes, an opcode may be claimed by none of them */
+            config->classes = 1 + below(state, PROC_MAX_CLASSES);
+            for (uint64_t c = 0; c < config->classes; c++) {
+                config->fu[c].count = unit_count(state, units, sizeof(units)/sizeof(units[0]));
+                config->fu[c].latency = below(state, 30);
+                config->fu[c].interval = below(state, 4) ? 0 : below(state, 12);
+                config->fu[c].opcodes = (uint32_t)next_random(state) & (uint32_t)next_random(state);
+            }
+            config->fu[below(state, config->classes)].opcodes |= PROC_OPCODE_BIT(-1) | PROC_OPCODE_BIT(0) |
+                                                               PROC_OPCODE_BIT(1) | PROC_OPCODE_BIT(2);
+        }
+    }
+
+    if (below(state, 5) == 0) {
+        /* Threads share the ROB, schedulers and units, each with its own trace */
+        config->threads = 2 + below(state, PROC_MAX_THREADS - 1);
+        config->fetch = below(state, PROC_FETCH_POLICIES);
+    }
+
+    if (below(state, 20) == 0) {
+        /* Out of range, the sweep service must refuse these rather than crash */
+        uint64_t value = one_of(state, bad, sizeof(bad)/sizeof(bad[0]));
+        switch (below(state, 7)) {
+        case 0: config->r = value; break;
+        case 1: config->f = value; break;
+        case 2: config->m = value; break;
+        case 3: config->k1 = value; break;
+        case 4: config->classes = PROC_MAX_CLASSES + 1 + below(state, 4); break;
+        case 5: config->threads = PROC_MAX_THREADS + 1 + below(state, 4); break;
+        default: config->policy = PROC_POLICIES + below(state, 4); break;
+        }
+    }
+}
+
+//
+// random_trace
+//
+//  draws a trace of fewer than longest instructions from the synthetic
+//  generator with a random shape, opcodes past 2 only when wide, then now
+//  and then strips every register or, unless the reference checks the case,
+//  writes ones outside the file
+//
+void random_trace(uint64_t* state, uint64_t longest, bool wide, bool legacy, std::vector<proc_inst_t>* trace)
+{
+    synth_config_t shape;
+    synth_t gen;
+    proc_inst_t inst;
+    uint64_t length = below(state, 8) ? below(state, longest) : below(state, 4);
+
+    synth_defaults(&shape);
+    shape.instructions = length;
+    shape.seed = next_random(state);
+    for (int i = 0; i < SYNTH_OPCODES; i++) {
+        /* Opcodes past 2 only for FU tables, the reference knows -1 to 2 */
+        shape.mix[i] = (i < 4 || (wide && below(state, 8) == 0)) ? below(state, 10) : 0;
+    }
+    shape.distance = 1 + below(state, 16);
+    shape.registers = 1 + below(state, 32);
+    shape.sources = below(state, 11) / 10.0;
+    shape.branches = below(state, 3) ? 0 : below(state, 5) / 10.0;
+    shape.taken = below(state, 11) / 10.0;
+    shape.memory = below(state, 3) ? 0 : below(state, 5) / 10.0;
+    shape.footprint = 64u << below(state, 16);
+
+    synth_init(&gen, &shape);
+    trace->clear();
+    while (synth_next(&gen, &inst)) {
+        trace->push_back(inst);
+    }
+
+    if (below(state, 8) == 0) {
+        for (size_t i = 0; i < trace->size(); i++) {
+            (*trace)[i].dest_reg = -1;
+            (*trace)[i].src_reg[0] = -1;
+            (*trace)[i].src_reg[1] = -1;
+        }
+    } else if (!legacy && below(state, 8) == 0) {
+        for (size_t i = 0; i < trace->size(); i += 1 + below(state, 50)) {
+            (*trace)[i].src_reg[below(state, 2)] = below(state, 2) ? PROC_REGISTERS + below(state, 1000) : -2;
+            (*trace)[i].dest_reg = below(state, 2) ? (*trace)[i].dest_reg : PROC_REGISTERS;
+        }
+    }
+}
+
+//
+// make_case
+//
+//  generates the case of a seed, the same seed always gives the same case
+//
+void make_case(uint64_t seed, fuzz_case_t* fuzz)
+{
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    bool legacy;
+
+    fuzz->seed = seed;
+    random_config(&state, &fuzz->config);
+    legacy = validate_config(&fuzz->config);
+    fuzz->threads = (fuzz->config.threads > 1 && fuzz->config.threads <= PROC_MAX_THREADS) ? fuzz->config.threads : 1;
+    for (uint64_t t = 0; t < PROC_MAX_THREADS; t++) {
+        fuzz->trace[t].clear();
+    }
+    for (uint64_t t = 0; t < fuzz->threads; t++) {
+        random_trace(&state, FUZZ_MAX_INSTRUCTIONS/fuzz->threads, fuzz->config.classes > 0 && below(&state, 2) == 0, legacy, &fuzz->trace[t]);
+    }
+    fuzz->validate = legacy && below(&state, 2) == 0;
+}
+
+//
+// instructions
+//
+//  instructions of a case over all its threads
+//
+size_t instructions(const fuzz_case_t* fuzz)
+{
+    size_t total = 0;
+
+    for (uint64_t t = 0; t < fuzz->threads; t++) {
+        total += fuzz->trace[t].size();
+    }
+    return total;
+}
+
+//
+// print_config
+//
+//  prints a configuration on one line
+//
+void print_config(FILE* out, const proc_config_t* config)
+{
+    fprintf(out, "r=%" PRIu64 " k0=%" PRIu64 " k1=%" PRIu64 " k2=%" PRIu64 " f=%" PRIu64 " m=%" PRIu64
+            " D=%" PRIu64 " B=%" PRIu64 " W=%" PRIu64 " Q=%" PRIu64 " policy=%" PRIu64 " unified=%" PRIu64
+            " predictor=%" PRIu64 ":%" PRIu64 " penalty=%" PRIu64, config->r, config->k0, config->k1, config->k2,
+            config->f, config->m, config->dispatch, config->cdb, config->retire, config->issue, config->policy,
+            config->scheduler, config->predictor, config->predictor_bits, config->mispredict_penalty);
+    if (config->l1.size > 0) {
+        fprintf(out, " l1=%" PRIu64 ":%" PRIu32 ":%" PRIu32 " l2=%" PRIu64 ":%" PRIu32 ":%" PRIu32 " line=%" PRIu64
+                " mem=%" PRIu64, config->l1.size, config->l1.assoc, config->l1.latency, config->l2.size,
+                config->l2.assoc, config->l2.latency, config->line, config->memory_latency);
+    }
+    if (config->threads > 1) {
+        fprintf(out, " threads=%" PRIu64 " fetch=%" PRIu64, config->threads, config->fetch);
+    }
+    for (uint64_t c = 0; c < config->classes && c < PROC_MAX_CLASSES; c++) {
+        fprintf(out, " fu%" PRIu64 "=%" PRIu64 ":%" PRIu32 ":%" PRIu32 ":0x%" PRIx32, c, config->fu[c].count,
+                config->fu[c].latency, config->fu[c].interval, config->fu[c].opcodes);
+    }
+    fprintf(out, "\n");
+}
+
+//
+// write_trace
+//
+//  writes a case's trace in the text format, registers outside the file
+//  included, which the trace reader refuses
+//
+bool write_trace(const char* path, const std::vector<proc_inst_t>& trace)
+{
+    FILE* out = fopen(path, "w");
+
+    if (out == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < trace.size(); i++) {
+        const proc_inst_t* inst = &trace[i];
+        fprintf(out, "%" PRIx32 " %" PRId32 " %" PRId32 " %" PRId32 " %" PRId32, inst->instruction_address,
+                inst->op_code, inst->dest_reg, inst->src_reg[0], inst->src_reg[1]);
+        if (inst->branch != PROC_BRANCH_NONE) {
+            fprintf(out, " %d %" PRIx32, inst->branch == PROC_BRANCH_TAKEN, inst->branch_target);
+        }
+        if (inst->memory) {
+            fprintf(out, " @%" PRIx32, inst->data_address);
+        }
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    return true;
+}
+
+//
+// array_source
+//
+//  hands the engine the instructions of a case
+//
+bool array_source(proc_inst_t* p_inst, void* context)
+{
+    array_source_t* source = (array_source_t*) context;
+
+    if (source->next == source->trace->size()) {
+        return false;
+    }
+    *p_inst = (*source->trace)[source->next++];
+    return true;
+}
+
+//
+// check_retired
+//
+//  checks retired instructions as they arrive: program order within each
+//  thread, each the instruction of its line in that thread's trace, and
+//  stage times that never go backwards
+//
+void check_retired(const proc_retire_t* records, uint64_t count, void* context)
+{
+    retire_check_t* check = (retire_check_t*) context;
+
+    for (uint64_t i = 0; i < count && check->failure[0] == '\0'; i++) {
+        const proc_retire_t* record = &records[i];
+        int64_t t = record->thread;
+
+        if (t < 0 || t >= (int64_t)check->fuzz->threads) {
+            snprintf(check->failure, sizeof(check->failure), "instruction %" PRId64 " retired on thread %" PRId64
+                     " of %" PRIu64, record->line_number, t, check->fuzz->threads);
+            break;
+        }
+        const std::vector<proc_inst_t>& trace = check->fuzz->trace[t];
+        if (record->line_number != check->retired[t] + 1 || record->line_number > (int64_t)trace.size()) {
+            snprintf(check->failure, sizeof(check->failure), "thread %" PRId64 ": instruction %" PRId64
+                     " retired after %" PRId64, t, record->line_number, check->retired[t]);
+        } else if (record->p_inst.op_code != trace[check->retired[t]].op_code ||
+                   record->p_inst.instruction_address != trace[check->retired[t]].instruction_address) {
+            snprintf(check->failure, sizeof(check->failure), "thread %" PRId64 ": instruction %" PRId64
+                     " is not the trace's", t, record->line_number);
+        } else if (!(record->fetch <= record->disp && record->disp <= record->sched && record->sched <= record->exec &&
+                     record->exec <= record->state && record->state <= record->retire)) {
+            snprintf(check->failure, sizeof(check->failure), "thread %" PRId64 ": instruction %" PRId64
+                     " has stages out of order: %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64,
+                     t, record->line_number, record->fetch, record->disp, record->sched, record->exec, record->state,
+                     record->retire);
+        } else if (record->retire < check->lastRetire[t]) {
+            snprintf(check->failure, sizeof(check->failure), "thread %" PRId64 ": instruction %" PRId64
+                     " retired at %" PRId64 ", before its predecessor at %" PRId64, t, record->line_number,
+                     record->retire, check->lastRetire[t]);
+        }
+        check->retired[t]++;
+        check->lastRetire[t] = record->retire;
+    }
+}
+
+//
+// first_blocked
+//
+//  index of the first instruction of a thread's trace no unit executes, the
+//  trace size if none: its opcode has no class, or the first class claiming
+//  it has no units
+//
+size_t first_blocked(const fuzz_case_t* fuzz, uint64_t thread)
+{
+    proc_fu_t table[PROC_MAX_CLASSES];
+    uint64_t classes = fu_classes_proc(&fuzz->config, table);
+    const std::vector<proc_inst_t>& trace = fuzz->trace[thread];
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        int32_t op = trace[i].op_code;
+        bool executable = false;
+
+        for (uint64_t c = 0; op >= -1 && op <= PROC_MAX_OPCODE && c < classes; c++) {
+            if (table[c].opcodes & PROC_OPCODE_BIT(op)) {
+                executable = table[c].count > 0;
+                break;
+            }
+        }
+        if (!executable) {
+            return i;
+        }
+    }
+    return trace.size();
+}
+
+//
+// cycle_bound
+//
+//  cycles a case may take before it counts as a hang: every instruction of
+//  every thread waiting out the slowest unit, a memory access and a
+//  misprediction in turn
+//
+uint64_t cycle_bound(const fuzz_case_t* fuzz)
+{
+    proc_fu_t table[PROC_MAX_CLASSES];
+    uint64_t classes = fu_classes_proc(&fuzz->config, table);
+    uint64_t slowest = 1;
+
+    for (uint64_t c = 0; c < classes; c++) {
+        uint64_t cycles = (uint64_t)table[c].latency + table[c].interval;
+        slowest = (cycles > slowest) ? cycles : slowest;
+    }
+    slowest += fuzz->config.l1.latency + fuzz->config.l2.latency + fuzz->config.memory_latency +
+               fuzz->config.mispredict_penalty + 8;
+    return 2*(instructions(fuzz) + 1)*slowest + 100;
+}
+
+//
+// run_case
+//
+//  simulates a case and checks it, returns its CASE_* status after
+//  printing why when it failed
+//
+int run_case(const fuzz_case_t* fuzz)
+{
+    array_source_t source[PROC_MAX_THREADS];
+    size_t blocked[PROC_MAX_THREADS];
+    retire_check_t check;
+    proc_stats_t stats;
+    bool blocks = false;
+    const char* error = check_config_proc(&fuzz->config);
+    int status = fuzz->validate ? CASE_VALIDATED : CASE_DRAINED;
+
+    if (error != NULL) {
+        return CASE_REJECTED;
+    }
+
+    memset(&check, 0, sizeof(check));
+    check.fuzz = fuzz;
+    configure_proc(&fuzz->config);
+    for (uint64_t t = 0; t < fuzz->threads; t++) {
+        source[t].trace = &fuzz->trace[t];
+        source[t].next = 0;
+        blocked[t] = first_blocked(fuzz, t);
+        blocks = blocks || blocked[t] < fuzz->trace[t].size();
+        set_thread_source_proc(t, array_source, &source[t]);
+    }
+    set_source_proc(array_source, &source[0]);
+    set_retire_proc(check_retired, &check);
+    if (fuzz->validate) {
+        /* The reference runs without stop criteria, a hang is left to the alarm */
+        if (!validate_proc(&fuzz->config, array_source, &source[0], false, stderr)) {
+            fprintf(stderr, "diverged from the reference\n");
+            return CASE_FAILED;
+        }
+    } else {
+        set_cycle_limit_proc(cycle_bound(fuzz));
+    }
+    run_proc(&stats);
+    complete_proc(&stats);
+
+    if (check.failure[0] != '\0') {
+        fprintf(stderr, "%s\n", check.failure);
+        return CASE_FAILED;
+    }
+    if (stats.stop_reason == PROC_STOP_CYCLES) {
+        for (uint64_t t = 0; t < fuzz->threads; t++) {
+            fprintf(stderr, "hung: thread %" PRIu64 " retired %" PRId64 " of %zu instructions in %lu cycles\n", t,
+                    check.retired[t], fuzz->trace[t].size(), stats.cycle_count);
+        }
+        return CASE_FAILED;
+    }
+
+    /* Dispatch is in order over all threads, so a blocked instruction stops them all */
+    for (uint64_t t = 0; t < fuzz->threads; t++) {
+        bool failed;
+
+        if (stats.stop_reason == PROC_STOP_BLOCKED) {
+            failed = !blocks || check.retired[t] > (int64_t)blocked[t];
+        } else {
+            failed = stats.stop_reason != PROC_STOP_NONE || check.retired[t] != (int64_t)fuzz->trace[t].size() ||
+                     blocks;
+        }
+        if (failed) {
+            fprintf(stderr, "%s: thread %" PRIu64 " retired %" PRId64 " of %zu instructions, the first no unit"
+                    " executes is %zu\n", (stats.stop_reason == PROC_STOP_BLOCKED) ? "blocked" : "drained", t,
+                    check.retired[t], fuzz->trace[t].size(), blocked[t] + 1);
+            return CASE_FAILED;
+        }
+    }
+    return (stats.stop_reason == PROC_STOP_BLOCKED) ? CASE_BLOCKED : status;
+}
+
+//
+// fork_case
+//
+//  runs a case in a child process under an address space limit and an
+//  alarm, so a crash, a runaway allocation or a hang fails only that case
+//
+int fork_case(const fuzz_case_t* fuzz, unsigned seconds, uint64_t megabytes, int* killed)
+{
+    int status;
+    pid_t child;
+
+    fflush(stdout);
+    fflush(stderr);
+    child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0) {
+        struct rlimit limit;
+        limit.rlim_cur = limit.rlim_max = megabytes << 20;
+        setrlimit(RLIMIT_AS, &limit);
+        alarm(seconds);
+        _exit(run_case(fuzz));
+    }
+
+    *killed = 0;
+    waitpid(child, &status, 0);
+    if (WIFSIGNALED(status)) {
+        *killed = WTERMSIG(status);
+        return CASE_FAILED;
+    }
+    switch (WEXITSTATUS(status)) {
+    case CASE_DRAINED:
+    case CASE_REJECTED:
+    case CASE_BLOCKED:
+    case CASE_VALIDATED:
+        return WEXITSTATUS(status);
+    default:
+        return CASE_FAILED;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    uint64_t cases = 1000;
+    uint64_t seed = 1;
+    unsigned seconds = 60;
+    uint64_t megabytes = 1024;
+    bool single = false;
+    uint64_t counts[CASE_VALIDATED + 1];
+    uint64_t failures = 0;
+    fuzz_case_t fuzz;
+
+    /* Read arguments */
+    while(-1 != (opt = getopt(argc, argv, "n:s:t:m:c:h"))) {
+        switch(opt) {
+        case 'n':
+            cases = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'm':
+            megabytes = strtoull(optarg, NULL, 10);
+            break;
+        case 'c':
+            seed = strtoull(optarg, NULL, 10);
+            single = true;
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+
+    if (single) {
+        /* Reproduce one case where a debugger can see it, -t 0 lets it take its time */
+        char path[64];
+        int status;
+
+        make_case(seed, &fuzz);
+        print_config(stdout, &fuzz.config);
+        for (uint64_t t = 0; t < fuzz.threads; t++) {
+            if (fuzz.threads > 1) {
+                snprintf(path, sizeof(path), "fuzz-%" PRIu64 "-%" PRIu64 ".trace", seed, t);
+            } else {
+                snprintf(path, sizeof(path), "fuzz-%" PRIu64 ".trace", seed);
+            }
+            if (!write_trace(path, fuzz.trace[t])) {
+                fprintf(stderr, "Failed to open %s for writing\n", path);
+            }
+            printf("%zu instructions in %s\n", fuzz.trace[t].size(), path);
+        }
+        alarm(seconds);
+        status = run_case(&fuzz);
+        printf("status %d\n", status);
+        return status == CASE_FAILED;
+    }
+
+    memset(counts, 0, sizeof(counts));
+    for (uint64_t i = 0; i < cases; i++) {
+        int killed;
+        int status;
+
+        make_case(seed + i, &fuzz);
+        status = fork_case(&fuzz, seconds, megabytes, &killed);
+        if (status == CASE_FAILED) {
+            failures++;
+            if (killed == SIGALRM) {
+                printf("FAIL seed %" PRIu64 ": no result within %u seconds\n", seed + i, seconds);
+            } else if (killed != 0) {
+                printf("FAIL seed %" PRIu64 ": %s\n", seed + i, strsignal(killed));
+            } else {
+                printf("FAIL seed %" PRIu64 ": see above\n", seed + i);
+            }
+            printf("  %zu instructions, ", instructions(&fuzz));
+            print_config(stdout, &fuzz.config);
+            printf("  reproduce with procsim_fuzz -c %" PRIu64 "\n", seed + i);
+        } else {
+            counts[status]++;
+        }
+    }
+
+    printf("%" PRIu64 " cases: %" PRIu64 " drained, %" PRIu64 " validated against the reference, %" PRIu64
+           " blocked, %" PRIu64 " configurations refused, %" PRIu64 " failed\n", cases, counts[CASE_DRAINED],
+           counts[CASE_VALIDATED], counts[CASE_BLOCKED], counts[CASE_REJECTED], failures);
+
+    return failures > 0;
+}
@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "procsim.hpp"
+#include "procsim_synth.hpp"
+
+void print_help_and_exit(void) {
+    printf("procsim_gen [OPTIONS]\n");
+    printf("  -n N\t\tInstructions to generate (default 1000000)\n");
+    printf("  -s seed\tRandom seed (default 1)\n");
+    printf("  -o file\tOutput file (default stdout)\n");
+    printf("  -b\t\tBinary records instead of text lines\n");
+    printf("  -x w,w,...\tOpcode mix, relative weights of opcodes -1, 0, 1, ... (default 22,54,8,16)\n");
+    printf("  -d D\t\tMean dependency distance in instructions, geometric (default 8)\n");
+    printf("  -g G\t\tRegisters written, 1 to 32; fewer means more register pressure (default 32)\n");
+    printf("  -u P\t\tProbability each source register is used (default 0.7)\n");
+    printf("  -B B[:T]\tFraction of branches with outcomes, and their taken probability (default 0:0.6)\n");
+    printf("  -A A[:bytes]\tFraction of instructions accessing data, and the bytes they touch,\n");
+    printf("\t\twith an optional k or m suffix (default 0:1m)\n");
+    printf("  -h\t\tThis helpful output\n");
+    exit(0);
+}
+
+//
+// read_mix
+//
+//  parses the weights of -x, "w,w,..." for opcodes -1, 0, 1, ...
+//
+//  returns false after printing the offending weight
+//
+bool read_mix(const char* spec, synth_config_t* config)
+{
+    const char* at = spec;
+    int n = 0;
+
+    memset(config->mix, 0, sizeof(config->mix));
+    while (*at != '\0') {
+        char* end;
+        if (n == SYNTH_OPCODES) {
+            fprintf(stderr, "More than %d opcode weights in %s\n", SYNTH_OPCODES, spec);
+            return false;
+        }
+        config->mix[n++] = strtod(at, &end);
+        if (end == at || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "Bad opcode weight in %s\n", spec);
+            return false;
+        }
+        at = (*end == ',') ? end + 1 : end;
+    }
+    return true;
+}
+
+//
+// read_size
+//
+//  parses a byte count with an optional k or m suffix
+//
+uint64_t read_size(const char* text)
+{
+    char* end;
+    uint64_t size = strtoull(text, &end, 10);
+
+    if (*end == 'k' || *end == 'K') {
+        size <<= 10;
+    } else if (*end == 'm' || *end == 'M') {
+        size <<= 20;
+    }
+    return size;
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    synth_config_t config;
+    synth_t gen;
+    const char* outPath = NULL;
+    bool binary = false;
+    FILE* out = stdout;
+    const char* colon;
+
+    synth_defaults(&config);
+
+    /* Read arguments */
+    while(-1 != (opt = getopt(argc, argv, "n:s:o:bx:d:g:u:B:A:h"))) {
+        switch(opt) {
+        case 'n':
+            config.instructions = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            config.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        case 'b':
+            binary = true;
+            break;
+        case 'x':
+            if (!read_mix(optarg, &config)) {
+                return 1;
+            }
+            break;
+        case 'd':
+            config.distance = atof(optarg);
+            break;
+        case 'g':
+            config.registers = atoi(optarg);
+            break;
+        case 'u':
+            config.sources = atof(optarg);
+            break;
+        case 'B':
+            config.branches = atof(optarg);
+            colon = strchr(optarg, ':');
+            if (colon != NULL) {
+                config.taken = atof(colon + 1);
+            }
+            break;
+        case 'A':
+            config.memory = atof(optarg);
+            colon = strchr(optarg, ':');
+            if (colon != NULL) {
+                config.footprint = read_size(colon + 1);
+            }
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+
+    if (config.branches + config.memory > 1) {
+        fprintf(stderr, "Branch and data access fractions add up to more than 1\n");
+        return 1;
+    }
+    if (config.registers < 1 || config.registers > 32) {
+        fprintf(stderr, "Registers must be between 1 and 32\n");
+        return 1;
+    }
+
+    if (outPath != NULL) {
+        out = fopen(outPath, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", outPath);
+            return 1;
+        }
+    }
+
+    synth_init(&gen, &config);
+    uint64_t written = synth_write(&gen, out, binary);
+    if (out != stdout) {
+        fclose(out);
+    }
+    fprintf(stderr, "Generated %" PRIu64 " instructions\n", written);
+
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <string.h>
+#include "procsim_interval.hpp"
+
+/*
+* classOf
+* FU class of an opcode, the first class of the table that claims it
+*
+* parameters:
+* const interval_t* est - estimator
+* int32_t op_code       - opcode from the trace
+*
+* returns:
+* int - class, -1 if no class executes the opcode
+*/
+static int classOf(const interval_t* est, int32_t op_code){
+	if (op_code < -1 || op_code > PROC_MAX_OPCODE){
+		return -1;
+	}
+	for (int c = 0; c < est->classes; c++){
+		if (est->fu[c].opcodes & PROC_OPCODE_BIT(op_code)){
+			return c;
+		}
+	}
+	return -1;
+}
+
+/*
+* maxOf
+* Larger of two cycles
+*
+* parameters:
+* int64_t a, b - cycles to compare
+*
+* returns:
+* int64_t - the later cycle
+*/
+static int64_t maxOf(int64_t a, int64_t b){
+	return a > b ? a : b;
+}
+
+/*
+* ringCount
+* Count kept for a cycle in a ring indexed by cycle mod horizon
+*
+* parameters:
+* int64_t* cycles - cycle each entry currently counts
+* uint32_t* used  - the counts
+* int64_t cycle   - cycle to look up
+*
+* returns:
+* uint32_t& - count, cleared when the horizon wraps onto a new cycle
+*/
+static uint32_t& ringCount(int64_t* cycles, uint32_t* used, int64_t cycle){
+	int slot = cycle % INTERVAL_HORIZON;
+
+	if (cycles[slot] != cycle){
+		cycles[slot] = cycle;
+		used[slot] = 0;
+	}
+	return used[slot];
+}
+
+/*
+* slotsUsed
+* Units of a class already taken in a cycle
+*
+* parameters:
+* interval_t* est - estimator
+* int c           - FU class
+* int64_t cycle   - exec cycle
+*
+* returns:
+* uint32_t& - busy units
+*/
+static uint32_t& slotsUsed(interval_t* est, int c, int64_t cycle){
+	return ringCount(est->slotCycle[c], est->slotUsed[c], cycle);
+}
+
+/*
+* ringAlloc
+* Allocates an empty ring of per-cycle counts
+*
+* parameters:
+* int64_t** cycles - receives the cycle of each entry
+* uint32_t** used  - receives the counts
+*
+* returns:
+* none
+*/
+static void ringAlloc(int64_t** cycles, uint32_t** used){
+	*cycles = (int64_t*) malloc(INTERVAL_HORIZON*sizeof(int64_t));
+	*used = (uint32_t*) calloc(INTERVAL_HORIZON, sizeof(uint32_t));
+	for (int j = 0; j < INTERVAL_HORIZON; j++){
+		(*cycles)[j] = -1;
+	}
+}
+
+/*
+* unitFree
+* Whether a class has a unit free for an instruction's whole issue interval
+*
+* parameters:
+* interval_t* est - estimator
+* int c           - FU class
+* int64_t exec    - first cycle of the instruction in the unit
+*
+* returns:
+* bool - true if fewer than count units are busy in every cycle of the interval
+*/
+static bool unitFree(interval_t* est, int c, int64_t exec){
+	for (uint32_t i = 0; i < est->fu[c].interval; i++){
+		if (slotsUsed(est, c, exec+i) >= est->fu[c].count){
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+* takeSlot
+* Occupies a scheduler queue slot until the instruction's result is written. A
+* full queue first gives up the slot that frees earliest, whatever its age.
+*
+* parameters:
+* int64_t* heap   - completion cycles of the occupants, a min-heap
+* uint64_t* count - occupants
+* uint64_t size   - slots in the queue
+* int64_t state   - cycle the new occupant writes its result
+*
+* returns:
+* none
+*/
+static void takeSlot(int64_t* heap, uint64_t* count, uint64_t size, int64_t state){
+	uint64_t i;
+
+	if (*count == size){
+		//Replace the root and sift it down
+		i = 0;
+		while (true){
+			uint64_t child = 2*i + 1;
+			if (child >= size){
+				break;
+			}
+			if (child + 1 < size && heap[child+1] < heap[child]){
+				child++;
+			}
+			if (heap[child] >= state){
+				break;
+			}
+			heap[i] = heap[child];
+			i = child;
+		}
+		heap[i] = state;
+		return;
+	}
+
+	//Append and sift up
+	i = (*count)++;
+	while (i > 0 && heap[(i-1)/2] > state){
+		heap[i] = heap[(i-1)/2];
+		i = (i-1)/2;
+	}
+	heap[i] = state;
+}
+
+/*
+* interval_init
+* Prepares an estimator for one configuration
+*
+* parameters:
+* interval_t* est             - estimator
+* const proc_config_t* config - configuration to estimate
+*
+* returns:
+* none
+*/
+void interval_init(interval_t* est, const proc_config_t* config){
+	memset(est, 0, sizeof(interval_t));
+	est->config = *config;
+	est->classes = fu_classes_proc(config, est->fu);
+	est->entries = scheduler_entries_proc(config);
+
+	est->history = maxOf(maxOf(config->r, config->f), maxOf(config->dispatch, config->retire)) + 1;
+	est->fetch = (int64_t*) calloc(est->history, sizeof(int64_t));
+	est->sched = (int64_t*) calloc(est->history, sizeof(int64_t));
+	est->retire = (int64_t*) calloc(est->history, sizeof(int64_t));
+	for (int c = 0; c < est->classes; c++){
+		if (est->fu[c].latency < 1){
+			est->fu[c].latency = 1;
+		}
+		if (est->fu[c].interval < 1){
+			est->fu[c].interval = 1;
+		}
+		//A unified scheduler keeps every occupant in class 0's heap
+		uint64_t entries = (config->scheduler == PROC_SCHED_UNIFIED && c == 0) ? est->entries : config->m*est->fu[c].count;
+		est->classState[c] = (int64_t*) calloc(entries + 1, sizeof(int64_t));
+		ringAlloc(&est->slotCycle[c], &est->slotUsed[c]);
+	}
+	ringAlloc(&est->cdbCycle, &est->cdbUsed);
+	ringAlloc(&est->issueCycle, &est->issueUsed);
+	predictor_init(&est->predictor, (config->predictor < PROC_PREDICTORS) ? config->predictor : PROC_PREDICT_NONE,
+				   (config->predictor_bits > 0) ? config->predictor_bits : DEFAULT_PREDICTOR_BITS);
+	dcache_init(&est->dcache, config);
+}
+
+/*
+* interval_step
+* Times one instruction from the times of the instructions before it. Each
+* pipeline stage is the latest of the constraints the cycle-level engine
+* enforces: fetch width and dispatch queue space, in-order dispatch into the ROB
+* and the scheduler queue up to the dispatch width, operand wake-up over
+* the CDB, a free unit of the class for its issue interval within the issue
+* width, a broadcast slot for the result, and in-order retirement up to the
+* retire width. Issue goes to the oldest, whatever the policy. With
+* the reference classes, k0 issue is held off for a cycle after k0 or more k1
+* issues, as checkAge does. A data access keeps the result for the latency of
+* the level that serves it, and fetch stops after a predicted taken branch
+* until the next cycle, after a mispredicted one until it resolves plus the
+* penalty.
+*
+* parameters:
+* interval_t* est         - estimator
+* const proc_inst_t* inst - next instruction in program order
+*
+* returns:
+* none
+*/
+void interval_step(interval_t* est, const proc_inst_t* inst){
+	const proc_config_t* config = &est->config;
+	uint64_t n = est->instructions;					//0-based index of this instruction
+	uint64_t h = est->history;
+	int c = classOf(est, inst->op_code);
+	bool legacy = (config->classes == 0);
+	bool unified = (config->scheduler == PROC_SCHED_UNIFIED);
+	int q = unified ? 0 : c;						//queue the instruction waits in
+	uint64_t queue = (c < 0) ? 0 : (unified ? est->entries : config->m*est->fu[c].count);
+	uint64_t retireWidth = (config->retire > 0) ? config->retire : config->f;
+	int64_t fetch, sched, exec, state, retire;
+
+	//Fetch: F per cycle, stalls while R older instructions wait to dispatch
+	fetch = 1;
+	if (n > 0){
+		fetch = maxOf(fetch, est->fetch[(n-1)%h]);
+	}
+	if (n >= config->f){
+		fetch = maxOf(fetch, est->fetch[(n-config->f)%h] + 1);
+	}
+	if (n >= config->r){
+		fetch = maxOf(fetch, est->sched[(n-config->r)%h] - 1);
+	}
+	fetch = maxOf(fetch, est->fetchResume);
+
+	//Dispatch: in order, needs a ROB entry and a slot in the scheduler
+	sched = fetch + 2;
+	if (n > 0){
+		sched = maxOf(sched, est->sched[(n-1)%h]);
+	}
+	if (n >= config->r){
+		sched = maxOf(sched, est->retire[(n-config->r)%h] + 2);
+	}
+	if (config->dispatch > 0 && n >= config->dispatch){
+		sched = maxOf(sched, est->sched[(n-config->dispatch)%h] + 1);
+	}
+	if (queue > 0 && est->classCount[q] == queue){
+		sched = maxOf(sched, est->classState[q][0] + 2);
+	}
+
+	//Issue: operands broadcast, then the first cycle with a free unit of the class
+	exec = sched + 1;
+	for (int i = 0; i < 2; i++){
+		if (inst->src_reg[i] >= 0 && inst->src_reg[i] < 32){
+			exec = maxOf(exec, est->regReady[inst->src_reg[i]]);
+		}
+	}
+	if (c < 0 || est->fu[c].count == 0){
+		est->blocked = true;
+		state = exec + 1;
+	}else{
+		while (!unitFree(est, c, exec) || (legacy && c == 0 && slotsUsed(est, 1, exec-1) >= est->fu[0].count) ||
+			   (config->issue > 0 && ringCount(est->issueCycle, est->issueUsed, exec) >= config->issue)){
+			exec++;
+		}
+		ringCount(est->issueCycle, est->issueUsed, exec)++;
+		for (uint32_t i = 0; i < est->fu[c].interval; i++){
+			slotsUsed(est, c, exec+i)++;
+		}
+		state = exec + est->fu[c].latency;
+		if (est->dcache.levels > 0 && inst->memory){
+			uint32_t latency = est->dcache.latency[dcache_access(&est->dcache, inst->data_address)];
+			state = maxOf(state, exec + latency);
+		}
+	}
+
+	//Broadcast: the result waits for a free CDB slot. Slots go to instructions in
+	//program order here rather than oldest first among those ready.
+	if (config->cdb > 0){
+		while (ringCount(est->cdbCycle, est->cdbUsed, state) >= config->cdb){
+			state++;
+		}
+		ringCount(est->cdbCycle, est->cdbUsed, state)++;
+	}
+
+	//Retire: in order, up to the retire width per cycle, the cycle after the result is written
+	retire = state + 1;
+	if (n > 0){
+		retire = maxOf(retire, est->retire[(n-1)%h]);
+	}
+	if (n >= retireWidth){
+		retire = maxOf(retire, est->retire[(n-retireWidth)%h] + 1);
+	}
+
+	//Branches with a known outcome end the fetch group, a mispredicted one fetches
+	//nothing until its result is written
+	if (inst->branch != PROC_BRANCH_NONE && est->predictor.kind != PROC_PREDICT_NONE){
+		bool taken = (inst->branch == PROC_BRANCH_TAKEN);
+		bool predicted = predictor_predict(&est->predictor, inst->instruction_address);
+
+		predictor_update(&est->predictor, inst->instruction_address, taken);
+		if (predicted != taken){
+			est->fetchResume = state + 1 + config->mispredict_penalty;
+		}else if (taken){
+			est->fetchResume = fetch + 1;
+		}
+	}
+
+	est->fetch[n%h] = fetch;
+	est->sched[n%h] = sched;
+	est->retire[n%h] = retire;
+	if (queue > 0){
+		takeSlot(est->classState[q], &est->classCount[q], queue, state);
+	}
+	if (inst->dest_reg >= 0 && inst->dest_reg < 32){
+		est->regReady[inst->dest_reg] = state + 1;
+	}
+	est->lastRetire = retire;
+	est->instructions++;
+}
+
+/*
+* interval_finish
+* Reports the estimate and releases the estimator
+*
+* parameters:
+* interval_t* est       - estimator
+* proc_stats_t* p_stats - receives estimated instructions, cycles and IPC
+*
+* returns:
+* none
+*/
+void interval_finish(interval_t* est, proc_stats_t* p_stats){
+	p_stats->retired_instruction = est->instructions;
+	p_stats->cycle_count = est->lastRetire;
+	p_stats->stop_reason = PROC_STOP_NONE;
+	p_stats->avg_inst_retired = (est->blocked || est->lastRetire == 0) ? 0 : ((double)est->instructions)/est->lastRetire;
+
+	free(est->fetch);
+	free(est->sched);
+	free(est->retire);
+	for (int c = 0; c < est->classes; c++){
+		free(est->classState[c]);
+		free(est->slotCycle[c]);
+		free(est->slotUsed[c]);
+	}
+	free(est->cdbCycle);
+	free(est->cdbUsed);
+	free(est->issueCycle);
+	free(est->issueUsed);
+	predictor_free(&est->predictor);
+	dcache_free(&est->dcache);
+}
@@ -0,0 +1,44 @@
+#ifndef PROCSIM_INTERVAL_HPP
+#define PROCSIM_INTERVAL_HPP
+
+#include <cstdint>
+#include "procsim.hpp"
+#include "procsim_branch.hpp"
+#include "procsim_dcache.hpp"
+
+//Cycles of FU issue slots tracked ahead of the oldest pending issue
+#define INTERVAL_HORIZON 4096
+
+typedef struct _interval_t
+{
+    proc_config_t config;
+    uint64_t instructions;
+    uint64_t history;               //ring size, covers R, F and the dispatch and retire widths
+    int64_t* fetch;                 //per-instruction times of the last history instructions
+    int64_t* sched;
+    int64_t* retire;
+    proc_fu_t fu[PROC_MAX_CLASSES]; //FU classes of the configuration
+    int classes;
+    uint64_t entries;               //scheduler entries over all classes
+    int64_t* classState[PROC_MAX_CLASSES];  //completion of each class's queue occupants, a min-heap,
+                                            //a unified scheduler uses the first only
+    uint64_t classCount[PROC_MAX_CLASSES];  //occupants of each class's queue
+    int64_t regReady[32];           //earliest exec of a consumer of each register
+    int64_t* slotCycle[PROC_MAX_CLASSES];   //busy units of each class, indexed by cycle mod horizon
+    uint32_t* slotUsed[PROC_MAX_CLASSES];
+    int64_t* cdbCycle;              //broadcasts per cycle, indexed by cycle mod horizon
+    uint32_t* cdbUsed;
+    int64_t* issueCycle;            //issues per cycle over all classes
+    uint32_t* issueUsed;
+    predictor_t predictor;          //trained in program order, as fetch does
+    dcache_t dcache;                //accessed in program order rather than issue order
+    int64_t fetchResume;            //first fetch after a taken or mispredicted branch
+    int64_t lastRetire;
+    bool blocked;                   //an instruction's class has no units
+} interval_t;
+
+void interval_init(interval_t* est, const proc_config_t* config);
+void interval_step(interval_t* est, const proc_inst_t* inst);
+void interval_finish(interval_t* est, proc_stats_t* p_stats);
+
+#endif /* PROCSIM_INTERVAL_HPP */
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include "procsim_kanata.hpp"
+
+//Longest command written at once, a label with a full instruction included
+#define KANATA_LINE 160
+
+//Stages after fetch, in the order of the retire record, then retirement
+#define KANATA_STAGES 4
+#define KANATA_RETIRE KANATA_STAGES
+
+//Names the viewer shows for the stages after fetch, which is F
+static const char* stageNames[KANATA_STAGES] = {"Ds", "Sc", "Ex", "St"};
+
+/*
+* earlier
+* Orders queued events by cycle, then by instruction and stage, so stages
+* that start in the same cycle are written in pipeline order
+*
+* parameters:
+* const kanata_event_t* a - event
+* const kanata_event_t* b - event
+*
+* returns:
+* bool - true if a is written before b
+*/
+static inline bool earlier(const kanata_event_t* a, const kanata_event_t* b){
+	if (a->cycle != b->cycle){
+		return a->cycle < b->cycle;
+	}
+	if (a->id != b->id){
+		return a->id < b->id;
+	}
+	return a->kind < b->kind;
+}
+
+/*
+* flushBuffer
+* Writes out the formatted commands
+*
+* parameters:
+* kanata_t* log - log
+*
+* returns:
+* none
+*/
+static void flushBuffer(kanata_t* log){
+	fwrite(log->buffer, 1, log->used, log->out);
+	log->used = 0;
+}
+
+/*
+* command
+* Formats a command into the buffer, after the cycle advance it needs
+*
+* parameters:
+* kanata_t* log      - log
+* int64_t cycle      - cycle the command happens in
+* const char* format - printf format of the command
+*
+* returns:
+* none
+*/
+static void command(kanata_t* log, int64_t cycle, const char* format, ...){
+	va_list args;
+
+	if (log->used > KANATA_BUFFER - 2*KANATA_LINE){
+		flushBuffer(log);
+	}
+	if (log->cycle < 0){
+		log->used += snprintf(log->buffer + log->used, KANATA_LINE, "C=\t%" PRId64 "\n", cycle);
+		log->cycle = cycle;
+	}else if (cycle > log->cycle){
+		log->used += snprintf(log->buffer + log->used, KANATA_LINE, "C\t%" PRId64 "\n", cycle - log->cycle);
+		log->cycle = cycle;
+	}
+	va_start(args, format);
+	int length = vsnprintf(log->buffer + log->used, KANATA_LINE, format, args);
+	va_end(args);
+	log->used += (length < KANATA_LINE) ? length : KANATA_LINE - 1;
+}
+
+/*
+* heapPush
+* Queues an event, growing the heap when it is full. Writing an event early
+* instead would break cycle order, since a later push can be earlier.
+*
+* parameters:
+* kanata_t* log               - log
+* const kanata_event_t* event - event
+*
+* returns:
+* none
+*/
+static void heapPush(kanata_t* log, const kanata_event_t* event){
+	uint64_t i;
+
+	if (log->count == log->capacity){
+		log->capacity *= 2;
+		log->heap = (kanata_event_t*) realloc(log->heap, log->capacity*sizeof(kanata_event_t));
+	}
+	i = log->count++;
+	while (i > 0 && earlier(event, &log->heap[(i - 1)/2])){
+		log->heap[i] = log->heap[(i - 1)/2];
+		i = (i - 1)/2;
+	}
+	log->heap[i] = *event;
+}
+
+/*
+* heapPop
+* Writes the earliest queued event and removes it
+*
+* parameters:
+* kanata_t* log - log, with at least one event queued
+*
+* returns:
+* none
+*/
+static void heapPop(kanata_t* log){
+	kanata_event_t top = log->heap[0];
+	kanata_event_t last = log->heap[--log->count];
+	uint64_t i = 0;
+
+	while (2*i + 1 < log->count){
+		uint64_t child = 2*i + 1;
+		if (child + 1 < log->count && earlier(&log->heap[child + 1], &log->heap[child])){
+			child++;
+		}
+		if (!earlier(&log->heap[child], &last)){
+			break;
+		}
+		log->heap[i] = log->heap[child];
+		i = child;
+	}
+	log->heap[i] = last;
+
+	if (top.kind == KANATA_RETIRE){
+		command(log, top.cycle, "R\t%" PRIu64 "\t%" PRIu64 "\t0\n", top.id, top.id);
+	}else{
+		command(log, top.cycle, "S\t%" PRIu64 "\t0\t%s\n", top.id, stageNames[top.kind]);
+	}
+}
+
+/*
+* kanata_all
+* Fills a window that exports every instruction
+*
+* parameters:
+* kanata_window_t* window - window
+*
+* returns:
+* none
+*/
+void kanata_all(kanata_window_t* window){
+	window->first_line = 0;
+	window->last_line = INT64_MAX;
+	window->first_cycle = 0;
+	window->last_cycle = INT64_MAX;
+}
+
+/*
+* kanata_open
+* Starts a log for a processor of one hardware thread. Every instruction in
+* flight at once can have events queued, so the heap starts sized by the tags
+* of the configuration, 2R, and grows if more ever are.
+*
+* parameters:
+* kanata_t* log                  - log
+* const char* path               - file to write
+* const proc_config_t* config    - configuration of the processor logged
+* const kanata_window_t* window  - instructions to export
+*
+* returns:
+* bool - false if the file cannot be written
+*/
+bool kanata_open(kanata_t* log, const char* path, const proc_config_t* config, const kanata_window_t* window){
+	memset(log, 0, sizeof(kanata_t));
+	log->out = fopen(path, "w");
+	if (log->out == NULL){
+		return false;
+	}
+	log->capacity = (KANATA_STAGES + 1)*(2*config->r + 1);
+	log->heap = (kanata_event_t*) malloc(log->capacity*sizeof(kanata_event_t));
+	log->buffer = (char*) malloc(KANATA_BUFFER);
+	log->window = *window;
+	log->cycle = -1;
+
+	log->used = snprintf(log->buffer, KANATA_LINE, "Kanata\t0004\n");
+	return true;
+}
+
+/*
+* kanata_retire
+* Adds retired instructions, in program order, with a signature that lets a
+* retire sink hand its batches over. Instructions are fetched in order, so no
+* later record has an event before the fetch of this one: everything queued
+* up to that cycle is written first.
+*
+* parameters:
+* kanata_t* log                 - log
+* const proc_retire_t* records  - retired instructions
+* uint64_t count                - records
+*
+* returns:
+* none
+*/
+void kanata_retire(kanata_t* log, const proc_retire_t* records, uint64_t count){
+	for (uint64_t i = 0; i < count; i++){
+		const proc_retire_t* record = &records[i];
+		const proc_inst_t* inst = &record->p_inst;
+		int64_t stages[KANATA_STAGES] = {record->disp, record->sched, record->exec, record->state};
+		kanata_event_t event;
+
+		while (log->count > 0 && log->heap[0].cycle <= record->fetch){
+			heapPop(log);
+		}
+		if (record->line_number < log->window.first_line || record->line_number > log->window.last_line ||
+			record->retire < log->window.first_cycle || record->fetch > log->window.last_cycle){
+			continue;
+		}
+
+		event.id = log->nextId++;
+		command(log, record->fetch, "I\t%" PRIu64 "\t%" PRId64 "\t%" PRId64 "\n", event.id, record->line_number,
+				record->thread);
+		command(log, record->fetch, "L\t%" PRIu64 "\t0\t%" PRId64 ": %" PRIx32 " %" PRId32 " %" PRId32 " %" PRId32
+				" %" PRId32 "\n", event.id, record->line_number, inst->instruction_address, inst->op_code,
+				inst->dest_reg, inst->src_reg[0], inst->src_reg[1]);
+		command(log, record->fetch, "S\t%" PRIu64 "\t0\tF\n", event.id);
+		for (int s = 0; s <= KANATA_STAGES; s++){
+			event.cycle = (s < KANATA_STAGES) ? stages[s] : record->retire;
+			event.kind = s;
+			heapPush(log, &event);
+		}
+		log->exported++;
+	}
+}
+
+/*
+* kanata_close
+* Writes the events still queued and closes the log
+*
+* parameters:
+* kanata_t* log - log
+*
+* returns:
+* uint64_t - instructions exported
+*/
+uint64_t kanata_close(kanata_t* log){
+	while (log->count > 0){
+		heapPop(log);
+	}
+	flushBuffer(log);
+	fclose(log->out);
+	free(log->heap);
+	free(log->buffer);
+	return log->exported;
+}
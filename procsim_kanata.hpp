@@ -0,0 +1,51 @@
+#ifndef PROCSIM_KANATA_HPP
+#define PROCSIM_KANATA_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Bytes formatted before each write
+#define KANATA_BUFFER (1 << 16)
+
+//Instructions or cycles exported, both bounds inclusive
+typedef struct _kanata_window_t
+{
+    int64_t first_line;             //instruction range, by line number
+    int64_t last_line;
+    int64_t first_cycle;            //cycle range an instruction's lifetime must overlap
+    int64_t last_cycle;
+} kanata_window_t;
+
+//A stage start or retirement of an exported instruction, not yet written
+typedef struct _kanata_event_t
+{
+    int64_t cycle;
+    uint64_t id;                    //instruction number in the log
+    int32_t kind;                   //stage index, or retirement
+} kanata_event_t;
+
+//Streaming writer of the Kanata log the Konata pipeline viewer reads. Records
+//arrive at retirement in program order; the events after an instruction's
+//fetch wait in a heap until no later record can precede them, so the heap
+//never holds more than the instructions in flight at once.
+typedef struct _kanata_t
+{
+    FILE* out;
+    char* buffer;
+    size_t used;
+    kanata_event_t* heap;           //min-heap on cycle
+    uint64_t count;
+    uint64_t capacity;
+    kanata_window_t window;
+    int64_t cycle;                  //cycle of the commands written last, -1 before the first
+    uint64_t nextId;
+    uint64_t exported;
+} kanata_t;
+
+void kanata_all(kanata_window_t* window);
+bool kanata_open(kanata_t* log, const char* path, const proc_config_t* config, const kanata_window_t* window);
+void kanata_retire(kanata_t* log, const proc_retire_t* records, uint64_t count);
+uint64_t kanata_close(kanata_t* log);
+
+#endif /* PROCSIM_KANATA_HPP */
@@ -0,0 +1,176 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "procsim_perf.hpp"
+
+/*
+* eventAttr
+* Describes a host event to perf_event_open
+*
+* parameters:
+* int event                    - PERF_*
+* struct perf_event_attr* attr - attributes to fill
+*
+* returns:
+* none
+*/
+static void eventAttr(int event, struct perf_event_attr* attr){
+	memset(attr, 0, sizeof(struct perf_event_attr));
+	attr->size = sizeof(struct perf_event_attr);
+	attr->type = PERF_TYPE_HARDWARE;
+	attr->exclude_kernel = 1;
+	attr->exclude_hv = 1;
+	attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	switch (event){
+	case PERF_INSTRUCTIONS:
+		attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case PERF_CYCLES:
+		attr->config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PERF_L1D_MISSES:
+		attr->type = PERF_TYPE_HW_CACHE;
+		attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+					   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case PERF_LLC_MISSES:
+		attr->config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	case PERF_BRANCH_MISSES:
+		attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	default:
+		attr->type = PERF_TYPE_SOFTWARE;
+		attr->config = PERF_COUNT_SW_TASK_CLOCK;
+		break;
+	}
+}
+
+/*
+* perf_open
+* Opens every event it can as one group counting the calling thread and
+* starts it. The group is scheduled on the PMU as a whole, so the events
+* count over the same intervals.
+*
+* parameters:
+* perf_t* perf - counters to open
+*
+* returns:
+* bool - true if at least one event counts
+*/
+bool perf_open(perf_t* perf){
+	struct perf_event_attr attr;
+
+	perf->leader = -1;
+	perf->members = 0;
+	perf->error = 0;
+	for (int e = 0; e < PERF_EVENTS; e++){
+		eventAttr(e, &attr);
+		attr.disabled = (perf->leader == -1);
+		perf->fd[e] = syscall(SYS_perf_event_open, &attr, 0, -1, perf->leader, 0);
+		perf->slot[e] = -1;
+		if (perf->fd[e] < 0){
+			perf->error = (perf->error != 0) ? perf->error : errno;
+			continue;
+		}
+		if (perf->leader == -1){
+			perf->leader = perf->fd[e];
+		}
+		perf->slot[e] = perf->members++;
+	}
+	if (perf->leader == -1){
+		return false;
+	}
+
+	ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+/*
+* perf_available
+* Tells whether an event is counted
+*
+* parameters:
+* const perf_t* perf - open counters
+* int event          - PERF_*
+*
+* returns:
+* bool - true if the group counts it
+*/
+bool perf_available(const perf_t* perf, int event){
+	return perf->slot[event] >= 0;
+}
+
+/*
+* perf_read
+* Reads the counts since perf_open with one system call, scaled up when the
+* kernel multiplexed the group off the PMU for part of the time
+*
+* parameters:
+* const perf_t* perf   - open counters
+* perf_counts_t* counts - counts to fill
+*
+* returns:
+* none
+*/
+void perf_read(const perf_t* perf, perf_counts_t* counts){
+	//nr, time_enabled, time_running, then one value per member
+	uint64_t data[3 + PERF_EVENTS];
+
+	memset(counts, 0, sizeof(perf_counts_t));
+	if (perf->leader == -1 || read(perf->leader, data, sizeof(data)) < (ssize_t)(3*sizeof(uint64_t))){
+		return;
+	}
+	for (int e = 0; e < PERF_EVENTS; e++){
+		if (perf->slot[e] >= 0 && (uint64_t)perf->slot[e] < data[0]){
+			uint64_t value = data[3 + perf->slot[e]];
+			if (data[2] > 0 && data[2] < data[1]){
+				value = (uint64_t)((double)value*data[1]/data[2]);
+			}
+			counts->value[e] = value;
+		}
+	}
+}
+
+/*
+* perf_close
+* Stops and closes the group
+*
+* parameters:
+* perf_t* perf - open counters
+*
+* returns:
+* none
+*/
+void perf_close(perf_t* perf){
+	for (int e = 0; e < PERF_EVENTS; e++){
+		if (perf->fd[e] >= 0){
+			close(perf->fd[e]);
+		}
+		perf->fd[e] = -1;
+		perf->slot[e] = -1;
+	}
+	perf->leader = -1;
+	perf->members = 0;
+}
+
+/*
+* perf_event_name
+* Names an event for reports
+*
+* parameters:
+* int event - PERF_*
+*
+* returns:
+* const char* - its name
+*/
+const char* perf_event_name(int event){
+	static const char* names[PERF_EVENTS] = {"instructions", "cycles", "L1D misses", "LLC misses",
+											 "branch misses", "task clock ns"};
+	return (event >= 0 && event < PERF_EVENTS) ? names[event] : "unknown";
+}
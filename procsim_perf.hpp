@@ -0,0 +1,38 @@
+#ifndef PROCSIM_PERF_HPP
+#define PROCSIM_PERF_HPP
+
+#include <cstdint>
+
+//Host events counted around a run, in the order of a perf_counts_t
+#define PERF_INSTRUCTIONS   0
+#define PERF_CYCLES         1
+#define PERF_L1D_MISSES     2       //L1 data cache read misses
+#define PERF_LLC_MISSES     3       //last level cache misses
+#define PERF_BRANCH_MISSES  4
+#define PERF_TASK_CLOCK     5       //nanoseconds on the CPU, a software event that works without a PMU
+#define PERF_EVENTS         6
+
+//Counts of every event, unavailable ones stay 0
+typedef struct _perf_counts_t
+{
+    uint64_t value[PERF_EVENTS];
+} perf_counts_t;
+
+//One perf_event_open group on the calling thread, user space only. Events the
+//host or the container does not expose are left out of the group.
+typedef struct _perf_t
+{
+    int leader;                     //file descriptor of the group, -1 when closed
+    int fd[PERF_EVENTS];            //-1 for an unavailable event
+    int slot[PERF_EVENTS];          //position in a group read, -1 for an unavailable event
+    int members;
+    int error;                      //errno of the first event that failed to open
+} perf_t;
+
+bool perf_open(perf_t* perf);
+bool perf_available(const perf_t* perf, int event);
+void perf_read(const perf_t* perf, perf_counts_t* counts);
+void perf_close(perf_t* perf);
+const char* perf_event_name(int event);
+
+#endif /* PROCSIM_PERF_HPP */
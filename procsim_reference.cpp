@@ -0,0 +1,1289 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "procsim_reference.hpp"
+
+//Boolean
+#define FALSE 	-1
+#define TRUE  	1
+
+//Array Status
+#define FULL  		2
+#define EMPTY  		3
+#define HAS_ROOM  	4
+
+//Field Status
+#define UNINITIALIZED -2
+#define READY         -3
+#define DONE          -4
+
+//ROB and CDB entries printed around a divergence
+#define DUMP_ENTRIES 16
+
+//Register structure
+typedef struct _refReg{
+	int64_t tag;
+} refReg;
+
+//CDB node
+typedef struct _refCDB{
+	int64_t line_number;
+	int ind;
+	int64_t tag;
+	int reg;
+	int FU;
+} refCDB;
+
+//Linked list node
+typedef struct _refNode{
+	_refNode *next;
+	_refNode *prev;
+	proc_inst_t p_inst;
+	int64_t line_number;
+	int ind;
+	int64_t destTag;
+	int64_t src1Tag;
+	int64_t src2Tag;
+	int age;
+	int64_t state;			//cycle its result is on the CDB
+} refNode;
+//Pointers for Linked List
+typedef struct _refList{
+	refNode* head;
+	refNode* tail;
+	int size;
+	int availExec;
+} refList;
+
+//Structure for ROB
+typedef struct _refROB{
+	proc_inst_t p_inst;
+	int64_t line_number;
+	int done;
+	int64_t state;
+} refROB;
+//Pointers for circular FIFO array
+typedef struct _refFIFO{
+	int head;
+	int tail;
+	int size;
+} refFIFO;
+
+//The original simulator's globals. Tags are line numbers, never recycled, and
+//only the state timing retirement depends on is kept: the validator compares
+//state, not retire rows.
+struct _reference_t{
+	//Initialization Parameters
+	uint64_t r;
+	uint64_t k0;
+	uint64_t k1;
+	uint64_t k2;
+	uint64_t f;
+	uint64_t m;
+
+	//Register file
+	refReg regFile[32];
+
+	//Dispatcher
+	refList dispatchPointers;
+
+	//Scheudler
+	refList k0QueuePointers;
+	refList k1QueuePointers;
+	refList k2QueuePointers;
+
+	//Execute
+	refNode** inK0;
+	refNode** inK1;
+	refNode** inK2;
+
+	//ROB Table for execution
+	refROB *ROBTable;
+	refFIFO ROBPointers;
+
+	//array to represent CDB
+	refCDB* CDB;
+	refCDB* tempCDB;
+	int CDBsize;
+	int tempCDBsize;
+
+	//Holds line number
+	int64_t instruction;
+	//File done flag
+	int readDoneFlag;
+	int flag;
+	//Clock
+	int64_t cycle;
+
+	//Dispatched this cycle per queue
+	int add0, add1, add2;
+
+	//Instruction source
+	proc_source_fn source;
+	void* sourceContext;
+};
+
+//Instance being simulated by the calling thread
+static thread_local reference_t* S = NULL;
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////ROB MANIPULATION//////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* statusROB
+* Returns status of the ROB
+*
+* parameters:
+* none
+*
+* returns:
+* int - status
+*/
+static int statusROB(){
+
+	if(S->ROBPointers.tail==S->ROBPointers.head && S->ROBPointers.size == 0){
+		return EMPTY;
+	}else if(S->ROBPointers.head == S->ROBPointers.tail){
+		return FULL;
+	}else{
+		return HAS_ROOM;
+	}
+}
+
+/*
+* addROB
+* Adds element to ROB
+*
+* parameters:
+* refNode* dispatchNode - the node being added
+*
+* returns:
+* int - ind into ROB, -1 if no room
+*/
+static int addROB(refNode* dispatchNode){
+	int ind = S->ROBPointers.tail;		//tag added to
+
+	if (statusROB()!=FULL){			//if there is room in the ROB
+		//Put item into ROB table
+		S->ROBTable[S->ROBPointers.tail].line_number = dispatchNode->line_number;
+		S->ROBTable[S->ROBPointers.tail].p_inst = dispatchNode->p_inst;
+		S->ROBTable[S->ROBPointers.tail].done = 0;
+		S->ROBPointers.tail = (S->ROBPointers.tail+1)%S->r;
+		S->ROBPointers.size++;
+	}else{
+		return FALSE;
+	}
+
+	return ind;
+}
+
+/*
+* removeROB
+* Removes head element from ROB
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void removeROB(){
+	S->ROBTable[S->ROBPointers.head].done = 0;
+
+	//Fix ROB queue
+	S->ROBPointers.head = (S->ROBPointers.head+1)%S->r;
+	S->ROBPointers.size--;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////LINKED LIST MANIPULATION//////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* addLL
+* Adds element to tail of linked list
+*
+* parameters:
+* refList* pointersIn - pointers to linked list
+* refNode* nextNode   - node to add
+*
+* returns:
+* none
+*/
+static void addLL(refList* pointersIn, refNode* nextNode){
+	pointersIn->size--;	//Decrease room
+
+	//Fix next and prev pointers
+	nextNode->prev = pointersIn->tail;
+	nextNode->next = NULL;
+
+	//Fix existing tail and head
+	if (pointersIn->tail != NULL){
+		pointersIn->tail->next = nextNode;
+	}else{		//means it was empty before
+		pointersIn->head = nextNode;
+	}
+
+	//Fix tail pointer
+	pointersIn->tail = nextNode;
+}
+
+/*
+* removeLL
+* Removes element from linked list
+*
+* parameters:
+* refList* pointersIn - pointers to linked list
+* refNode* deleteNode - node to delete
+* int freeMem         - free memory
+*
+* returns:
+* none
+*/
+static void removeLL(refList* pointersIn, refNode* deleteNode, int freeMem){
+	if (deleteNode->prev==NULL){			//Head element
+		if (deleteNode->next==NULL){		//Special case where there is only 1 element
+			pointersIn->head = NULL;
+			pointersIn->tail = NULL;
+		}else{
+			pointersIn->head = deleteNode->next;
+			pointersIn->head->prev = NULL;
+		}
+	}else if (deleteNode->next==NULL){		//Tail element
+		pointersIn->tail = deleteNode->prev;
+		pointersIn->tail->next = NULL;
+	} else{									//Element in middle
+		deleteNode->prev->next = deleteNode->next;
+		deleteNode->next->prev = deleteNode->prev;
+	}
+	//Add room to linked list
+	pointersIn->size++;
+
+	//Free the node if desired
+	if (freeMem==TRUE){
+		free(deleteNode);
+	}
+}
+
+/*
+* freeLL
+* Frees every node of a linked list
+*
+* parameters:
+* refList* pointersIn - pointers to linked list
+*
+* returns:
+* none
+*/
+static void freeLL(refList* pointersIn){
+	while (pointersIn->head != NULL){
+		removeLL(pointersIn, pointersIn->head, TRUE);
+	}
+}
+
+/*
+* createNode
+* Creates node for dispatcher
+*
+* parameters:
+* proc_inst_t p_inst  - instruction of the node
+* int64_t line_number - line number of instruction
+*
+* returns:
+* refNode* - node that has been created
+*/
+static refNode* createNode(proc_inst_t p_inst, int64_t line_number){
+	refNode* newNode = (refNode*) malloc(sizeof(refNode));
+
+	//Copy over data
+	newNode->p_inst = p_inst;
+	newNode->line_number = line_number;
+	newNode->destTag = line_number;
+
+	//Add valididty data
+	newNode->src1Tag = UNINITIALIZED;
+	newNode->src2Tag = UNINITIALIZED;
+	newNode->age = UNINITIALIZED;
+
+	return newNode;
+}
+
+/*
+* createNodeforSched
+* Reads the source tags of a node and renames its destination
+*
+* parameters:
+* refNode* dispatchNode - node to be modified
+*
+* returns:
+* none
+*/
+static void createNodeforSched(refNode* dispatchNode){
+	if (dispatchNode->p_inst.src_reg[0]!=-1){
+		dispatchNode->src1Tag = S->regFile[dispatchNode->p_inst.src_reg[0]].tag;
+	}else{
+		dispatchNode->src1Tag = READY;
+	}
+	if (dispatchNode->p_inst.src_reg[1]!=-1){
+		dispatchNode->src2Tag = S->regFile[dispatchNode->p_inst.src_reg[1]].tag;
+	}else{
+		dispatchNode->src2Tag = READY;
+	}
+
+	//Fix register file
+	if (dispatchNode->p_inst.dest_reg!=-1){
+		S->regFile[dispatchNode->p_inst.dest_reg].tag = dispatchNode->destTag;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////PIPELINE INSTUCTIONS//////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* fetchInstructions
+* Fetch F instructions while the dispatch queue has room
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void fetchInstructions(){
+	proc_inst_t p_inst;
+
+	for (uint64_t i = 0; i<S->f; i++){
+		if ((S->dispatchPointers.size+S->add0+S->add1+S->add2) <= 0){
+			break;
+		}
+		if (!S->source(&p_inst, S->sourceContext)){
+			S->readDoneFlag = 0;
+			break;
+		}
+		S->instruction++;
+		addLL(&S->dispatchPointers, createNode(p_inst, S->instruction));
+	}
+}
+
+/*
+* queueOf
+* Scheduling queue of an opcode
+*
+* parameters:
+* int32_t op_code - opcode from the trace
+*
+* returns:
+* int - 0, 1 or 2, FALSE for an opcode no queue takes
+*/
+static int queueOf(int32_t op_code){
+	if (op_code == 0 || op_code == -1){
+		return 0;
+	}
+	if (op_code == 1 || op_code == 2){
+		return op_code;
+	}
+	return FALSE;
+}
+
+/*
+* setUpRegs
+* Moves the instructions dispatched this cycle to their scheduling queues
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void setUpRegs(){
+	int i = 0;
+	refNode* dispatchNode = S->dispatchPointers.head;
+	refNode* dispatchNodeTemp;
+	refList* queues[3] = {&S->k0QueuePointers, &S->k1QueuePointers, &S->k2QueuePointers};
+
+	while(i++<(S->add0+S->add1+S->add2) && dispatchNode!=NULL){
+		createNodeforSched(dispatchNode);
+
+		dispatchNodeTemp = dispatchNode;
+		dispatchNode = dispatchNode->next;
+		removeLL(&S->dispatchPointers, dispatchNodeTemp, FALSE);
+		addLL(queues[queueOf(dispatchNodeTemp->p_inst.op_code)], dispatchNodeTemp);
+	}
+}
+
+/*
+* dispatchToScheduler
+* Reserves queue and ROB entries for the oldest instructions, in order, until
+* one does not fit
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void dispatchToScheduler(){
+	refNode* dispatchNode = S->dispatchPointers.head;
+
+	while(dispatchNode!=NULL){
+		int q = queueOf(dispatchNode->p_inst.op_code);
+		int room;
+
+		if (q == 0){
+			room = S->k0QueuePointers.size - S->add0;
+		}else if (q == 1){
+			room = S->k1QueuePointers.size - S->add1;
+		}else if (q == 2){
+			room = S->k2QueuePointers.size - S->add2;
+		}else{
+			return;
+		}
+		if (room <= 0 || statusROB()==FULL){
+			return;
+		}
+
+		if (q == 0){
+			S->add0++;
+		}else if (q == 1){
+			S->add1++;
+		}else{
+			S->add2++;
+		}
+		dispatchNode->age = READY;
+		dispatchNode->ind = addROB(dispatchNode);
+		dispatchNode = dispatchNode->next;
+	}
+}
+
+/*
+* checkAge
+* Applies the original issue limits: k1 and k2 issue at most k per cycle
+* counting their first 2*k slots, and k0 issue waits while k0 or more of the
+* first k0 k1 slots hold an instruction in its last cycle. The original read
+* past the k1 slots when k0 > 2*k1; the window stops at them instead, as the
+* engine's does.
+*
+* parameters:
+* int unit - FU class
+*
+* returns:
+* int - 1 if the class may issue
+*/
+static int checkAge(int unit){
+	int count = 0;
+	uint64_t window;
+
+	if (unit == 0){
+		window = (S->k0 < 2*S->k1) ? S->k0 : 2*S->k1;
+		for (uint64_t j = 0; j<window; j++){
+			if (S->inK1[j]!=NULL && S->inK1[j]->age == 1){
+				count++;
+			}
+			if (count>=(int)S->k0){
+				return 0;
+			}
+		}
+	}
+	if (unit == 1){
+		for (uint64_t j = 0; j<S->k1*2; j++){
+			if (S->inK1[j]!=NULL && S->inK1[j]->age == 2){
+				count++;
+			}
+			if (count>=(int)S->k1){
+				return 0;
+			}
+		}
+	}
+	if (unit == 2){
+		for (uint64_t j = 0; j<S->k2*2; j++){
+			if (S->inK2[j]!=NULL && S->inK2[j]->age == 3){
+				count++;
+			}
+			if (count>=(int)S->k2){
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+* scheduleUpdate
+* Wakes up sources whose tags are on the CDB
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void scheduleUpdate(){
+	refList* queues[3] = {&S->k0QueuePointers, &S->k1QueuePointers, &S->k2QueuePointers};
+
+	for (int q = 0; q < 3; q++){
+		for (refNode* updateNode = queues[q]->head; updateNode!=NULL; updateNode = updateNode->next){
+			for (int j = 0;j<S->CDBsize; j++){
+				if(S->CDB[j].tag==updateNode->src1Tag){
+					updateNode->src1Tag = READY;
+				}
+				if (S->CDB[j].tag==updateNode->src2Tag){
+					updateNode->src2Tag = READY;
+				}
+			}
+		}
+	}
+}
+
+/*
+* issueOne
+* Issues a queue's node to the first free slot of its class if it is ready
+*
+* parameters:
+* refNode* temp       - node, NULL past the end of the queue
+* refList* pointersIn - its queue
+* refNode** inK       - slots of the class
+* uint64_t slots      - number of slots
+* int unit            - FU class, also its latency
+*
+* returns:
+* none
+*/
+static void issueOne(refNode* temp, refList* pointersIn, refNode** inK, uint64_t slots, int unit){
+	if (temp!=NULL && pointersIn->availExec>0 && temp->src1Tag == READY && temp->src2Tag == READY &&
+		temp->age == READY && checkAge(unit)){
+		pointersIn->availExec--;
+		temp->age = unit + 1;
+
+		for (uint64_t j = 0; j<slots; j++){
+			if (inK[j]==NULL){
+				inK[j] = temp;
+				break;
+			}
+		}
+	}
+}
+
+/*
+* scheduleInstructionstoFU
+* Walks the three queues side by side, issuing ready instructions
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void scheduleInstructionstoFU(){
+	refNode* temp0 = S->k0QueuePointers.head;
+	refNode* temp1 = S->k1QueuePointers.head;
+	refNode* temp2 = S->k2QueuePointers.head;
+
+	while(temp0 != NULL || temp1 != NULL || temp2 != NULL ){
+		issueOne(temp0, &S->k0QueuePointers, S->inK0, S->k0, 0);
+		temp0 = (temp0 != NULL) ? temp0->next : NULL;
+		issueOne(temp1, &S->k1QueuePointers, S->inK1, S->k1*2, 1);
+		temp1 = (temp1 != NULL) ? temp1->next : NULL;
+		issueOne(temp2, &S->k2QueuePointers, S->inK2, S->k2*3, 2);
+		temp2 = (temp2 != NULL) ? temp2->next : NULL;
+	}
+}
+
+/*
+* updateReg
+* Marks registers ready whose newest producer just finished
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void updateReg(){
+	for (int i = 0; i < S->tempCDBsize; i++){
+		if (S->regFile[S->tempCDB[i].reg].tag == S->tempCDB[i].tag){
+			S->regFile[S->tempCDB[i].reg].tag = READY;
+		}
+	}
+}
+
+/*
+* removeFU
+* Frees the slots of finished instructions
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void removeFU(){
+	refList* queues[3] = {&S->k0QueuePointers, &S->k1QueuePointers, &S->k2QueuePointers};
+	refNode** inK[3] = {S->inK0, S->inK1, S->inK2};
+	uint64_t slots[3] = {S->k0, S->k1*2, S->k2*3};
+
+	for (int q = 0; q < 3; q++){
+		for (uint64_t j = 0; j<slots[q]; j++){
+			if (inK[q][j] != NULL && inK[q][j]->age == DONE){
+				queues[q]->availExec++;
+				inK[q][j] = NULL;
+			}
+		}
+	}
+}
+
+/*
+* incrementTimer
+* Ages the instructions in the FUs and collects the finished ones
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void incrementTimer(){
+	refNode** inK[3] = {S->inK0, S->inK1, S->inK2};
+	uint64_t slots[3] = {S->k0, S->k1*2, S->k2*3};
+
+	S->tempCDBsize = 0;
+	for (int q = 0; q < 3; q++){
+		for (uint64_t j= 0; j<slots[q]; j++){
+			refNode* temp = inK[q][j];
+			if (temp != NULL){
+				temp->age--;
+				if (temp->age == 0){
+					S->tempCDB[S->tempCDBsize].tag = temp->destTag;
+					S->tempCDB[S->tempCDBsize].ind = temp->ind;
+					S->tempCDB[S->tempCDBsize].FU = q;
+					S->tempCDB[S->tempCDBsize].line_number = temp->line_number;
+					S->tempCDB[S->tempCDBsize++].reg = temp->p_inst.dest_reg;
+					temp->state = S->cycle+1;
+					temp->age = DONE;
+				}
+			}
+		}
+	}
+}
+
+/*
+* orderCDB
+* Sorts the finished instructions by line number
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void orderCDB(){
+	refCDB swap;
+
+	for(int i=0; i<S->tempCDBsize; i++){
+		for(int j=i; j<S->tempCDBsize; j++){
+			if(S->tempCDB[i].line_number > S->tempCDB[j].line_number){
+				swap = S->tempCDB[i];
+				S->tempCDB[i] = S->tempCDB[j];
+				S->tempCDB[j] = swap;
+			}
+		}
+	}
+}
+
+/*
+* exchangeCDB
+* Broadcasts the finished instructions
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void exchangeCDB(){
+	for (int i = 0; i<S->tempCDBsize ;i++){
+		S->CDB[i] = S->tempCDB[i];
+	}
+	S->CDBsize = S->tempCDBsize;
+}
+
+/*
+* markROBDone
+* Mark instructions done in ROB
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void markROBDone(){
+	for (int i= 0; i < S->CDBsize; i++){
+		S->ROBTable[S->CDB[i].ind].done = 1;
+	}
+}
+
+/*
+* removeScheduler
+* Remove completed instructions from scheduler
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void removeScheduler(){
+	refList* queues[3] = {&S->k0QueuePointers, &S->k1QueuePointers, &S->k2QueuePointers};
+
+	for(int j = 0;j<S->CDBsize; j++){
+		refList* queue = queues[S->CDB[j].FU];
+		for (refNode* updateNode = queue->head; updateNode!=NULL; updateNode = updateNode->next){
+			if (S->CDB[j].tag==updateNode->destTag){
+				S->ROBTable[updateNode->ind].state = updateNode->state;
+				removeLL(queue, updateNode, TRUE);
+				break;
+			}
+		}
+	}
+}
+
+/*
+* retireInstructions
+* Retire completed instruction in ROB, a cycle after their state update
+*
+* parameters:
+* none
+*
+* returns:
+* none
+*/
+static void retireInstructions(){
+	int initHead = S->ROBPointers.head;
+
+	for (uint64_t i = 0; i<S->f; i++){
+		int indexROB = (initHead + i)%S->r;
+		if (S->ROBTable[indexROB].done == 1 && (S->cycle - S->ROBTable[indexROB].state)>0 && S->ROBPointers.size > 0){
+			removeROB();
+		}else{
+			break;
+		}
+	}
+
+	//all instructions done, none left waiting to dispatch either
+	if (S->readDoneFlag == 0 && statusROB()==EMPTY && S->dispatchPointers.head == NULL){
+		S->flag = 0;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////PIPELINE DRIVERS//////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* reference_create
+* Builds the original simulator for a k0/k1/k2 configuration
+*
+* parameters:
+* uint64_t r, k0, k1, k2, f, m - as for setup_proc
+* proc_source_fn source        - instruction source
+* void* context                - passed back to source
+*
+* returns:
+* reference_t* - simulator, freed by reference_free
+*/
+reference_t* reference_create(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f, uint64_t m,
+							  proc_source_fn source, void* context){
+	reference_t* ref = (reference_t*) calloc(1, sizeof(reference_t));
+
+	ref->r = r;
+	ref->k0 = k0;
+	ref->k1 = k1;
+	ref->k2 = k2;
+	ref->f = f;
+	ref->m = m;
+	ref->source = source;
+	ref->sourceContext = context;
+
+	for (int i = 0; i<32; i++){
+		ref->regFile[i].tag = READY;
+	}
+
+	ref->ROBTable = (refROB*) calloc(r, sizeof(refROB));
+	//One entry per FU slot, the original's k0+k1+k2+10 could overflow
+	ref->CDB = (refCDB*) malloc((k0+k1*2+k2*3+10)*sizeof(refCDB));
+	ref->tempCDB = (refCDB*) malloc((k0+k1*2+k2*3+10)*sizeof(refCDB));
+	ref->inK0 = (refNode**) calloc(k0+1, sizeof(refNode*));
+	ref->inK1 = (refNode**) calloc(k1*2+1, sizeof(refNode*));
+	ref->inK2 = (refNode**) calloc(k2*3+1, sizeof(refNode*));
+
+	ref->ROBPointers = {0,0,0};
+	ref->dispatchPointers = {NULL, NULL, (int)r      , (int)0};
+	ref->k0QueuePointers =  {NULL, NULL, (int)(m*k0) , (int)k0};
+	ref->k1QueuePointers =  {NULL, NULL, (int)(m*k1) , (int)k1*2};
+	ref->k2QueuePointers =  {NULL, NULL, (int)(m*k2) , (int)k2*3};
+
+	ref->readDoneFlag = 1;
+	ref->flag = 1;
+	return ref;
+}
+
+/*
+* reference_cycle
+* Simulates one clock cycle, the same half-cycle order as cycleProc
+*
+* parameters:
+* reference_t* ref - simulator
+*
+* returns:
+* bool - true while instructions remain
+*/
+bool reference_cycle(reference_t* ref){
+	S = ref;
+	if (!S->flag){
+		return false;
+	}
+
+	//////////////SECOND HALF OF CYCLE//////////////////////
+	removeScheduler();
+	retireInstructions();
+	exchangeCDB();
+	scheduleUpdate();
+	setUpRegs();
+	////////////////////////////////////////////////////////
+
+	S->cycle++;
+
+	//////////////FIRST HALF OF CYCLE///////////////////////
+	markROBDone();
+	incrementTimer();
+	updateReg();
+	removeFU();
+	orderCDB();
+	scheduleInstructionstoFU();
+	S->add0 = S->add1 = S->add2 = 0;
+	dispatchToScheduler();
+	fetchInstructions();
+	////////////////////////////////////////////////////////
+
+	return S->flag;
+}
+
+/*
+* reference_probe
+* Reads the ROB and CDB like probe_proc does for the engine
+*
+* parameters:
+* reference_t* ref     - simulator
+* proc_probe_t* probe  - receives the state, arrays of R entries
+*
+* returns:
+* none
+*/
+void reference_probe(reference_t* ref, proc_probe_t* probe){
+	probe->cycle = ref->cycle;
+	probe->running = ref->flag;
+	probe->rob_count = ref->ROBPointers.size;
+	for (int i = 0; i < ref->ROBPointers.size; i++){
+		refROB* entry = &ref->ROBTable[(ref->ROBPointers.head+i)%ref->r];
+		probe->rob[i].line_number = entry->line_number;
+		probe->rob[i].reg = entry->p_inst.dest_reg;
+		probe->rob[i].done = entry->done;
+	}
+	probe->cdb_count = ref->CDBsize;
+	for (int i = 0; i < ref->CDBsize; i++){
+		probe->cdb[i].line_number = ref->CDB[i].line_number;
+		probe->cdb[i].reg = ref->CDB[i].reg;
+		probe->cdb[i].done = 0;
+	}
+}
+
+/*
+* reference_free
+* Releases a simulator and the instructions still in it
+*
+* parameters:
+* reference_t* ref - simulator
+*
+* returns:
+* none
+*/
+void reference_free(reference_t* ref){
+	freeLL(&ref->dispatchPointers);
+	freeLL(&ref->k0QueuePointers);
+	freeLL(&ref->k1QueuePointers);
+	freeLL(&ref->k2QueuePointers);
+	free(ref->ROBTable);
+	free(ref->CDB);
+	free(ref->tempCDB);
+	free(ref->inK0);
+	free(ref->inK1);
+	free(ref->inK2);
+	free(ref);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////LOCK-STEP VALIDATION//////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+//Engine and reference stepping through one trace. The engine records every
+//instruction it fetches for the reference to replay, and publishes its state
+//after each cycle for the reference to compare against.
+typedef struct _validator{
+	proc_source_fn source;			//the trace, read by the engine only
+	void* sourceContext;
+	bool parallel;					//reference on its own thread
+	FILE* report;
+
+	//Fetched instructions not yet replayed, a ring
+	proc_inst_t* stream;
+	uint64_t capacity;
+	uint64_t written;
+	uint64_t replayed;
+
+	//Engine states not yet compared, a ring of VALIDATE_LAG probes
+	proc_probe_t probes[VALIDATE_LAG];
+	uint64_t published;				//engine cycles simulated
+	uint64_t checked;				//cycles both agree on
+	int64_t refCycle;				//cycle the reference is simulating
+
+	reference_t* ref;
+	proc_probe_t refProbe;
+	bool engineDone;
+	bool starved;					//reference waits for a state the engine cannot publish
+	bool diverged;
+	std::mutex lock;
+	std::condition_variable changed;
+} validator;
+
+/*
+* recordSource
+* Engine source: reads the trace and keeps each instruction for the reference.
+* With a reference thread it waits while the ring is full, without one a full
+* ring means the reference stopped fetching, a divergence.
+*
+* parameters:
+* proc_inst_t* p_inst - instruction to fill
+* void* context       - validator
+*
+* returns:
+* bool - false at the end of the trace
+*/
+static bool recordSource(proc_inst_t* p_inst, void* context){
+	validator* v = (validator*) context;
+
+	if (!v->source(p_inst, v->sourceContext)){
+		return false;
+	}
+
+	std::unique_lock<std::mutex> hold(v->lock);
+	while (v->parallel && v->written - v->replayed == v->capacity && !v->diverged && !v->starved){
+		v->changed.wait(hold);
+	}
+	if (v->written - v->replayed == v->capacity){
+		if (!v->diverged){
+			fprintf(v->report, "Divergence at cycle %" PRIu64 ": the reference fell %" PRIu64
+					" instructions behind the engine's fetch\n", v->published + 1, v->capacity);
+			v->diverged = true;
+			v->changed.notify_all();
+		}
+		return true;
+	}
+	v->stream[v->written % v->capacity] = *p_inst;
+	v->written++;
+	v->changed.notify_all();
+	return true;
+}
+
+/*
+* replaySource
+* Reference source: the instructions the engine fetched. Waits while the
+* engine has not yet simulated the reference's cycle; an instruction it did
+* not fetch by then is the end of the trace for the reference.
+*
+* parameters:
+* proc_inst_t* p_inst - instruction to fill
+* void* context       - validator
+*
+* returns:
+* bool - false when the engine fetched nothing more
+*/
+static bool replaySource(proc_inst_t* p_inst, void* context){
+	validator* v = (validator*) context;
+	std::unique_lock<std::mutex> hold(v->lock);
+
+	while (v->written == v->replayed && !v->engineDone && !v->diverged && (int64_t)v->published < v->refCycle){
+		v->changed.wait(hold);
+	}
+	if (v->written == v->replayed){
+		return false;
+	}
+	*p_inst = v->stream[v->replayed % v->capacity];
+	v->replayed++;
+	v->changed.notify_all();
+	return true;
+}
+
+/*
+* dumpEntries
+* Prints the engine's and the reference's entries side by side, marking the
+* ones that differ
+*
+* parameters:
+* FILE* out                       - report
+* const char* name                - ROB or CDB
+* const proc_probe_entry_t* mine  - engine entries
+* uint64_t mineCount
+* const proc_probe_entry_t* ref   - reference entries
+* uint64_t refCount
+*
+* returns:
+* none
+*/
+static void dumpEntries(FILE* out, const char* name, const proc_probe_entry_t* mine, uint64_t mineCount,
+						const proc_probe_entry_t* ref, uint64_t refCount){
+	uint64_t count = (mineCount > refCount) ? mineCount : refCount;
+
+	fprintf(out, "%s: engine %" PRIu64 " entries, reference %" PRIu64 "\n", name, mineCount, refCount);
+	fprintf(out, "\tINST\tREG\tDONE\t| INST\tREG\tDONE\n");
+	for (uint64_t i = 0; i < count && i < DUMP_ENTRIES; i++){
+		bool same = i < mineCount && i < refCount && mine[i].line_number == ref[i].line_number &&
+					mine[i].reg == ref[i].reg && mine[i].done == ref[i].done;
+		fprintf(out, "%c", same ? ' ' : '*');
+		if (i < mineCount){
+			fprintf(out, "\t%" PRId64 "\t%d\t%d\t|", mine[i].line_number, mine[i].reg, mine[i].done);
+		}else{
+			fprintf(out, "\t\t\t\t|");
+		}
+		if (i < refCount){
+			fprintf(out, " %" PRId64 "\t%d\t%d", ref[i].line_number, ref[i].reg, ref[i].done);
+		}
+		fprintf(out, "\n");
+	}
+	if (count > DUMP_ENTRIES){
+		fprintf(out, "\t... %" PRIu64 " more\n", count - DUMP_ENTRIES);
+	}
+}
+
+/*
+* sameEntries
+* Compares two runs of probe entries
+*
+* parameters:
+* const proc_probe_entry_t* a, b - entries
+* uint64_t count                 - entries in each
+*
+* returns:
+* bool - true if equal
+*/
+static bool sameEntries(const proc_probe_entry_t* a, const proc_probe_entry_t* b, uint64_t count){
+	for (uint64_t i = 0; i < count; i++){
+		if (a[i].line_number != b[i].line_number || a[i].reg != b[i].reg || a[i].done != b[i].done){
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+* compareProbes
+* Compares the engine's state after a cycle with the reference's and reports
+* the first difference with a dump of both
+*
+* parameters:
+* validator* v               - validator
+* const proc_probe_t* mine   - engine state
+* const proc_probe_t* ref    - reference state
+*
+* returns:
+* bool - true if they agree
+*/
+static bool compareProbes(validator* v, const proc_probe_t* mine, const proc_probe_t* ref){
+	const char* what = NULL;
+
+	if (mine->cycle != ref->cycle){
+		what = "cycle counters differ";
+	}else if (mine->running != ref->running){
+		what = mine->running ? "the reference drained first" : "the engine drained first";
+	}else if (mine->rob_count != ref->rob_count || !sameEntries(mine->rob, ref->rob, mine->rob_count)){
+		what = "ROB contents differ";
+	}else if (mine->cdb_count != ref->cdb_count || !sameEntries(mine->cdb, ref->cdb, mine->cdb_count)){
+		what = "CDB contents differ";
+	}
+	if (what == NULL){
+		return true;
+	}
+
+	fprintf(v->report, "Divergence at cycle %" PRId64 ": %s\n", mine->cycle, what);
+	fprintf(v->report, "Cycle: engine %" PRId64 ", reference %" PRId64 "\n", mine->cycle, ref->cycle);
+	dumpEntries(v->report, "ROB", mine->rob, mine->rob_count, ref->rob, ref->rob_count);
+	dumpEntries(v->report, "CDB", mine->cdb, mine->cdb_count, ref->cdb, ref->cdb_count);
+	return false;
+}
+
+/*
+* referenceStep
+* Simulates one reference cycle and compares it with the engine's state for
+* the same cycle, waiting for the engine to publish it
+*
+* parameters:
+* validator* v - validator
+*
+* returns:
+* bool - true while both keep running and agree
+*/
+static bool referenceStep(validator* v){
+	{
+		std::lock_guard<std::mutex> hold(v->lock);
+		v->refCycle = v->checked + 1;
+	}
+	reference_cycle(v->ref);
+	reference_probe(v->ref, &v->refProbe);
+
+	std::unique_lock<std::mutex> hold(v->lock);
+	while (v->published == v->checked && !v->engineDone && !v->diverged){
+		v->starved = true;
+		v->changed.notify_all();
+		v->changed.wait(hold);
+	}
+	v->starved = false;
+	if (v->diverged){
+		return false;
+	}
+	if (v->published == v->checked){
+		//The engine stopped without publishing this cycle, it drained earlier
+		fprintf(v->report, "Divergence at cycle %" PRIu64 ": the engine drained first\n", v->checked + 1);
+		v->diverged = true;
+		v->changed.notify_all();
+		return false;
+	}
+
+	proc_probe_t* mine = &v->probes[v->checked % VALIDATE_LAG];
+	bool same = compareProbes(v, mine, &v->refProbe);
+	v->diverged = !same;
+	v->checked++;
+	v->changed.notify_all();
+	return same && mine->running;
+}
+
+/*
+* referenceThread
+* Runs the reference to the end of the trace or the first divergence
+*
+* parameters:
+* validator* v - validator
+*
+* returns:
+* none
+*/
+static void referenceThread(validator* v){
+	while (referenceStep(v)){
+	}
+	std::lock_guard<std::mutex> hold(v->lock);
+	v->starved = true;
+	v->changed.notify_all();
+}
+
+/*
+* validate_config
+* Checks that a configuration is one the reference simulates: k0/k1/k2
+* classes with at least one unit each, one thread and none of the later
+* pipeline options. With no units of a class the reference waits forever.
+*
+* parameters:
+* const proc_config_t* config - processor configuration
+*
+* returns:
+* bool - true if the reference can validate it
+*/
+bool validate_config(const proc_config_t* config){
+	return config->classes == 0 && config->k0 > 0 && config->k1 > 0 && config->k2 > 0 && config->dispatch == 0 && config->cdb == 0 &&
+		   (config->retire == 0 || config->retire == config->f) && config->scheduler == PROC_SCHED_SPLIT &&
+		   config->policy == PROC_POLICY_OLDEST && config->issue == 0 && config->threads <= 1 &&
+		   config->predictor == PROC_PREDICT_NONE && config->l1.size == 0;
+}
+
+/*
+* validate_proc
+* Runs the calling thread's processor to the end of a trace one cycle at a
+* time, with the reference simulating the same instructions in lock-step, and
+* compares their ROB and CDB after every cycle. The processor must have been
+* set up from config by configure_proc, without stop criteria; this replaces
+* its run_proc loop, run_proc and complete_proc then finish as usual.
+*
+* parameters:
+* const proc_config_t* config - configuration the processor was set up from
+* proc_source_fn source       - the trace
+* void* context               - passed back to source
+* bool parallel               - run the reference on a second thread
+* FILE* report                - receives the state of both at a divergence
+*
+* returns:
+* bool - true if they agreed on every cycle
+*/
+bool validate_proc(const proc_config_t* config, proc_source_fn source, void* context, bool parallel, FILE* report){
+	validator* v = new validator();
+	proc_probe_entry_t* entries;
+	std::thread worker;
+	bool ok;
+
+	v->source = source;
+	v->sourceContext = context;
+	v->parallel = parallel;
+	v->report = report;
+	v->capacity = 4*config->r + (VALIDATE_LAG+2)*config->f + 1024;
+	v->stream = (proc_inst_t*) malloc(v->capacity*sizeof(proc_inst_t));
+
+	//Each probe and the reference's own get an R-entry ROB and CDB
+	entries = (proc_probe_entry_t*) malloc((VALIDATE_LAG+1)*2*(config->r+1)*sizeof(proc_probe_entry_t));
+	for (int i = 0; i <= VALIDATE_LAG; i++){
+		proc_probe_t* probe = (i < VALIDATE_LAG) ? &v->probes[i] : &v->refProbe;
+		probe->rob = entries + 2*i*(config->r+1);
+		probe->cdb = probe->rob + config->r+1;
+	}
+
+	v->ref = reference_create(config->r, config->k0, config->k1, config->k2, config->f, config->m, replaySource, v);
+	set_source_proc(recordSource, v);
+	if (parallel){
+		worker = std::thread(referenceThread, v);
+	}
+
+	for (bool more = true; more; ){
+		more = step_proc(1);
+
+		std::unique_lock<std::mutex> hold(v->lock);
+		while (v->published - v->checked == VALIDATE_LAG && !v->diverged){
+			v->changed.wait(hold);
+		}
+		if (v->diverged){
+			break;
+		}
+		hold.unlock();
+		probe_proc(&v->probes[v->published % VALIDATE_LAG]);
+		hold.lock();
+		v->published++;
+		v->changed.notify_all();
+		hold.unlock();
+
+		if (!parallel && !referenceStep(v)){
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> hold(v->lock);
+		v->engineDone = true;
+		v->changed.notify_all();
+	}
+	if (parallel){
+		worker.join();
+	}
+	ok = !v->diverged;
+
+	reference_free(v->ref);
+	free(entries);
+	free(v->stream);
+	delete v;
+	return ok;
+}
@@ -0,0 +1,24 @@
+#ifndef PROCSIM_REFERENCE_HPP
+#define PROCSIM_REFERENCE_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Snapshots the engine may run ahead of the reference when validating on two threads
+#define VALIDATE_LAG 64
+
+typedef struct _reference_t reference_t;
+
+//The original simulator, kept as the model the engine is validated against.
+//It only knows the k0/k1/k2 configuration of setup_proc and one trace.
+reference_t* reference_create(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f, uint64_t m,
+                              proc_source_fn source, void* context);
+bool reference_cycle(reference_t* ref);
+void reference_probe(reference_t* ref, proc_probe_t* probe);
+void reference_free(reference_t* ref);
+
+bool validate_config(const proc_config_t* config);
+bool validate_proc(const proc_config_t* config, proc_source_fn source, void* context, bool parallel, FILE* report);
+
+#endif /* PROCSIM_REFERENCE_HPP */
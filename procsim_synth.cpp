@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "procsim_synth.hpp"
+#include "procsim_trace.hpp"
+
+//Bytes formatted before each write
+#define SYNTH_BUFFER (1 << 20)
+
+//Longest text line written, address, four fields, an outcome, a target and a data address
+#define SYNTH_LINE 96
+
+//Code and data regions of the generated addresses
+#define SYNTH_CODE_BASE 0x10000
+#define SYNTH_CODE_SIZE 0x10000
+#define SYNTH_DATA_BASE 0x10000000
+
+//Binary data_address of an instruction without a data access
+#define NO_ADDRESS UINT32_MAX
+
+/*
+* nextRandom
+* Advances the xorshift64* generator
+*
+* parameters:
+* synth_t* gen - generator
+*
+* returns:
+* uint64_t - 64 random bits
+*/
+static inline uint64_t nextRandom(synth_t* gen){
+	gen->state ^= gen->state >> 12;
+	gen->state ^= gen->state << 25;
+	gen->state ^= gen->state >> 27;
+	return gen->state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+* pick
+* Scales 8 random bits to a range without a division
+*
+* parameters:
+* uint64_t bits - random bits, the low 8 are used
+* uint32_t n    - size of the range, at most 256
+*
+* returns:
+* uint32_t - value in [0, n)
+*/
+static inline uint32_t pick(uint64_t bits, uint32_t n){
+	return ((bits & 0xff) * n) >> 8;
+}
+
+/*
+* cut
+* Threshold on 32 random bits taken with a probability
+*
+* parameters:
+* double p - probability, clamped to [0, 1]
+*
+* returns:
+* uint32_t - values below it occur with probability p
+*/
+static uint32_t cut(double p){
+	if (p <= 0){
+		return 0;
+	}
+	if (p >= 1){
+		return UINT32_MAX;
+	}
+	return (uint32_t)(p * 4294967296.0);
+}
+
+/*
+* putHex
+* Formats a value in lower case hex without leading zeros
+*
+* parameters:
+* char* out      - buffer
+* uint32_t value - value
+*
+* returns:
+* char* - one past the last digit
+*/
+static inline char* putHex(char* out, uint32_t value){
+	char digits[8];
+	int n = 0;
+
+	do{
+		digits[n++] = "0123456789abcdef"[value & 0xf];
+		value >>= 4;
+	}while (value != 0);
+	while (n > 0){
+		*out++ = digits[--n];
+	}
+	return out;
+}
+
+/*
+* putInt
+* Formats a small signed value in decimal
+*
+* parameters:
+* char* out     - buffer
+* int32_t value - value, at least -1
+*
+* returns:
+* char* - one past the last digit
+*/
+static inline char* putInt(char* out, int32_t value){
+	if (value < 0){
+		*out++ = '-';
+		value = -value;
+	}
+	if (value >= 100){
+		out = putInt(out, value / 100);
+		value %= 100;
+		*out++ = '0' + value / 10;
+	}else if (value >= 10){
+		*out++ = '0' + value / 10;
+	}
+	*out++ = '0' + value % 10;
+	return out;
+}
+
+/*
+* synth_defaults
+* Fills a configuration with the shape of the bundled gcc trace: a million
+* instructions, its opcode mix, a mean dependency distance of 8 over all 32
+* registers, no branch outcomes and no data addresses
+*
+* parameters:
+* synth_config_t* config - configuration
+*
+* returns:
+* none
+*/
+void synth_defaults(synth_config_t* config){
+	memset(config, 0, sizeof(synth_config_t));
+	config->instructions = 1000000;
+	config->seed = 1;
+	config->mix[0] = 22;
+	config->mix[1] = 54;
+	config->mix[2] = 8;
+	config->mix[3] = 16;
+	config->distance = 8;
+	config->registers = 32;
+	config->sources = 0.7;
+	config->taken = 0.6;
+	config->footprint = 1 << 20;
+}
+
+/*
+* synth_init
+* Prepares a generator, sampling tables included, for a configuration
+*
+* parameters:
+* synth_t* gen                 - generator
+* const synth_config_t* config - shape of the trace
+*
+* returns:
+* none
+*/
+void synth_init(synth_t* gen, const synth_config_t* config){
+	double total = 0;
+	double sum = 0;
+	double p;
+	int op = 0;
+
+	memset(gen, 0, sizeof(synth_t));
+	gen->config = *config;
+	if (gen->config.registers < 1 || gen->config.registers > 32){
+		gen->config.registers = 32;
+	}
+	if (gen->config.distance < 1){
+		gen->config.distance = 1;
+	}
+	if (gen->config.footprint < 4){
+		gen->config.footprint = 4;
+	}
+	gen->state = config->seed * 0x9E3779B97F4A7C15ULL + 1;
+	gen->pc = SYNTH_CODE_BASE;
+
+	//Opcode of the slice each entry falls in
+	for (int i = 0; i < SYNTH_OPCODES; i++){
+		total += (config->mix[i] > 0) ? config->mix[i] : 0;
+	}
+	if (total <= 0){
+		gen->config.mix[1] = total = 1;
+	}
+	sum = (gen->config.mix[0] > 0) ? gen->config.mix[0] : 0;
+	for (int i = 0; i < SYNTH_TABLE; i++){
+		while (op < SYNTH_OPCODES - 1 && (i + 0.5) / SYNTH_TABLE > sum / total){
+			op++;
+			sum += (gen->config.mix[op] > 0) ? gen->config.mix[op] : 0;
+		}
+		gen->opTable[i] = op - 1;
+	}
+
+	//Geometric distances, P(d) = p(1-p)^(d-1), the tail folded into the longest
+	p = 1.0 / gen->config.distance;
+	for (int i = 0, d = 1; i < SYNTH_TABLE; i++){
+		while (d < SYNTH_MAX_DISTANCE && (i + 0.5) / SYNTH_TABLE > 1 - pow(1 - p, d)){
+			d++;
+		}
+		gen->distanceTable[i] = d;
+	}
+
+	for (int i = 0; i < SYNTH_MAX_DISTANCE; i++){
+		gen->recent[i] = nextRandom(gen) % gen->config.registers;
+	}
+	gen->sourceCut = cut(config->sources);
+	gen->branchCut = cut(config->branches);
+	gen->takenCut = cut(config->taken);
+	gen->memoryCut = cut(config->memory);
+}
+
+/*
+* synth_next
+* Generates the next instruction. Each source reads the destination of an
+* instruction a sampled distance back, or a random register when that one
+* wrote none. Branches jump to a fixed target per address inside a small code
+* region, so predictors see recurring branches with a biased outcome.
+*
+* parameters:
+* synth_t* gen        - generator
+* proc_inst_t* p_inst - instruction to fill
+*
+* returns:
+* bool - false once the configured length was produced
+*/
+bool synth_next(synth_t* gen, proc_inst_t* p_inst){
+	uint64_t bits;
+	uint64_t more;
+	uint32_t pc = gen->pc;
+
+	if (gen->produced >= gen->config.instructions){
+		return false;
+	}
+	bits = nextRandom(gen);
+	more = nextRandom(gen);
+
+	p_inst->instruction_address = pc;
+	p_inst->op_code = gen->opTable[bits % SYNTH_TABLE];
+	p_inst->dest_reg = pick(bits >> 12, gen->config.registers);
+	//Both sources are computed whether used or not, selects instead of
+	//unpredictable branches
+	for (int i = 0; i < 2; i++){
+		uint32_t roll = (uint32_t)(more >> (32*i));
+		uint32_t d = gen->distanceTable[(bits >> (20 + 12*i)) % SYNTH_TABLE];
+		int32_t reg = gen->recent[(gen->produced - d) % SYNTH_MAX_DISTANCE];
+		int32_t other = pick(roll >> 8, gen->config.registers);
+		reg = (reg < 0) ? other : reg;
+		p_inst->src_reg[i] = (roll < gen->sourceCut) ? reg : -1;
+	}
+	p_inst->branch = PROC_BRANCH_NONE;
+	p_inst->branch_target = 0;
+	p_inst->memory = 0;
+	p_inst->data_address = 0;
+
+	//Branches and data accesses are decided by the top 20 bits
+	pc += 4;
+	if ((uint32_t)(bits >> 44) << 12 < gen->branchCut){
+		uint32_t target = SYNTH_CODE_BASE + ((pc * 2654435761u) % SYNTH_CODE_SIZE & ~3u);
+		bool taken = (uint32_t)nextRandom(gen) < gen->takenCut;
+		p_inst->dest_reg = -1;
+		p_inst->branch = taken ? PROC_BRANCH_TAKEN : PROC_BRANCH_NOT_TAKEN;
+		p_inst->branch_target = target;
+		if (taken){
+			pc = target;
+		}
+	}else if (((uint32_t)(bits >> 44) << 12) - gen->branchCut < gen->memoryCut){
+		p_inst->memory = 1;
+		p_inst->data_address = SYNTH_DATA_BASE + ((nextRandom(gen) % gen->config.footprint) & ~3u);
+	}
+	if (pc >= SYNTH_CODE_BASE + SYNTH_CODE_SIZE){
+		pc = SYNTH_CODE_BASE;
+	}
+	gen->pc = pc;
+
+	gen->recent[gen->produced % SYNTH_MAX_DISTANCE] = p_inst->dest_reg;
+	gen->produced++;
+	return true;
+}
+
+/*
+* synth_write
+* Streams the rest of a generated trace, formatting into a large buffer
+* between writes. Text lines carry branch outcomes and data addresses when
+* the configuration produces them; binary records carry only the fields the
+* configuration uses.
+*
+* parameters:
+* synth_t* gen - generator
+* FILE* out    - output
+* bool binary  - binary records instead of text lines
+*
+* returns:
+* uint64_t - instructions written
+*/
+uint64_t synth_write(synth_t* gen, FILE* out, bool binary){
+	char* buffer = (char*) malloc(SYNTH_BUFFER);
+	char* at = buffer;
+	proc_inst_t inst;
+	uint64_t count = 0;
+	size_t size = TRACE_RECORD_BASE;
+
+	if (binary){
+		trace_binary_header_t header;
+		memcpy(header.magic, TRACE_BINARY_MAGIC, 4);
+		header.version = TRACE_BINARY_VERSION;
+		header.flags = 0;
+		if (gen->config.branches > 0 || gen->config.memory > 0){
+			header.flags |= TRACE_FLAG_BRANCH;
+			size = offsetof(trace_binary_record_t, data_address);
+		}
+		if (gen->config.memory > 0){
+			header.flags |= TRACE_FLAG_ADDRESS;
+			size = sizeof(trace_binary_record_t);
+		}
+		header.record_size = size;
+		fwrite(&header, sizeof(header), 1, out);
+	}
+
+	while (synth_next(gen, &inst)){
+		if (binary){
+			trace_binary_record_t record;
+			record.instruction_address = inst.instruction_address;
+			record.op_code = inst.op_code;
+			record.dest_reg = inst.dest_reg;
+			record.src_reg[0] = inst.src_reg[0];
+			record.src_reg[1] = inst.src_reg[1];
+			record.branch = inst.branch;
+			record.branch_target = inst.branch_target;
+			record.data_address = inst.memory ? inst.data_address : NO_ADDRESS;
+			//The buffer keeps room for a whole record, the unused fields are overwritten next
+			memcpy(at, &record, sizeof(record));
+			at += size;
+		}else{
+			at = putHex(at, inst.instruction_address);
+			*at++ = ' ';
+			at = putInt(at, inst.op_code);
+			*at++ = ' ';
+			at = putInt(at, inst.dest_reg);
+			*at++ = ' ';
+			at = putInt(at, inst.src_reg[0]);
+			*at++ = ' ';
+			at = putInt(at, inst.src_reg[1]);
+			if (inst.branch != PROC_BRANCH_NONE){
+				*at++ = ' ';
+				*at++ = (inst.branch == PROC_BRANCH_TAKEN) ? '1' : '0';
+				*at++ = ' ';
+				at = putHex(at, inst.branch_target);
+			}
+			if (inst.memory){
+				*at++ = ' ';
+				*at++ = '@';
+				at = putHex(at, inst.data_address);
+			}
+			*at++ = '\n';
+		}
+		count++;
+
+		if (at - buffer > SYNTH_BUFFER - SYNTH_LINE){
+			fwrite(buffer, 1, at - buffer, out);
+			at = buffer;
+		}
+	}
+	fwrite(buffer, 1, at - buffer, out);
+	free(buffer);
+
+	return count;
+}
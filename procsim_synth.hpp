@@ -0,0 +1,52 @@
+#ifndef PROCSIM_SYNTH_HPP
+#define PROCSIM_SYNTH_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Opcodes the mix can weigh, -1 up to PROC_MAX_OPCODE
+#define SYNTH_OPCODES (PROC_MAX_OPCODE + 2)
+
+//Entries of the lookup tables sampling the opcode mix and the dependency distance
+#define SYNTH_TABLE 4096
+
+//Longest dependency distance, instructions back to the producer of a source
+#define SYNTH_MAX_DISTANCE 256
+
+//Shape of a synthetic trace
+typedef struct _synth_config_t
+{
+    uint64_t instructions;          //length of the trace
+    uint64_t seed;                  //same seed and shape, same trace
+    double mix[SYNTH_OPCODES];      //relative weight of opcodes -1, 0, 1, ...
+    double distance;                //mean dependency distance, geometric, at least 1
+    uint32_t registers;             //architectural registers written, 1 to 32
+    double sources;                 //probability each source register is used
+    double branches;                //fraction of branches, 0 without outcomes
+    double taken;                   //probability a branch is taken
+    double memory;                  //fraction of instructions accessing data
+    uint64_t footprint;             //bytes of data addresses touched
+} synth_config_t;
+
+typedef struct _synth_t
+{
+    synth_config_t config;
+    uint64_t state;                 //xorshift generator
+    uint64_t produced;
+    uint32_t pc;
+    int8_t opTable[SYNTH_TABLE];    //opcode of each slice of the mix
+    uint16_t distanceTable[SYNTH_TABLE];    //distance of each slice of the distribution
+    int8_t recent[SYNTH_MAX_DISTANCE];      //destination of the latest instructions, a ring
+    uint32_t sourceCut;             //thresholds on 32 random bits
+    uint32_t branchCut;
+    uint32_t takenCut;
+    uint32_t memoryCut;
+} synth_t;
+
+void synth_defaults(synth_config_t* config);
+void synth_init(synth_t* gen, const synth_config_t* config);
+bool synth_next(synth_t* gen, proc_inst_t* p_inst);
+uint64_t synth_write(synth_t* gen, FILE* out, bool binary);
+
+#endif /* PROCSIM_SYNTH_HPP */
@@ -0,0 +1,523 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "procsim_trace.hpp"
+
+//Longest text trace line accepted
+#define LINE_LENGTH 256
+
+//Binary data_address of an instruction without a data access
+#define NO_ADDRESS UINT32_MAX
+
+//Header of a sidecar index file
+typedef struct _indexHeader{
+	char magic[4];
+	uint32_t version;
+	uint64_t stride;
+	uint64_t traceSize;
+	uint64_t traceTime;		//modification time of the trace in ns
+	uint64_t instructions;
+	uint64_t entries;
+} indexHeader;
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////TEXT PARSING//////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* isBlank
+* Checks whether a line holds only whitespace
+*
+* parameters:
+* const char* line - line to check
+*
+* returns:
+* bool - true if blank
+*/
+static bool isBlank(const char* line){
+	while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n'){
+		line++;
+	}
+	return *line == '\0';
+}
+
+/*
+* validRegister
+* Checks a register field of a trace instruction
+*
+* parameters:
+* int32_t reg - register, -1 for none
+*
+* returns:
+* bool - true if -1 or in the register file
+*/
+static bool validRegister(int32_t reg){
+	return reg >= -1 && reg < PROC_REGISTERS;
+}
+
+/*
+* parseLine
+* Parses "<hex address> <op> <dest> <src1> <src2>", optionally followed by
+* "<taken> <hex target>" for a branch with a known outcome and then by
+* "@<hex address>" for an instruction that accesses data
+*
+* parameters:
+* const char* line    - text line
+* proc_inst_t* p_inst - instruction to fill
+*
+* returns:
+* bool - true if the five required fields were present and the registers
+* are -1 or in the register file
+*/
+static bool parseLine(const char* line, proc_inst_t* p_inst){
+	char* end;
+
+	p_inst->instruction_address = strtoul(line, &end, 16);
+	if (end == line){
+		return false;
+	}
+	line = end;
+	p_inst->op_code = strtol(line, &end, 10);
+	if (end == line){
+		return false;
+	}
+	line = end;
+	p_inst->dest_reg = strtol(line, &end, 10);
+	if (end == line){
+		return false;
+	}
+	line = end;
+	p_inst->src_reg[0] = strtol(line, &end, 10);
+	if (end == line){
+		return false;
+	}
+	line = end;
+	p_inst->src_reg[1] = strtol(line, &end, 10);
+	if (end == line){
+		return false;
+	}
+	if (!validRegister(p_inst->dest_reg) || !validRegister(p_inst->src_reg[0]) || !validRegister(p_inst->src_reg[1])){
+		return false;
+	}
+
+	//Branch outcome and target
+	p_inst->branch = PROC_BRANCH_NONE;
+	p_inst->branch_target = 0;
+	line = end;
+	long taken = strtol(line, &end, 10);
+	if (end != line){
+		p_inst->branch = taken ? PROC_BRANCH_TAKEN : PROC_BRANCH_NOT_TAKEN;
+		line = end;
+		p_inst->branch_target = strtoul(line, &end, 16);
+		line = end;
+	}
+
+	//Data address
+	p_inst->memory = 0;
+	p_inst->data_address = 0;
+	while (*line == ' ' || *line == '\t'){
+		line++;
+	}
+	if (*line == '@'){
+		p_inst->data_address = strtoul(line + 1, &end, 16);
+		p_inst->memory = (end != line + 1);
+	}
+
+	return true;
+}
+
+/*
+* fileSize
+* Size of an open file in bytes
+*
+* parameters:
+* FILE* file - file to measure
+*
+* returns:
+* uint64_t - size, 0 if unknown
+*/
+static uint64_t fileSize(FILE* file){
+	struct stat st;
+
+	if (fstat(fileno(file), &st) != 0){
+		return 0;
+	}
+	return st.st_size;
+}
+
+/*
+* fileTime
+* Last modification time of an open file
+*
+* parameters:
+* FILE* file - file to check
+*
+* returns:
+* uint64_t - nanoseconds since the epoch, 0 if unknown
+*/
+static uint64_t fileTime(FILE* file){
+	struct stat st;
+
+	if (fstat(fileno(file), &st) != 0){
+		return 0;
+	}
+	return (uint64_t)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////INDEX/////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* indexPath
+* Name of the sidecar index for a trace
+*
+* parameters:
+* const char* path - trace file
+* char* out        - buffer for the index name
+* size_t size      - size of the buffer
+*
+* returns:
+* none
+*/
+static void indexPath(const char* path, char* out, size_t size){
+	snprintf(out, size, "%s.idx", path);
+}
+
+/*
+* loadIndex
+* Loads the sidecar index if it matches the trace: same size and modification
+* time as when it was built, and one entry per stride of its instruction count
+*
+* parameters:
+* trace_t* trace   - open text trace
+* const char* path - trace file
+*
+* returns:
+* none
+*/
+static void loadIndex(trace_t* trace, const char* path){
+	char name[4096];
+	indexHeader header;
+	FILE* in;
+
+	indexPath(path, name, sizeof(name));
+	in = fopen(name, "rb");
+	if (in == NULL){
+		return;
+	}
+
+	//Ignore an index written for a different version of the trace
+	if (fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, TRACE_INDEX_MAGIC, 4) == 0 &&
+		header.version == TRACE_INDEX_VERSION && header.stride > 0 && header.traceSize == fileSize(trace->file) &&
+		header.traceTime == fileTime(trace->file) && header.entries <= header.traceSize &&
+		header.entries == header.instructions/header.stride + (header.instructions % header.stride != 0)){
+		trace->offsets = (uint64_t*) malloc(header.entries*sizeof(uint64_t));
+		if (trace->offsets != NULL && fread(trace->offsets, sizeof(uint64_t), header.entries, in) == header.entries){
+			trace->stride = header.stride;
+			trace->entries = header.entries;
+			trace->length = header.instructions;
+		}else{
+			free(trace->offsets);
+			trace->offsets = NULL;
+		}
+	}
+	fclose(in);
+}
+
+/*
+* trace_build_index
+* Writes <path>.idx with the byte offset of every stride-th instruction of a
+* text trace in one streaming pass
+*
+* parameters:
+* const char* path - text trace
+* uint64_t stride  - instructions between entries
+*
+* returns:
+* bool - true on success
+*/
+bool trace_build_index(const char* path, uint64_t stride){
+	char name[4096];
+	char tempName[4096+8];
+	char line[LINE_LENGTH];
+	proc_inst_t inst;
+	indexHeader header;
+	uint64_t offset = 0;
+	uint64_t count = 0;
+	FILE* in;
+	FILE* out;
+
+	if (stride == 0){
+		return false;
+	}
+	in = fopen(path, "rb");
+	if (in == NULL){
+		return false;
+	}
+
+	indexPath(path, name, sizeof(name));
+	snprintf(tempName, sizeof(tempName), "%s.tmp", name);
+	out = fopen(tempName, "wb");
+	if (out == NULL){
+		fclose(in);
+		return false;
+	}
+
+	//Header is rewritten once the entry count is known
+	memcpy(header.magic, TRACE_INDEX_MAGIC, 4);
+	header.version = TRACE_INDEX_VERSION;
+	header.stride = stride;
+	header.traceSize = fileSize(in);
+	header.traceTime = fileTime(in);
+	header.instructions = 0;
+	header.entries = 0;
+	fwrite(&header, sizeof(header), 1, out);
+
+	while (fgets(line, sizeof(line), in) != NULL){
+		size_t length = strlen(line);
+		if (!isBlank(line)){
+			if (!parseLine(line, &inst)){
+				break;
+			}
+			if (count % stride == 0){
+				fwrite(&offset, sizeof(uint64_t), 1, out);
+				header.entries++;
+			}
+			count++;
+		}
+		offset += length;
+	}
+	fclose(in);
+
+	header.instructions = count;
+	fseek(out, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, out);
+	if (fclose(out) != 0 || rename(tempName, name) != 0){
+		return false;
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////TRACE SOURCE//////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+/*
+* trace_open
+* Opens a text or binary trace, detecting the format from its first byte
+*
+* parameters:
+* const char* path - trace file, NULL for stdin
+*
+* returns:
+* trace_t* - open trace, NULL on failure
+*/
+trace_t* trace_open(const char* path){
+	trace_t* trace;
+	FILE* file;
+	int first;
+
+	file = (path == NULL) ? stdin : fopen(path, "rb");
+	if (file == NULL){
+		return NULL;
+	}
+
+	trace = (trace_t*) calloc(1, sizeof(trace_t));
+	trace->file = file;
+	trace->seekable = (path != NULL) || (ftell(file) >= 0);
+	trace->length = TRACE_LENGTH_UNKNOWN;
+
+	//Text traces start with a hex digit or whitespace, never 'P'
+	first = getc(file);
+	if (first != EOF){
+		ungetc(first, file);
+	}
+	if (first == TRACE_BINARY_MAGIC[0]){
+		trace_binary_header_t header;
+		if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_BINARY_MAGIC, 4) != 0 ||
+			header.version != TRACE_BINARY_VERSION || header.record_size < TRACE_RECORD_BASE ||
+			((header.flags & TRACE_FLAG_BRANCH) && header.record_size < offsetof(trace_binary_record_t, branch_target) + 4) ||
+			((header.flags & TRACE_FLAG_ADDRESS) && header.record_size < offsetof(trace_binary_record_t, data_address) + 4)){
+			trace_close(trace);
+			return NULL;
+		}
+		trace->binary = true;
+		trace->record_size = header.record_size;
+		trace->flags = header.flags;
+		if (trace->seekable){
+			trace->length = (fileSize(file) - sizeof(header)) / header.record_size;
+		}
+	}else if (path != NULL){
+		loadIndex(trace, path);
+	}
+
+	return trace;
+}
+
+/*
+* trace_close
+* Closes a trace opened by trace_open
+*
+* parameters:
+* trace_t* trace - trace to close
+*
+* returns:
+* none
+*/
+void trace_close(trace_t* trace){
+	if (trace->file != stdin){
+		fclose(trace->file);
+	}
+	free(trace->offsets);
+	free(trace);
+}
+
+/*
+* trace_read
+* Reads the next instruction, a malformed one ends the trace
+*
+* parameters:
+* trace_t* trace      - open trace
+* proc_inst_t* p_inst - instruction to fill
+*
+* returns:
+* bool - true if an instruction was read
+*/
+bool trace_read(trace_t* trace, proc_inst_t* p_inst){
+	if (trace->binary){
+		char record[256];
+		trace_binary_record_t* fields = (trace_binary_record_t*) record;
+		size_t size = trace->record_size < sizeof(record) ? trace->record_size : sizeof(record);
+
+		if (fread(record, size, 1, trace->file) != 1){
+			return false;
+		}
+		if (size < trace->record_size){
+			fseek(trace->file, trace->record_size - size, SEEK_CUR);
+		}
+		p_inst->instruction_address = fields->instruction_address;
+		p_inst->op_code = fields->op_code;
+		p_inst->dest_reg = fields->dest_reg;
+		p_inst->src_reg[0] = fields->src_reg[0];
+		p_inst->src_reg[1] = fields->src_reg[1];
+		if (!validRegister(p_inst->dest_reg) || !validRegister(p_inst->src_reg[0]) || !validRegister(p_inst->src_reg[1])){
+			return false;
+		}
+		p_inst->branch = PROC_BRANCH_NONE;
+		p_inst->branch_target = 0;
+		p_inst->memory = 0;
+		p_inst->data_address = 0;
+		if (trace->flags & TRACE_FLAG_BRANCH){
+			p_inst->branch = fields->branch;
+			p_inst->branch_target = fields->branch_target;
+		}
+		if ((trace->flags & TRACE_FLAG_ADDRESS) && fields->data_address != NO_ADDRESS){
+			p_inst->memory = 1;
+			p_inst->data_address = fields->data_address;
+		}
+	}else{
+		char line[LINE_LENGTH];
+		do{
+			if (fgets(line, sizeof(line), trace->file) == NULL){
+				return false;
+			}
+		}while (isBlank(line));
+		if (!parseLine(line, p_inst)){
+			return false;
+		}
+	}
+
+	trace->position++;
+	return true;
+}
+
+/*
+* trace_seek
+* Positions the trace so the next read returns instruction n (0 based). Binary
+* traces compute the offset directly; text traces jump to the nearest indexed
+* instruction and skip fewer than stride lines.
+*
+* parameters:
+* trace_t* trace - open trace
+* uint64_t n     - instruction to read next
+*
+* returns:
+* bool - true if the trace holds at least n instructions
+*/
+bool trace_seek(trace_t* trace, uint64_t n){
+	proc_inst_t skipped;
+
+	if (trace->binary && trace->seekable){
+		//fseek succeeds past the end of the file, so check the record count first
+		if (n > trace->length || fseek(trace->file, sizeof(trace_binary_header_t) + n*trace->record_size, SEEK_SET) != 0){
+			return false;
+		}
+		trace->position = n;
+		return true;
+	}
+
+	if (trace->seekable && trace->entries > 0){
+		uint64_t entry = n / trace->stride;
+		if (entry >= trace->entries){
+			entry = trace->entries - 1;
+		}
+		if (fseek(trace->file, trace->offsets[entry], SEEK_SET) != 0){
+			return false;
+		}
+		trace->position = entry * trace->stride;
+	}else if (trace->seekable && n < trace->position){
+		//No index: rescan from the start
+		fseek(trace->file, 0, SEEK_SET);
+		trace->position = 0;
+		if (trace->binary){
+			fseek(trace->file, sizeof(trace_binary_header_t), SEEK_SET);
+		}
+	}
+
+	while (trace->position < n){
+		if (!trace_read(trace, &skipped)){
+			return false;
+		}
+	}
+
+	return trace->position == n;
+}
+
+/*
+* trace_write_binary
+* Copies the rest of a trace to out in binary format
+*
+* parameters:
+* trace_t* trace - open trace
+* FILE* out      - binary output
+*
+* returns:
+* uint64_t - instructions written
+*/
+uint64_t trace_write_binary(trace_t* trace, FILE* out){
+	trace_binary_header_t header;
+	trace_binary_record_t record;
+	proc_inst_t inst;
+	uint64_t count = 0;
+
+	memcpy(header.magic, TRACE_BINARY_MAGIC, 4);
+	header.version = TRACE_BINARY_VERSION;
+	header.record_size = sizeof(trace_binary_record_t);
+	header.flags = TRACE_FLAG_BRANCH | TRACE_FLAG_ADDRESS;
+	fwrite(&header, sizeof(header), 1, out);
+
+	while (trace_read(trace, &inst)){
+		record.instruction_address = inst.instruction_address;
+		record.op_code = inst.op_code;
+		record.dest_reg = inst.dest_reg;
+		record.src_reg[0] = inst.src_reg[0];
+		record.src_reg[1] = inst.src_reg[1];
+		record.branch = inst.branch;
+		record.branch_target = inst.branch_target;
+		record.data_address = inst.memory ? inst.data_address : NO_ADDRESS;
+		fwrite(&record, sizeof(record), 1, out);
+		count++;
+	}
+
+	return count;
+}
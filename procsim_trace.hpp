@@ -0,0 +1,68 @@
+#ifndef PROCSIM_TRACE_HPP
+#define PROCSIM_TRACE_HPP
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include "procsim.hpp"
+
+//Binary trace: 16 byte header followed by fixed size records
+#define TRACE_BINARY_MAGIC   "PSTB"
+#define TRACE_BINARY_VERSION 1
+
+//Optional record fields, present when the header flags name them
+#define TRACE_FLAG_BRANCH    0x1    //branch and branch_target follow src_reg
+#define TRACE_FLAG_ADDRESS   0x2    //data_address follows them, UINT32_MAX for none
+
+//Sidecar index for text traces, stored at <trace>.idx
+#define TRACE_INDEX_MAGIC    "PSIX"
+#define TRACE_INDEX_VERSION  2
+#define DEFAULT_INDEX_STRIDE 1024
+
+#define TRACE_LENGTH_UNKNOWN UINT64_MAX
+
+typedef struct _trace_binary_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t flags;
+} trace_binary_header_t;
+
+typedef struct _trace_binary_record_t
+{
+    uint32_t instruction_address;
+    int32_t op_code;
+    int32_t dest_reg;
+    int32_t src_reg[2];
+    int32_t branch;         //TRACE_FLAG_BRANCH
+    uint32_t branch_target;
+    uint32_t data_address;  //TRACE_FLAG_ADDRESS
+} trace_binary_record_t;
+
+//Size of a record without optional fields, the smallest accepted
+#define TRACE_RECORD_BASE offsetof(trace_binary_record_t, branch)
+
+typedef struct _trace_t
+{
+    FILE* file;
+    bool binary;
+    bool seekable;
+    uint32_t record_size;   //binary only
+    uint32_t flags;         //binary only, TRACE_FLAG_* fields the records carry
+    uint64_t position;      //index of the next instruction read
+    uint64_t length;        //instructions in the trace, TRACE_LENGTH_UNKNOWN without index
+    uint64_t stride;        //instructions between index entries, 0 without an index
+    uint64_t entries;
+    uint64_t* offsets;      //byte offset of instruction i*stride
+} trace_t;
+
+trace_t* trace_open(const char* path);
+void trace_close(trace_t* trace);
+bool trace_read(trace_t* trace, proc_inst_t* p_inst);
+bool trace_seek(trace_t* trace, uint64_t n);
+
+bool trace_build_index(const char* path, uint64_t stride);
+uint64_t trace_write_binary(trace_t* trace, FILE* out);
+
+#endif /* PROCSIM_TRACE_HPP */